@@ -1,12 +1,15 @@
 #ifndef AGENTS_ABSTRACTAGENT_H
 #define AGENTS_ABSTRACTAGENT_H
 
+#include <cmath>
 #include <i3d/image3d.h>
 #include "../util/report.h"
 #include "../DisplayUnits/DisplayUnit.h"
 #include "../Geometries/Geometry.h"
 #include "../FrontOfficer.h"
 #include "../util/strings.h"
+#include "../util/Checkpoint.h"
+#include "../util/rnd_generators.h"
 
 /**
  * This class is essentially only a read-only representation of
@@ -186,6 +189,18 @@ public:
 		return currTime;
 	}
 
+	/** returns a stream of random numbers that is private to this agent, to its
+	    current local time (round) and to the 'purpose' (any non-negative number that
+	    tells apart independent uses within the same round); the stream yields the same
+	    numbers regardless of which FO or thread asks for them, see rndStream; negative
+	    purposes are reserved for streams of no agent, see e_nonAgentStreamPurposes */
+	rndStream getRandomStream(const int purpose) const
+	{
+		if (purpose < 0)
+			throw ERROR_REPORT("Agent " << ID << " asks for random stream of negative purpose " << purpose);
+		return rndStream(ID, (int)std::lround(currTime/incrTime), purpose);
+	}
+
 	/** This method is considered as a callback function, also known as the
 	    "texture hook", and it should be regularly executed from the main
 	    simulator (the Officer). Technically, the method should be called
@@ -329,5 +344,33 @@ public:
 	virtual
 	//template <class T> //T = just some Type
 	void drawForDebug(i3d::Image3d<i3d::GRAY16>&) {};
+
+
+	// ------------- checkpointing -------------
+	/** Returns the name under which the agent's class is registered in the AgentsFactory,
+	    or NULL if the agent cannot be saved into a checkpoint (which is the default).
+	    A checkpointable class must override this method as well as the two below,
+	    and must be registered in the AgentsFactory. */
+	virtual
+	const char* getCheckpointClassName(void) const { return NULL; }
+
+	/** Writes the agent's state into the checkpoint, everything except for its ID, type,
+	    local time and exported geometry (these are saved by the FO and passed back into
+	    the c'tor via the AgentsFactory); overriding methods should call this one first. */
+	virtual
+	void saveCheckpoint(CheckpointWriter& cp) const
+	{
+		cp.put(detailedDrawingMode);
+		cp.put(detailedReportingMode);
+	}
+
+	/** Reads back what the saveCheckpoint() has written, it is called on an agent
+	    that was freshly created with the AgentsFactory. */
+	virtual
+	void loadCheckpoint(CheckpointReader& cp)
+	{
+		detailedDrawingMode   = cp.get<bool>();
+		detailedReportingMode = cp.get<bool>();
+	}
 };
 #endif
@@ -1,5 +1,12 @@
+#include "util/AgentsFactory.h"
 #include "Nucleus4SAgent.h"
 
+static AgentsFactory::Registration nucleus4SAgentRegistration("Nucleus4SAgent",
+	[](const int ID, const std::string& type, const Geometry& geom, const float currTime, const float incrTime)
+	{
+		return new Nucleus4SAgent(ID,type, AgentsFactory::expectGeometry<Spheres>(geom,ID), currTime,incrTime);
+	});
+
 void Nucleus4SAgent::getCurrentOffVectorsForCentres(Vector3d<G_FLOAT> offs[4])
 {
 	//the centre point
@@ -20,6 +20,22 @@ public:
 		centreDistance[2] = (geometryAlias.centres[3] - geometryAlias.centres[2]).len();
 	}
 
+	// ------------- checkpointing -------------
+	const char* getCheckpointClassName(void) const override
+	{ return "Nucleus4SAgent"; }
+
+	void saveCheckpoint(CheckpointWriter& cp) const override
+	{
+		NucleusAgent::saveCheckpoint(cp);
+		cp.putArray(centreDistance,3);
+	}
+
+	void loadCheckpoint(CheckpointReader& cp) override
+	{
+		NucleusAgent::loadCheckpoint(cp);
+		cp.getArray(centreDistance,3);
+	}
+
 
 protected:
 	// ------------- internals state -------------
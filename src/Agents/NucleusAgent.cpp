@@ -1,4 +1,5 @@
 #include "../util/surfacesamplers.h"
+#include "util/AgentsFactory.h"
 #include "NucleusAgent.h"
 
 const ForceName ftype_s2s       = "sphere-sphere";     //internal forces
@@ -19,6 +20,49 @@ const G_FLOAT fstrength_rep_scale      = (G_FLOAT)0.6;     // [1/um]      TRAgen
 const G_FLOAT fstrength_slide_scale    = (G_FLOAT)1.0;     // unitless
 const G_FLOAT fstrength_hinter_scale   = (G_FLOAT)0.25;    // [1/um^2]
 
+static AgentsFactory::Registration nucleusAgentRegistration("NucleusAgent",
+	[](const int ID, const std::string& type, const Geometry& geom, const float currTime, const float incrTime)
+	{
+		return new NucleusAgent(ID,type, AgentsFactory::expectGeometry<Spheres>(geom,ID), currTime,incrTime);
+	});
+
+
+void NucleusAgent::saveCheckpoint(CheckpointWriter& cp) const
+{
+	AbstractAgent::saveCheckpoint(cp);
+
+	cp.putVector3d(velocity_CurrentlyDesired);
+	cp.put(velocity_PersistenceTime);
+	cp.put(cytoplasmWidth);
+	cp.put(ignoreDistance);
+
+	//the geometryAlias is restored via the c'tor,
+	//and the forces are empty in between the rounds
+	cp.putGeometry(futureGeometry);
+	for (int i=0; i < futureGeometry.noOfSpheres; ++i)
+	{
+		cp.putVector3d(velocities[i]);
+		cp.put(weights[i]);
+	}
+}
+
+void NucleusAgent::loadCheckpoint(CheckpointReader& cp)
+{
+	AbstractAgent::loadCheckpoint(cp);
+
+	cp.getVector3d(velocity_CurrentlyDesired);
+	velocity_PersistenceTime = cp.get<G_FLOAT>();
+	cytoplasmWidth = cp.get<float>();
+	ignoreDistance = cp.get<float>();
+
+	cp.getGeometryInto(futureGeometry);
+	for (int i=0; i < futureGeometry.noOfSpheres; ++i)
+	{
+		cp.getVector3d(velocities[i]);
+		weights[i] = cp.get<G_FLOAT>();
+	}
+}
+
 
 void NucleusAgent::adjustGeometryByForces(void)
 {
@@ -191,6 +191,13 @@ public:
 		return velocities[index];
 	}
 
+	// ------------- checkpointing -------------
+	const char* getCheckpointClassName(void) const override
+	{ return "NucleusAgent"; }
+
+	void saveCheckpoint(CheckpointWriter& cp) const override;
+	void loadCheckpoint(CheckpointReader& cp) override;
+
 protected:
 	// ------------- rendering -------------
 	void drawMask(DisplayUnit& du) override;
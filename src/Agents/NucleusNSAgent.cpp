@@ -1,6 +1,13 @@
 #include <cmath>
+#include "util/AgentsFactory.h"
 #include "NucleusNSAgent.h"
 
+static AgentsFactory::Registration nucleusNSAgentRegistration("NucleusNSAgent",
+	[](const int ID, const std::string& type, const Geometry& geom, const float currTime, const float incrTime)
+	{
+		return new NucleusNSAgent(ID,type, AgentsFactory::expectGeometry<Spheres>(geom,ID), currTime,incrTime);
+	});
+
 void NucleusNSAgent::resetDistanceMatrix()
 {
 	for (int row=0; row < futureGeometry.noOfSpheres; ++row)
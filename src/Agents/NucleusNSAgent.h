@@ -21,6 +21,22 @@ public:
 		resetDistanceMatrix();
 	}
 
+	// ------------- checkpointing -------------
+	const char* getCheckpointClassName(void) const override
+	{ return "NucleusNSAgent"; }
+
+	void saveCheckpoint(CheckpointWriter& cp) const override
+	{
+		NucleusAgent::saveCheckpoint(cp);
+		cp.putArray(distanceMatrix.data, (size_t)(distanceMatrix.side*distanceMatrix.side));
+	}
+
+	void loadCheckpoint(CheckpointReader& cp) override
+	{
+		NucleusAgent::loadCheckpoint(cp);
+		cp.getArray(distanceMatrix.data, (size_t)(distanceMatrix.side*distanceMatrix.side));
+	}
+
 
 protected:
 	// ------------- internals state -------------
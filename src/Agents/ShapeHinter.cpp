@@ -1,8 +1,15 @@
 #include "../util/report.h"
 #include "../DisplayUnits/util/RenderingFunctions.h"
 #include "../util/surfacesamplers.h"
+#include "util/AgentsFactory.h"
 #include "ShapeHinter.h"
 
+static AgentsFactory::Registration shapeHinterRegistration("ShapeHinter",
+	[](const int ID, const std::string& type, const Geometry& geom, const float currTime, const float incrTime)
+	{
+		return new ShapeHinter(ID,type, AgentsFactory::expectGeometry<ScalarImg>(geom,ID), currTime,incrTime);
+	});
+
 void ShapeHinter::drawForDebug(DisplayUnit& du)
 {
 	if (detailedDrawingMode)
@@ -27,6 +27,11 @@ public:
 		DEBUG_REPORT("EmbryoShell with ID=" << ID << " was just deleted");
 	}
 
+	// ------------- checkpointing -------------
+	/** the (never changing) geometry is all the state there is */
+	const char* getCheckpointClassName(void) const override
+	{ return "ShapeHinter"; }
+
 
 private:
 	// ------------- internals state -------------
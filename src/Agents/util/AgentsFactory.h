@@ -0,0 +1,76 @@
+#ifndef AGENTSFACTORY_H
+#define AGENTSFACTORY_H
+
+#include <functional>
+#include <map>
+#include <string>
+#include "../../util/report.h"
+#include "../../Geometries/Geometry.h"
+
+class AbstractAgent;
+
+/**
+ * Registry of agent classes that can be re-created when the simulation is restarted
+ * from a checkpoint. A class is registered under the name that its
+ * AbstractAgent::getCheckpointClassName() returns, together with a function that
+ * creates a new agent from the agent's saved ID, type, exported geometry and local
+ * time; the rest of the agent's state is then restored with AbstractAgent::loadCheckpoint().
+ *
+ * Classes typically register themselves with a file-scope AgentsFactory::Registration
+ * object placed next to their implementation.
+ */
+class AgentsFactory
+{
+public:
+	typedef std::function<AbstractAgent*(const int ID, const std::string& type,
+	                                     const Geometry& geom,
+	                                     const float currTime, const float incrTime)> Creator;
+
+	static void registerClass(const std::string& className, const Creator& creator)
+	{
+		if (!creators().emplace(className,creator).second)
+			throw ERROR_REPORT("Agent class " << className << " is already registered");
+	}
+
+	static bool isRegistered(const std::string& className)
+	{ return creators().count(className) > 0; }
+
+	/** creates a new agent of the registered class, the 'geom' is not used after the call */
+	static AbstractAgent* create(const std::string& className,
+	                             const int ID, const std::string& type,
+	                             const Geometry& geom,
+	                             const float currTime, const float incrTime)
+	{
+		auto c = creators().find(className);
+		if (c == creators().end())
+			throw ERROR_REPORT("Cannot re-create agent " << ID << ", its class " << className << " is not registered");
+		return c->second(ID,type,geom,currTime,incrTime);
+	}
+
+	/** helper for the Creators: returns the 'geom' as the geometry the class expects */
+	template <class G>
+	static const G& expectGeometry(const Geometry& geom, const int ID)
+	{
+		const G* g = dynamic_cast<const G*>(&geom);
+		if (g == NULL)
+			throw ERROR_REPORT("Cannot re-create agent " << ID << " from geometry of type " << geom.getType());
+		return *g;
+	}
+
+	/** registers the class during the static initialization */
+	struct Registration
+	{
+		Registration(const char* className, const Creator& creator)
+		{ registerClass(className,creator); }
+	};
+
+private:
+	/** the registry, as a function-local static so that it exists
+	    before any of the static Registrations is initialized */
+	static std::map<std::string,Creator>& creators()
+	{
+		static std::map<std::string,Creator> registry;
+		return registry;
+	}
+};
+#endif
@@ -2,6 +2,7 @@
 #define CELLCYCLE_H
 
 #include "../../util/report.h"
+#include "../../util/Checkpoint.h"
 
 /**
  * Utility class that governs proper cycling through a (normal) cell cycle.
@@ -137,6 +138,24 @@ public:
 	    it makes sure that no run_phase_method is called with zero progress ratio */
 	void triggerCycleMethods(const float currentGlobalTime);
 
+	/** writes the phase durations and the progress through them into the checkpoint,
+	    to be called from the AbstractAgent::saveCheckpoint() of the cycling agent;
+	    the fullCycleDuration is not included, it comes via the c'tor */
+	void saveCellCycleCheckpoint(CheckpointWriter& cp) const
+	{
+		cp.putArray(phaseDurations,8);
+		cp.put(curPhase);
+		cp.put(lastPhaseChangeGlobalTime);
+	}
+
+	/** restores what saveCellCycleCheckpoint() has written, no phase_methods are called */
+	void loadCellCycleCheckpoint(CheckpointReader& cp)
+	{
+		cp.getArray(phaseDurations,8);
+		curPhase = cp.get<ListOfPhases>();
+		lastPhaseChangeGlobalTime = cp.get<float>();
+	}
+
 	// --------------------------------------------------
 	// the phase_methods
 
@@ -1,5 +1,6 @@
 #include <cmath>
-#include "../../util/texture/texture.h"
+#include <vector>
+#include "../../util/texture/perlin.h"
 #include "../../util/report.h"
 #include "Texture.h"
 
@@ -70,37 +71,90 @@ void Texture::createPerlinTexture(const Spheres& geom,
                                   const float quantization,
                                   const bool shouldCollectOutlyingDots)
 {
-	//setup the aux texture image
-	i3d::Image3d<float> img;
-	setupImageForRasterizingTexture(img,textureResolution, geom);
+	//the voxels of the texture image that would wrap around the 'geom' (see
+	//setupImageForRasterizingTexture()), the image itself is not created though
+	Vector3d<float> off;
+	Vector3d<size_t> size;
+	geom.AABB.adaptGrid(off,size, textureResolution);
 
 	//sanity check... if the 'geom' is "empty", no texture image is "wrapped" around it,
 	//we do no creation of the texture then...
-	if (img.GetImageSize() == 0)
+	if (size.x*size.y*size.z == 0)
 	{
 		DEBUG_REPORT("WARNING: Wrapping texture image is of zero size... stopping here.");
 		return;
 	}
 
-	//fill the aux image
-	DoPerlin3D(img, var,alpha,beta,n);
+	//own noise of this texture, reproducible given the state of the rngState
+	uint64_t seed = 0;
+	for (int i = 0; i < 4; ++i)
+		seed = (seed << 16) | (uint64_t)GetRandomUniform(0.f,65535.f, rngState);
+	const PerlinNoiseGenerator perlin(seed);
 
-	//get the current average intensity and adjust to the desired one
+	//evaluate the noise only for voxels inside the 'geom', a row at once, and keep
+	//only these values (in the order of the sweeping); the 'var' is in microns
+	std::vector<float> noise, xs,ys,zs;
+	Vector3d<size_t> pxPos;
+	Vector3d<float>  umPos;
+
+	for (pxPos.z = 0; pxPos.z < size.z; ++pxPos.z)
+	for (pxPos.y = 0; pxPos.y < size.y; ++pxPos.y)
+	{
+		xs.clear(); ys.clear(); zs.clear();
+		for (pxPos.x = 0; pxPos.x < size.x; ++pxPos.x)
+		{
+			umPos.toMicronsFrom(pxPos, textureResolution,off);
+			if (geom.collideWithPoint(umPos) >= 0)
+			{
+				xs.push_back( (float)(umPos.x / var) );
+				ys.push_back( (float)(umPos.y / var) );
+				zs.push_back( (float)(umPos.z / var) );
+			}
+		}
+
+		const size_t rowStart = noise.size();
+		noise.resize(rowStart + xs.size());
+		perlin.harmonicNoise(xs.data(),ys.data(),zs.data(), noise.data()+rowStart, xs.size(), alpha,beta,n);
+	}
+
+	if (noise.empty())
+	{
+		DEBUG_REPORT("WARNING: No texture voxel is inside the geometry... stopping here.");
+		return;
+	}
+
+	//get the current average intensity (inside the 'geom') and adjust to the desired one
 	double sum = 0;
-	float* i = img.GetFirstVoxelAddr();
-	float* const iL = i + img.GetImageSize();
-	for (; i != iL; ++i) sum += *i;
-	sum /= (double)img.GetImageSize();
+	for (const float v : noise) sum += v;
+	sum /= (double)noise.size();
 	//
 	const float textureIntShift = textureAverageIntensity - (float)sum;
-	for (i = img.GetFirstVoxelAddr(); i != iL; ++i)
+
+	//populate the dots by sweeping the same voxels again, see sampleDotsFromImage()
+	//NB: negative-valued texture voxels create no dots
+	const Vector3d<float> chaossSigma( Vector3d<float>(1.0f/6.0f).elemDivBy(textureResolution) );
+	const float* noiseVal = noise.data();
+
+	for (pxPos.z = 0; pxPos.z < size.z; ++pxPos.z)
+	for (pxPos.y = 0; pxPos.y < size.y; ++pxPos.y)
+	for (pxPos.x = 0; pxPos.x < size.x; ++pxPos.x)
 	{
-		*i += textureIntShift;
-		//*i  = std::max( *i, 0.f );
+		umPos.toMicronsFrom(pxPos, textureResolution,off);
+		if (geom.collideWithPoint(umPos) >= 0)
+		{
+			checkAndIncreaseCapacity();
+
+			//displace randomly within this voxel
+			for (int i = int((*noiseVal++ + textureIntShift)/quantization); i > 0; --i)
+			{
+				dots.emplace_back(umPos);
+				dots.back().pos += Vector3d<float>(
+				       GetRandomGauss(0.f,chaossSigma.x, rngState),
+				       GetRandomGauss(0.f,chaossSigma.y, rngState),
+				       GetRandomGauss(0.f,chaossSigma.z, rngState) );
+			}
+		}
 	}
-	sampleDotsFromImage(img,geom, quantization);
-	//NB: the function ignores any negative-valued texture image voxels,
-	//    no dots are created for such voxels
 
 	if (shouldCollectOutlyingDots)
 	{
@@ -212,6 +266,32 @@ inline float getBleachFactor(const short)
 #endif
 
 
+void Texture::saveTextureCheckpoint(CheckpointWriter& cp) const
+{
+	cp.put((uint64_t)dots.size());
+	for (const auto& dot : dots)
+	{
+		cp.putVector3d(dot.pos);
+		cp.put(dot.cntOfExcitations);
+		cp.put(dot.refractiveIdx);
+	}
+	cp.putRngState(rngState);
+}
+
+
+void Texture::loadTextureCheckpoint(CheckpointReader& cp)
+{
+	dots.resize((size_t)cp.get<uint64_t>());
+	for (auto& dot : dots)
+	{
+		cp.getVector3d(dot.pos);
+		dot.cntOfExcitations = cp.get<short>();
+		dot.refractiveIdx    = cp.get<float>();
+	}
+	cp.getRngState(rngState);
+}
+
+
 void Texture::renderIntoPhantom(i3d::Image3d<float> &phantoms, const float quantization)
 {
 	DEBUG_REPORT("going to render " << dots.size() << " dots");
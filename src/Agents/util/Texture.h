@@ -7,6 +7,7 @@
 #include <i3d/image3d.h>
 #include "../../util/report.h"
 #include "../../util/rnd_generators.h"
+#include "../../util/Checkpoint.h"
 #include "../../util/Dots.h"
 #include "../../Geometries/Geometry.h"
 #include "../../Geometries/Spheres.h"
@@ -93,6 +94,11 @@ public:
 	    the given 'geom' and shifted if necessary to assure that they are always within
 	    the given union of spheres (the 'geom').
 
+	    No texture image is actually created: the noise is evaluated only at the voxels
+	    (of the would-be image around the 'geom') that are inside the 'geom', and the
+	    average intensity is adjusted over these voxels. Every call uses its own Perlin
+	    noise (PerlinNoiseGenerator) seeded from the 'rngState'.
+
 	    Note that the Perlin noise created with the default parameters typically creates
 	    images with intensities within the range [-0.5;+0.5]. The 'textureAverageIntensity'
 	    is only shifting the range into [textureAverageIntensity-0.5,textureAverageIntensity+0.5].
@@ -124,6 +130,16 @@ public:
 
 	/** renders the current content of the this->dots list into the given phantom image */
 	void renderIntoPhantom(i3d::Image3d<float> &phantoms, const float quantization = 1);
+
+	// --------------------------------------------------
+	// checkpointing
+
+	/** writes the dots and the state of the rngState into the checkpoint, to be
+	    called from the AbstractAgent::saveCheckpoint() of the textured agent */
+	void saveTextureCheckpoint(CheckpointWriter& cp) const;
+
+	/** replaces the dots and the rngState with what saveTextureCheckpoint() has written */
+	void loadTextureCheckpoint(CheckpointReader& cp);
 };
 
 
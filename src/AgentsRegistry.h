@@ -0,0 +1,104 @@
+#ifndef AGENTSREGISTRY_H
+#define AGENTSREGISTRY_H
+
+#include <unordered_map>
+#include <vector>
+#include "util/report.h"
+#include "Communication/AgentsChecksum.h"
+
+/** A datatype to hold which agent lives at which FO. Agents are looked up,
+    added and removed in constant time (via a hash map), and the agents of
+    every FO are kept in a dense array so that they can be iterated in bulk;
+    the order of agents within an FO is not preserved upon removals;
+    checksums of IDs of agents of every FO are maintained along the way. */
+class AgentsRegistry
+{
+public:
+	/** registers the agent 'agentID' to be living at the FO 'FO' */
+	void add(const int agentID, const int FO)
+	{
+		if (FO < 0) throw ERROR_REPORT("Cannot register agent " << agentID << " at FO #" << FO);
+		if ((size_t)FO >= agentsAtFO.size())
+		{
+			agentsAtFO.resize((size_t)FO+1);
+			checksumsAtFO.resize((size_t)FO+1);
+		}
+
+		std::vector<int>& atFO = agentsAtFO[(size_t)FO];
+		if (!records.emplace(agentID, Record{FO,atFO.size()}).second)
+			throw ERROR_REPORT("Agent " << agentID << " is already registered (at FO #" << getFO(agentID) << ")");
+		atFO.push_back(agentID);
+		checksumsAtFO[(size_t)FO].addID(agentID);
+	}
+
+	/** unregisters the agent 'agentID', which must be registered */
+	void remove(const int agentID)
+	{
+		auto rec = records.find(agentID);
+		if (rec == records.end())
+			throw ERROR_REPORT("Couldn't find a record about agent " << agentID);
+
+		//move the last agent of the same FO into the vacated slot
+		std::vector<int>& atFO = agentsAtFO[(size_t)rec->second.FO];
+		const int lastID = atFO.back();
+		atFO[rec->second.pos] = lastID;
+		records[lastID].pos = rec->second.pos;
+		atFO.pop_back();
+		checksumsAtFO[(size_t)rec->second.FO].removeID(agentID);
+
+		records.erase(rec);
+	}
+
+	/** returns the FO of the agent 'agentID', or -1 if the agent is not registered */
+	int getFO(const int agentID) const
+	{
+		auto rec = records.find(agentID);
+		return rec != records.end() ? rec->second.FO : -1;
+	}
+
+	bool contains(const int agentID) const
+	{ return records.count(agentID) > 0; }
+
+	/** returns the number of all registered agents */
+	size_t size() const
+	{ return records.size(); }
+
+	/** returns IDs of all agents registered at the FO 'FO' */
+	const std::vector<int>& getAgentsOfFO(const int FO) const
+	{
+		return (FO >= 0 && (size_t)FO < agentsAtFO.size()) ? agentsAtFO[(size_t)FO] : noAgents;
+	}
+
+	/** returns the checksum of IDs (the AgentsChecksum::versions is not used)
+	    of all agents registered at the FO 'FO' */
+	const AgentsChecksum& getChecksumOfFO(const int FO) const
+	{
+		return (FO >= 0 && (size_t)FO < checksumsAtFO.size()) ? checksumsAtFO[(size_t)FO] : noChecksum;
+	}
+
+	/** calls fn(agentID,FO) for every registered agent, FO after FO */
+	template <typename FN>
+	void forEach(FN fn) const
+	{
+		for (size_t FO = 0; FO < agentsAtFO.size(); ++FO)
+			for (int agentID : agentsAtFO[FO]) fn(agentID,(int)FO);
+	}
+
+	/** prepares the registry for the given number of agents */
+	void reserve(const size_t noOfAgents)
+	{ records.reserve(noOfAgents); }
+
+private:
+	struct Record
+	{
+		int FO;      //where the agent lives
+		size_t pos;  //index of the agent within agentsAtFO[FO]
+	};
+
+	std::unordered_map<int,Record> records;
+	std::vector< std::vector<int> > agentsAtFO;
+	std::vector<AgentsChecksum> checksumsAtFO;
+	const std::vector<int> noAgents;
+	const AgentsChecksum noChecksum;
+};
+#endif
@@ -0,0 +1,77 @@
+#ifndef AGENTSCHECKSUM_H
+#define AGENTSCHECKSUM_H
+
+#include <cstdint>
+
+/**
+ * Order-independent fingerprint of a set of agents: their count, XOR of
+ * their (scrambled) IDs, and a sum of their (scrambled) IDs paired with
+ * geometry versions. Agents can be added and removed in any order, and
+ * the IDs part can be maintained without knowing the versions (that's
+ * what the Director does).
+ *
+ * FOs attach the fingerprint of all their agents to the header of every
+ * AABBs broadcast, so that the receivers can verify that they see the
+ * same agents without any extra round trip.
+ */
+class AgentsChecksum
+{
+public:
+	uint64_t count = 0;
+	uint64_t IDs = 0;
+	uint64_t versions = 0;
+
+	/** number of uint64_t items that toHeader() writes */
+	static const int headerItems = 3;
+
+	void add(const int agentID, const int version)
+	{
+		addID(agentID);
+		versions += mix(mix((uint64_t)agentID) ^ (uint32_t)version);
+	}
+
+	void addID(const int agentID)
+	{
+		++count;
+		IDs ^= mix((uint64_t)agentID);
+	}
+
+	void removeID(const int agentID)
+	{
+		--count;
+		IDs ^= mix((uint64_t)agentID);
+	}
+
+	bool equalIDs(const AgentsChecksum& c) const
+	{ return count == c.count && IDs == c.IDs; }
+
+	bool operator==(const AgentsChecksum& c) const
+	{ return equalIDs(c) && versions == c.versions; }
+
+	bool operator!=(const AgentsChecksum& c) const
+	{ return !(*this == c); }
+
+	void toHeader(uint64_t* header) const
+	{
+		header[0] = count;
+		header[1] = IDs;
+		header[2] = versions;
+	}
+
+	void fromHeader(const uint64_t* header)
+	{
+		count    = header[0];
+		IDs      = header[1];
+		versions = header[2];
+	}
+
+private:
+	/** the finalizer of the SplitMix64, scatters consecutive IDs over all bits */
+	static uint64_t mix(uint64_t x)
+	{
+		x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+		x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	}
+};
+#endif
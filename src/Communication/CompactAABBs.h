@@ -0,0 +1,201 @@
+#ifndef COMPACTAABBS_H
+#define COMPACTAABBS_H
+
+#include "DistributedCommunicator.h"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/**
+ * Compact wire format of the AABBs (and of IDs of dead agents) that FOs
+ * broadcast to each other. Corners are stored as 16-bit multiples of the
+ * 'quantum' relative to the 'origin', the min corner is rounded down and
+ * the max corner up so the transferred boxes can only grow (and thus
+ * remain conservative). IDs and versions are stored as variable-length
+ * integers, IDs as differences to the previous ID in the list, and agent
+ * types as indices into a table of the distinct types of the message.
+ *
+ * Layout: origin (3x G_FLOAT), quantum (G_FLOAT), no. of types (varint),
+ * types (8 bytes each), AABBs (delta ID, type index, version as varints,
+ * followed by 6x uint16), dead IDs (delta IDs as varints).
+ */
+class CompactAABBs
+{
+public:
+	/** encodes the AABBs and dead IDs into the 'out' buffer (which is resized
+	    accordingly), returns false if some corner cannot be expressed within
+	    the 16-bit range of the given quantum and origin; the lists are best
+	    given sorted by IDs as the IDs are then encoded in fewer bytes */
+	static bool encode(const std::vector<t_aabb>& aabbs, const std::vector<int>& deadIDs,
+	                   const Vector3d<G_FLOAT>& origin, const G_FLOAT quantum,
+	                   std::vector<char>& out)
+	{
+		out.clear();
+		out.reserve(4*sizeof(G_FLOAT) + aabbs.size()*(6*sizeof(uint16_t)+4) + deadIDs.size()*2);
+		putRaw(out, origin.x);
+		putRaw(out, origin.y);
+		putRaw(out, origin.z);
+		putRaw(out, quantum);
+
+		//table of types: agents typically share a few types only
+		std::vector<unsigned long long> types;
+		std::vector<uint64_t> typeIdx(aabbs.size());
+		for (size_t i = 0; i < aabbs.size(); ++i)
+		{
+			size_t t = 0;
+			while (t < types.size() && types[t] != aabbs[i].atype) ++t;
+			if (t == types.size()) types.push_back(aabbs[i].atype);
+			typeIdx[i] = t;
+		}
+		putVarint(out, types.size());
+		for (auto t : types) putRaw(out, t);
+
+		int lastID = 0;
+		uint16_t q[6];
+		for (size_t i = 0; i < aabbs.size(); ++i)
+		{
+			const t_aabb& a = aabbs[i];
+			if (!quantize(a.minCorner.x, origin.x, quantum, false, q[0])
+			 || !quantize(a.minCorner.y, origin.y, quantum, false, q[1])
+			 || !quantize(a.minCorner.z, origin.z, quantum, false, q[2])
+			 || !quantize(a.maxCorner.x, origin.x, quantum, true,  q[3])
+			 || !quantize(a.maxCorner.y, origin.y, quantum, true,  q[4])
+			 || !quantize(a.maxCorner.z, origin.z, quantum, true,  q[5])) return false;
+
+			putVarint(out, zigzag((int64_t)a.id - lastID));
+			lastID = a.id;
+			putVarint(out, typeIdx[i]);
+			putVarint(out, zigzag(a.version));
+			for (auto c : q) putRaw(out, c);
+		}
+
+		lastID = 0;
+		for (int id : deadIDs)
+		{
+			putVarint(out, zigzag((int64_t)id - lastID));
+			lastID = id;
+		}
+		return true;
+	}
+
+	/** decodes the buffer made with encode(), the expected numbers of AABBs and of
+	    dead IDs must be provided (they travel in the header of the broadcast) */
+	static void decode(const char* in, const size_t size,
+	                   const size_t noOfAABBs, const size_t noOfDeadIDs,
+	                   std::vector<t_aabb>& aabbs, std::vector<int>& deadIDs)
+	{
+		const char* const end = in + size;
+		Vector3d<G_FLOAT> origin;
+		G_FLOAT quantum;
+		getRaw(in, end, origin.x);
+		getRaw(in, end, origin.y);
+		getRaw(in, end, origin.z);
+		getRaw(in, end, quantum);
+
+		std::vector<unsigned long long> types((size_t)getVarint(in, end));
+		for (auto& t : types) getRaw(in, end, t);
+
+		aabbs.resize(noOfAABBs);
+		int lastID = 0;
+		uint16_t q[6];
+		for (auto& a : aabbs)
+		{
+			a.id = lastID + (int)unzigzag(getVarint(in, end));
+			lastID = a.id;
+			const uint64_t t = getVarint(in, end);
+			if (t >= types.size())
+				throw ERROR_REPORT("Corrupted compact AABBs: type index " << t << " out of " << types.size());
+			a.atype = types[t];
+			a.version = (int)unzigzag(getVarint(in, end));
+			for (auto& c : q) getRaw(in, end, c);
+
+			a.minCorner.x = dequantize(origin.x, quantum, q[0]);
+			a.minCorner.y = dequantize(origin.y, quantum, q[1]);
+			a.minCorner.z = dequantize(origin.z, quantum, q[2]);
+			a.maxCorner.x = dequantize(origin.x, quantum, q[3]);
+			a.maxCorner.y = dequantize(origin.y, quantum, q[4]);
+			a.maxCorner.z = dequantize(origin.z, quantum, q[5]);
+		}
+
+		deadIDs.resize(noOfDeadIDs);
+		lastID = 0;
+		for (auto& id : deadIDs)
+		{
+			id = lastID + (int)unzigzag(getVarint(in, end));
+			lastID = id;
+		}
+	}
+
+	/** the one and only way to turn the quantized coordinate back,
+	    both encode() and decode() must agree on it to the last bit */
+	static G_FLOAT dequantize(const G_FLOAT origin, const G_FLOAT quantum, const long q)
+	{
+		return (G_FLOAT)((double)origin + (double)quantum*(double)q);
+	}
+
+	/** rounds the 'value' down (or up if 'roundUp'), returns false if it
+	    doesn't fit into the 16-bit range */
+	static bool quantize(const G_FLOAT value, const G_FLOAT origin, const G_FLOAT quantum,
+	                     const bool roundUp, uint16_t& q)
+	{
+		const double k = ((double)value - (double)origin) / (double)quantum;
+		if (!std::isfinite(k) || k < -1.0 || k > 65536.0) return false;
+
+		long kk = roundUp ? (long)std::ceil(k) : (long)std::floor(k);
+		//make sure the rounding errors didn't get us inside the box
+		if (roundUp) { while (dequantize(origin,quantum,kk) < value) ++kk; }
+		else         { while (dequantize(origin,quantum,kk) > value) --kk; }
+
+		if (kk < 0 || kk > 65535) return false;
+		q = (uint16_t)kk;
+		return true;
+	}
+
+private:
+	static uint64_t zigzag(const int64_t v)
+	{ return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+
+	static int64_t unzigzag(const uint64_t v)
+	{ return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+	static void putVarint(std::vector<char>& out, uint64_t v)
+	{
+		while (v >= 0x80)
+		{
+			out.push_back((char)(v | 0x80));
+			v >>= 7;
+		}
+		out.push_back((char)v);
+	}
+
+	static uint64_t getVarint(const char*& in, const char* const end)
+	{
+		uint64_t v = 0;
+		for (int shift = 0; shift < 64; shift += 7)
+		{
+			if (in == end) throw ERROR_REPORT("Corrupted compact AABBs: truncated varint");
+			const unsigned char b = (unsigned char)*in++;
+			v |= (uint64_t)(b & 0x7f) << shift;
+			if (b < 0x80) return v;
+		}
+		throw ERROR_REPORT("Corrupted compact AABBs: too long varint");
+	}
+
+	template <typename T>
+	static void putRaw(std::vector<char>& out, const T v)
+	{
+		const size_t off = out.size();
+		out.resize(off + sizeof(T));
+		std::memcpy(out.data()+off, &v, sizeof(T));
+	}
+
+	template <typename T>
+	static void getRaw(const char*& in, const char* const end, T& v)
+	{
+		if ((size_t)(end - in) < sizeof(T)) throw ERROR_REPORT("Corrupted compact AABBs: truncated data");
+		std::memcpy(&v, in, sizeof(T));
+		in += sizeof(T);
+	}
+};
+#endif
@@ -3,10 +3,11 @@
 #include "../FrontOfficer.h"
 #include <chrono>
 #include <thread>
+#include <vector>
 
-void Director::respond_getNextAvailAgentID()
+void Director::respond_getNextAvailAgentIDs(const int noOfIDs)
 {
-	communicator->sendNextID(getNextAvailAgentID());
+	communicator->sendNextIDs(getNextAvailAgentIDs(noOfIDs), noOfIDs);
 }
 
 
@@ -28,6 +29,29 @@ void Director::respond_updateParentalLink(int FO)
 }
 
 
+void Director::respond_agentsEvents(int FO, const int* events, const int count)
+{
+	for (int i = 0; i+2 < count; i += 3)
+	{
+		switch (events[i])
+		{
+		case AGENT_EVENT_START:
+			startNewAgent(events[i+1], FO, events[i+2] != 0);
+			break;
+		case AGENT_EVENT_CLOSE:
+			closeAgent(events[i+1], FO);
+			break;
+		case AGENT_EVENT_PARENT:
+			startNewDaughterAgent(events[i+1], events[i+2]);
+			break;
+		default:
+			throw ERROR_REPORT("Unknown agents lifecycle event " << events[i] << " from FO #" << FO);
+		}
+	}
+	communicator->sendACKtoFO(FO);
+}
+
+
 void Director::notify_publishAgentsAABBs(const int FOsID)
 {
 	//int buffer[1] = {0};
@@ -40,21 +64,43 @@ void Director::waitFor_publishAgentsAABBs()
 {
 	//This method needs to be executed so that the broadcasted messages do not stay in the queue
 	DEBUG_REPORT("Director is running AABB reporting cycle");
-	t_aabb * sentAABBs;
 	int total_AABBs = 0;
 	for (int i = 1 ; i <= FOsCount ; i++) {
-		int aabb_count = (int)communicator->cntOfAABBs(i, true);
-		//In reality, following is dummy code needed to correctly distribute broadcasts through all nodes
-		//sentAABBs = new t_aabb[aabb_count];
-		sentAABBs = (t_aabb*) malloc(sizeof(t_aabb)*(aabb_count+1));
+		//In reality, following is dummy code needed to correctly distribute broadcasts through all nodes,
+		//it mirrors FrontOfficer::respond_AABBsDelta(): header, changed AABBs, IDs of dead agents
+		//(or both of them in the compact format)
+		uint64_t header[AABBS_HEADER_ITEMS] = {0};
+		int cnt = AABBS_HEADER_ITEMS;
+		communicator->receiveBroadcast(header, cnt, i, e_comm_tags::count_AABB);
+
+		int aabb_count = (int)header[0];
+		int dead_count = (int)header[1];
 		total_AABBs += aabb_count;
-		communicator->receiveBroadcast(sentAABBs, aabb_count, i, e_comm_tags::send_AABB);
-		//delete [] sentAABBs;
-		free(sentAABBs);
+
+		//the header carries (for free) a checksum of all agents of the FO,
+		//the IDs part of it must agree with our registry
+		AgentsChecksum checksum;
+		checksum.fromHeader(header+4);
+		if (!checksum.equalIDs(agents.getChecksumOfFO(i)))
+			throw ERROR_REPORT("FO #" << i << " announces " << checksum.count << " agents but "
+			                   << agents.getChecksumOfFO(i).count << " are registered there, or they differ");
+
+		if (header[3])
+		{
+			int compact_size = (int)header[3];
+			std::vector<char> compactAABBs(header[3]);
+			communicator->receiveBroadcast(compactAABBs.data(), compact_size, i, e_comm_tags::compact_AABB);
+			continue;
+		}
+
+		std::vector<t_aabb> sentAABBs(aabb_count);
+		communicator->receiveBroadcast(sentAABBs.data(), aabb_count, i, e_comm_tags::send_AABB);
+		std::vector<int> deadIDs(dead_count);
+		communicator->receiveBroadcast(deadIDs.data(), dead_count, i, e_comm_tags::dead_AABB);
 		//End of dummy code
 	}
 	communicator->waitFor_publishAgentsAABBs();
-	DEBUG_REPORT("Director has finished AABB reporting cycle with global size " << total_AABBs);
+	DEBUG_REPORT("Director has finished AABB reporting cycle with " << total_AABBs << " changed AABBs");
 	respond_newAgentsTypes(0);
 }
 
@@ -127,19 +173,16 @@ void Director::respond_Loop()
 			std::this_thread::sleep_for((std::chrono::milliseconds)10);
 			continue;
 		}*/
+		//blocks until a request comes, or until wakeUpResponder() is called
 		tag=communicator->detectFOMessage(false);
 		if (communicator->isFinished()) { break; }
-		if (tag == e_comm_tags::ACK) {
-			REPORT("ACK on Director Communicator on Director");
-			std::this_thread::sleep_for((std::chrono::milliseconds)10);
-			continue;
-		}
+		if (tag == e_comm_tags::unspecified) { continue; }
 		items = DIRECTOR_RECV_MAX;
 		switch (tag) {
 			case e_comm_tags::get_next_ID:
-				communicator->receiveFOMessage(buffer, items, instance, tag);
-				assert(items == 0);
-				respond_getNextAvailAgentID();
+				communicator->receiveFOMessage(ibuffer, items, instance, tag);
+				assert(items == 1);
+				respond_getNextAvailAgentIDs(ibuffer[0]);
 				break;
 			case e_comm_tags::new_agent:
 				communicator->receiveFOMessage(ibuffer, items, instance, tag);
@@ -159,6 +202,11 @@ void Director::respond_Loop()
 				closeAgent(ibuffer[0], ibuffer[1]);
 				respond_closeAgent(instance);
 				break;
+			case e_comm_tags::agents_events:
+				communicator->receiveFOMessage(ibuffer, items, instance, tag);
+				assert(items % 3 == 0);
+				respond_agentsEvents(instance, ibuffer, items);
+				break;
 			case e_comm_tags::send_AABB: //Forgotten round-robin
 				communicator->receiveFOMessage(ibuffer, items, instance, tag);
 				assert(items == 0);
@@ -172,6 +220,9 @@ void Director::respond_Loop()
 			case e_comm_tags::set_debug:
 				communicator->receiveFOMessage(buffer, items, instance, tag);
 				break;
+			case e_comm_tags::noop:
+				communicator->receiveFOMessage(buffer, items, instance, tag);
+				break;
 			case e_comm_tags::finished:
 				finished++;
 				REPORT("Finished FOs total: " << finished << " out of " << FOsCount << " on Director");
@@ -258,6 +309,9 @@ void Director::broadcast_throwException(const char* exceptionMessage)
 
 void Director::close_communication()
 {
+	//the responder, once woken up, leaves on its own
+	communicator->wakeUpResponder();
+	if (responder.joinable()) responder.join();
 	communicator->close();
 }
 
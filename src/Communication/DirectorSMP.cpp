@@ -4,16 +4,16 @@
 //in the SMP world, a lot of respond_...() methods are actually
 //empty because the FOs reach directly the implementing code
 
-void Director::respond_getNextAvailAgentID()
+void Director::respond_getNextAvailAgentIDs(const int)
 {
 	//this never happens (as FO here talks directly to the Direktor)
 	//MPI world:
 
-	//gets : nothing
-	//gives: int
+	//gets : int
+	//gives: int, int
 
 	/*
-	int sendBackThisNewID = getNextAvailAgentID();
+	int sendBackThisNewID = getNextAvailAgentIDs(noOfIDs);
 	*/
 }
 
@@ -72,6 +72,16 @@ void Director::respond_updateParentalLink(int)
 	*/
 }
 
+
+void Director::respond_agentsEvents(int, const int*, const int)
+{
+	//this never happens (as FO here talks directly to the Direktor)
+	//MPI world:
+
+	//gets : int triplets
+	//gives: nothing
+}
+
 /*
 void Director::respond_willRenderNextFrameFlag()
 {
@@ -3,6 +3,136 @@
 #include <thread>
 
 #ifdef DISTRIBUTED
+int DistributedCommunicator::getNextAvailAgentID()
+{
+	//the Director hands out blocks of IDs, ask for the next one early
+	//so that it is likely here before the current one runs out
+	if (!agentIDsRequested && agentIDsBlockEnd - agentIDsBlockNext <= AGENT_IDS_BLOCK_SIZE/4)
+	{
+		int buffer [] = {AGENT_IDS_BLOCK_SIZE};
+		sendDirector(buffer, 1, e_comm_tags::get_next_ID);
+		agentIDsRequested = true;
+	}
+
+	if (agentIDsBlockNext == agentIDsBlockEnd)
+	{
+		//blocks and waits until it gets the block back from the Director
+		e_comm_tags tag = e_comm_tags::next_ID;
+		int id_cnt = 2;
+		int buffer [] = {0,0};
+		receiveDirectorMessage(buffer, id_cnt, tag);
+		agentIDsRequested = false;
+		agentIDsBlockNext = buffer[0];
+		agentIDsBlockEnd  = buffer[0] + buffer[1];
+		DEBUG_REPORT("From FO " << instance_ID << " to Director: got new agent IDs " << agentIDsBlockNext << "-" << agentIDsBlockEnd-1);
+	}
+
+	return agentIDsBlockNext++;
+}
+
+void DistributedCommunicator::startNewAgent(const int newAgentID, const int associatedFO, const bool wantsToAppearInCTCtracksTXTfile)
+{
+	int buffer [] = {newAgentID, associatedFO, wantsToAppearInCTCtracksTXTfile};
+	DEBUG_REPORT("From FO " << associatedFO << " to Director: start new agent ID=" << newAgentID << ((wantsToAppearInCTCtracksTXTfile)?" (CTC)":"") );
+	sendDirector(buffer, sizeof(buffer)/sizeof(int), e_comm_tags::new_agent);
+	receiveDirectorACK();
+}
+
+void DistributedCommunicator::closeAgent(const int agentID, const int associatedFO)
+{
+	int buffer [] = {agentID, associatedFO};
+	sendDirector(buffer, sizeof(buffer)/sizeof(int), e_comm_tags::close_agent);
+	receiveDirectorACK();
+	DEBUG_REPORT("From FO " << associatedFO << " to Director: close agent ID=" << agentID );
+}
+
+void DistributedCommunicator::startNewDaughterAgent(const int childID, const int parentID)
+{
+	int buffer [] = {childID, parentID};
+	sendDirector(buffer, sizeof(buffer)/sizeof(int), e_comm_tags::update_parent);
+	receiveDirectorACK();
+}
+
+void DistributedCommunicator::sendAgentsEvents(int* events, const int count)
+{
+	DEBUG_REPORT("From FO " << instance_ID << " to Director: " << count/3 << " agents lifecycle events");
+	sendDirector(events, count, e_comm_tags::agents_events);
+	receiveDirectorACK();
+}
+
+void DistributedCommunicator::setAgentsDetailedDrawingMode(int FO, int agentID, bool state)
+{
+	int buffer [] = {agentID, state};
+	sendFO(buffer, sizeof(buffer)/sizeof(int), FO, e_comm_tags::set_detailed_drawing);
+	receiveFOACK(FO);
+}
+
+void DistributedCommunicator::setAgentsDetailedReportingMode(int FO, int agentID, bool state)
+{
+	int buffer [] = {agentID, state};
+	sendFO(buffer, sizeof(buffer)/sizeof(int), FO, e_comm_tags::set_detailed_reporting);
+	receiveFOACK(FO);
+}
+
+void DistributedCommunicator::publishAgentsAABBs(int FO)
+{
+	int buffer [] = {0};
+	sendFO(buffer, 0, FO, e_comm_tags::send_AABB); //FO!
+	//receiveFOACK(FO);
+}
+
+void DistributedCommunicator::renderNextFrame(int FO)
+{
+	int buffer [] = {0};
+	sendFO(buffer, 0, FO, e_comm_tags::render_frame);
+//	receiveFOACK(FO);
+}
+
+size_t DistributedCommunicator::cntOfAABBs(int FO, bool broadcast)
+{
+	e_comm_tags tag = e_comm_tags::count_AABB;
+	uint64_t buffer [] = {0};
+	int cnt = 1;
+	DEBUG_REPORT("Request AABBS total from #" << FO << ((broadcast)?" (broadcast)":"") << " at #" << instance_ID);
+	sendFO(buffer, 0, FO, e_comm_tags::get_count_AABB);
+	//DEBUG_REPORT("Waiting for AABBs total from " << FO);
+	if (broadcast) {
+		receiveBroadcast(buffer, cnt, FO, e_comm_tags::count_AABB);
+	} else {
+		receiveFOMessage(buffer, cnt, FO, tag);
+	}
+	DEBUG_REPORT("AABBS total " << buffer[0] << " from #" << FO);
+	return buffer[0];
+}
+
+void DistributedCommunicator::sendCntOfAABBs(size_t count_AABBs, bool broadcast)
+{
+	size_t buffer [] = {count_AABBs};
+	DEBUG_REPORT("Send AABBS total from #" << instance_ID << " total " << buffer[0] << ((broadcast)?" (broadcast)":""));
+	if (broadcast) {
+		sendBroadcast(buffer, 1, instance_ID, e_comm_tags::count_AABB);
+	} else {
+		sendDirector(buffer, 1, e_comm_tags::count_AABB);
+	}
+}
+
+
+void DistributedCommunicator::waitFor_publishAgentsAABBs() {
+	waitSync(e_comm_tags::send_AABB);
+}
+
+void DistributedCommunicator::waitFor_renderNextFrame() {
+	waitSync(e_comm_tags::float_image_data);
+}
+
+void DistributedCommunicator::sendNextIDs(int firstID, int noOfIDs) {
+	e_comm_tags tag = e_comm_tags::next_ID;
+	int buffer [] = {firstID, noOfIDs};
+	sendLastFO(buffer, 2, tag); /* MISSING Agent ID, for now solved with this variable !!!*/
+}
+
+
+#ifndef DISTRIBUTED_INPROCESS
 char MPI_Communicator::no_message[1] = {0};
 
 MPI_Communicator::~MPI_Communicator() {
@@ -183,70 +313,6 @@ bool MPI_Communicator::receiveFOMessage(void * buffer, int &recv_size, int & ins
 }
 
 
-int MPI_Communicator::getNextAvailAgentID()
-{
-	//return Direktor->getNextAvailAgentID();
-	//blocks and waits until it gets int back from the Director
-	e_comm_tags tag = e_comm_tags::next_ID;
-	int id_cnt = 1;
-	int buffer [] = {0};
-	sendDirector(buffer, 0, e_comm_tags::get_next_ID);
-	receiveDirectorMessage(buffer, id_cnt, tag);
-	DEBUG_REPORT("From FO " << instance_ID << " to Director: get new agent ID=" << buffer[0]);
-	return buffer[0];
-}
-
-void MPI_Communicator::startNewAgent(const int newAgentID, const int associatedFO, const bool wantsToAppearInCTCtracksTXTfile)
-{
-	int buffer [] = {newAgentID, associatedFO, wantsToAppearInCTCtracksTXTfile};
-	DEBUG_REPORT("From FO " << associatedFO << " to Director: start new agent ID=" << newAgentID << ((wantsToAppearInCTCtracksTXTfile)?" (CTC)":"") );
-	sendDirector(buffer, sizeof(buffer)/sizeof(int), e_comm_tags::new_agent);
-	receiveDirectorACK();
-}
-
-void MPI_Communicator::closeAgent(const int agentID, const int associatedFO)
-{
-	int buffer [] = {agentID, associatedFO};
-	sendDirector(buffer, sizeof(buffer)/sizeof(int), e_comm_tags::close_agent);
-	receiveDirectorACK();
-	DEBUG_REPORT("From FO " << associatedFO << " to Director: close agent ID=" << agentID );
-}
-
-void MPI_Communicator::startNewDaughterAgent(const int childID, const int parentID)
-{
-	int buffer [] = {childID, parentID};
-	sendDirector(buffer, sizeof(buffer)/sizeof(int), e_comm_tags::update_parent);
-	receiveDirectorACK();
-}
-
-void MPI_Communicator::setAgentsDetailedDrawingMode(int FO, int agentID, bool state)
-{
-	int buffer [] = {agentID, state};
-	sendFO(buffer, sizeof(buffer)/sizeof(int), FO, e_comm_tags::set_detailed_drawing);
-	receiveFOACK(FO);
-}
-
-void MPI_Communicator::setAgentsDetailedReportingMode(int FO, int agentID, bool state)
-{
-	int buffer [] = {agentID, state};
-	sendFO(buffer, sizeof(buffer)/sizeof(int), FO, e_comm_tags::set_detailed_reporting);
-	receiveFOACK(FO);
-}
-
-void MPI_Communicator::publishAgentsAABBs(int FO)
-{
-	int buffer [] = {0};
-	sendFO(buffer, 0, FO, e_comm_tags::send_AABB); //FO!
-	//receiveFOACK(FO);
-}
-
-void MPI_Communicator::renderNextFrame(int FO)
-{
-	int buffer [] = {0};
-	sendFO(buffer, 0, FO, e_comm_tags::render_frame);
-//	receiveFOACK(FO);
-}
-
 size_t MPI_Communicator::receiveRenderedFrame(int /*fromFO*/, int /*slice_size*/, int /*slices*/) {
 	/* Unused right now due to mergeImages method*/
 	return 0; //just to make compiler happy (i.e., w/o warnings)
@@ -262,16 +328,14 @@ void MPI_Communicator::mergeImages(int FO, int slice_size, int slices, unsigned
 
 	DEBUG_REPORT("From #" << instance_ID << " to #" << FO << " merge images plane size " << slice_size << " slices " << slices);
 	for (int slice = 0 ; slice < slices; slice++) {
-		int received_slice_size = (int) slice_size;
-		int received_from = MPI_ANY_SOURCE;
-		unsigned short * mask_start = maskPixelBuffer+slice*sizeof(unsigned short);
-		float * phantom_start = phantomBuffer+slice*sizeof(float);
-		float * optics_start = opticsBuffer+slice*sizeof(float);
+		unsigned short * mask_start = maskPixelBuffer+(size_t)slice*slice_size;
+		float * phantom_start = phantomBuffer+(size_t)slice*slice_size;
+		float * optics_start = opticsBuffer+(size_t)slice*slice_size;
 		if (instance_ID) { // Front officer - receives and send later
 			DEBUG_REPORT("Receive at FO #" << instance_ID << " slice " << slice);
-			if (maskPixelBuffer) { receiveMPIMessage(image_comm, mask_add, received_slice_size, tagMap(rmask), MPI_STATUSES_IGNORE, received_from, rmask); }
-			if (phantomBuffer) { receiveMPIMessage(image_comm, phantom_add, received_slice_size, tagMap(rimg), MPI_STATUSES_IGNORE, received_from, rimg);  }
-			if (opticsBuffer) { receiveMPIMessage(image_comm, optics_add, received_slice_size, tagMap(rimg), MPI_STATUSES_IGNORE, received_from, rimg); }
+			if (maskPixelBuffer) { receiveImageSlice(mask_add, slice_size, sizeof(unsigned short), rmask); }
+			if (phantomBuffer) { receiveImageSlice(phantom_add, slice_size, sizeof(float), rimg);  }
+			if (opticsBuffer) { receiveImageSlice(optics_add, slice_size, sizeof(float), rimg); }
 //			assert(received_slice_size == slice_size && received_from == instance_ID - 1);
 			for (int idx=0; idx < slice_size; idx++) {
 				if (maskPixelBuffer){ mask_start[idx] += mask_add[idx]; }
@@ -282,15 +346,15 @@ void MPI_Communicator::mergeImages(int FO, int slice_size, int slices, unsigned
 
 		DEBUG_REPORT("Send from #" << instance_ID << " to #" << FO << " slice " << slice);
 		//TBD Check if Director's image is zeroed
-		if (maskPixelBuffer) { sendMPIMessage(image_comm, mask_start, slice_size, tagMap(e_comm_tags::mask_data), FO , e_comm_tags::mask_data); }
-		if (phantomBuffer) { sendMPIMessage(image_comm, phantom_start, slice_size, tagMap(e_comm_tags::float_image_data), FO, e_comm_tags::float_image_data); }
-		if (opticsBuffer) { sendMPIMessage(image_comm, optics_start, slice_size, tagMap(e_comm_tags::float_image_data), FO, e_comm_tags::float_image_data); }
+		if (maskPixelBuffer) { sendImageSlice(mask_start, slice_size, sizeof(unsigned short), FO, e_comm_tags::mask_data); }
+		if (phantomBuffer) { sendImageSlice(phantom_start, slice_size, sizeof(float), FO, e_comm_tags::float_image_data); }
+		if (opticsBuffer) { sendImageSlice(optics_start, slice_size, sizeof(float), FO, e_comm_tags::float_image_data); }
 
 		if (!instance_ID) { // Director - receives last, directly apply to the buffer
 			DEBUG_REPORT("Receive at Director" << instance_ID << " slice " << slice);
-			if (maskPixelBuffer) { receiveMPIMessage(image_comm, mask_start, received_slice_size, tagMap(rmask), MPI_STATUSES_IGNORE, received_from, rmask); }
-			if (phantomBuffer) { receiveMPIMessage(image_comm, phantom_start, received_slice_size, tagMap(rimg), MPI_STATUSES_IGNORE, received_from, rimg);  }
-			if (opticsBuffer) { receiveMPIMessage(image_comm, optics_start, received_slice_size, tagMap(rimg), MPI_STATUSES_IGNORE, received_from, rimg); }
+			if (maskPixelBuffer) { receiveImageSlice(mask_start, slice_size, sizeof(unsigned short), rmask); }
+			if (phantomBuffer) { receiveImageSlice(phantom_start, slice_size, sizeof(float), rimg);  }
+			if (opticsBuffer) { receiveImageSlice(optics_start, slice_size, sizeof(float), rimg); }
 			//assert(received_slice_size == slice_size && received_from == instances - 1);
 		}
 	}
@@ -301,47 +365,51 @@ void MPI_Communicator::mergeImages(int FO, int slice_size, int slices, unsigned
 }
 
 
-size_t MPI_Communicator::cntOfAABBs(int FO, bool broadcast)
-{
-	e_comm_tags tag = e_comm_tags::count_AABB;
-	uint64_t buffer [] = {0};
-	int cnt = 1;
-	DEBUG_REPORT("Request AABBS total from #" << FO << ((broadcast)?" (broadcast)":"") << " at #" << instance_ID);
-	sendFO(buffer, 0, FO, e_comm_tags::get_count_AABB);
-	//DEBUG_REPORT("Waiting for AABBs total from " << FO);
-	if (broadcast) {
-		receiveBroadcast(buffer, cnt, FO, e_comm_tags::count_AABB);
-	} else {
-		receiveFOMessage(buffer, cnt, FO, tag);
-	}
-	DEBUG_REPORT("AABBS total " << buffer[0] << " from #" << FO);
-	return buffer[0];
-}
+void MPI_Communicator::sendImageSlice(void* data, const int items, const size_t elemSize, const int peer, const e_comm_tags tag) {
+	const size_t bytes = (size_t)items * elemSize;
+	if (compressPayloads && imageSlicesCompression.shouldCompress(bytes)) {
+		if (slicePackedBuffer.size() < bytes) slicePackedBuffer.resize(bytes);
 
-void MPI_Communicator::sendCntOfAABBs(size_t count_AABBs, bool broadcast)
-{
-	size_t buffer [] = {count_AABBs};
-	DEBUG_REPORT("Send AABBS total from #" << instance_ID << " total " << buffer[0] << ((broadcast)?" (broadcast)":""));
-	if (broadcast) {
-		sendBroadcast(buffer, 1, instance_ID, e_comm_tags::count_AABB);
-	} else {
-		sendDirector(buffer, 1, e_comm_tags::count_AABB);
-	}
-}
+		auto start = std::chrono::steady_clock::now();
+		const size_t packed = ByteShuffleLZ::compress((const char*)data, bytes, elemSize,
+		                          sliceScratchBuffer, slicePackedBuffer.data(), bytes);
+		auto end = std::chrono::steady_clock::now();
+		imageSlicesCompression.reportCompression(bytes, packed, std::chrono::duration<double>(end-start).count());
 
+		if (packed > 0) {
+			start = end;
+			sendMPIMessage(image_comm, slicePackedBuffer.data(), (int)packed, MPI_CHAR, peer, e_comm_tags::compressed_image_data);
+			end = std::chrono::steady_clock::now();
+			imageSlicesCompression.reportTransfer(packed, std::chrono::duration<double>(end-start).count());
+			return;
+		}
+	}
 
-void MPI_Communicator::waitFor_publishAgentsAABBs() {
-	waitSync(e_comm_tags::send_AABB);
+	auto start = std::chrono::steady_clock::now();
+	sendMPIMessage(image_comm, data, items, tagMap(tag), peer, tag);
+	imageSlicesCompression.reportTransfer(bytes, std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count());
 }
 
-void MPI_Communicator::waitFor_renderNextFrame() {
-	waitSync(e_comm_tags::float_image_data);
+void MPI_Communicator::receiveImageSlice(void* data, const int items, const size_t elemSize, const e_comm_tags tag) {
+	//only one peer sends to us in the mergeImages(), so whatever comes next is the slice
+	e_comm_tags gotTag = e_comm_tags::unspecified;
+	detectMPIMessage(image_comm, MPI_ANY_SOURCE, gotTag, false);
+
+	int received_from = MPI_ANY_SOURCE;
+	int received_items = items;
+	if (gotTag == e_comm_tags::compressed_image_data) {
+		//the sender compresses only if it gets smaller than the original
+		const size_t bytes = (size_t)items * elemSize;
+		if (slicePackedBuffer.size() < bytes) slicePackedBuffer.resize(bytes);
+		received_items = (int)bytes;
+		receiveMPIMessage(image_comm, slicePackedBuffer.data(), received_items, MPI_CHAR, MPI_STATUSES_IGNORE, received_from, gotTag);
+		ByteShuffleLZ::decompress(slicePackedBuffer.data(), (size_t)received_items, elemSize,
+		                          sliceScratchBuffer, (char*)data, bytes);
+	} else {
+		receiveMPIMessage(image_comm, data, received_items, tagMap(tag), MPI_STATUSES_IGNORE, received_from, tag);
+	}
 }
 
-void MPI_Communicator::sendNextID(int id) {
-	e_comm_tags tag = e_comm_tags::next_ID;
-	sendLastFO(&id, 1, tag); /* MISSING Agent ID, for now solved with this variable !!!*/
-}
 
 void MPI_Communicator::close() {
 	finished=true;
@@ -349,4 +417,5 @@ void MPI_Communicator::close() {
 	MPI_Finalize();
 }
 
+#endif /*DISTRIBUTED_INPROCESS*/
 #endif
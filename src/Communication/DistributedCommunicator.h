@@ -3,6 +3,7 @@
 
 #include "../Agents/AbstractAgent.h"
 #include "../util/report.h"
+#include <atomic>
 
 extern "C" {
 	typedef struct {
@@ -25,6 +26,13 @@ extern "C" {
 #define DIRECTOR_RECV_MAX (1<<20) // Receive buffer for director-only communication
 #define DIRECTOR_ID 0 			  // Main node
 #define FO_INSTANCE_ANY 0		  // Any FO is OK
+#define AABB_FULL_RESYNC_PERIOD 20 // Every this-th AABB exchange re-sends all AABBs, not only the changed ones
+#define AABBS_HEADER_ITEMS 7       // Header of the AABB exchange: 4 counts and flags, and the AgentsChecksum
+#define AGENT_IDS_BLOCK_SIZE 1024  // Agent IDs the Director hands out to an FO at once
+
+#define AGENT_EVENT_START  0 // Codes of the agents lifecycle events, see FrontOfficer::agentsEvents
+#define AGENT_EVENT_CLOSE  1
+#define AGENT_EVENT_PARENT 2
 
 
 typedef enum {
@@ -41,7 +49,14 @@ typedef enum {
 	get_shadow_copy=0xa,
 	shadow_copy=0xb,
 	shadow_copy_data=0xc,
+	dead_AABB=0xd,
+	get_shadow_copies=0xe,
+	compact_AABB=0xf,
 	render_frame=0x10,
+	ghost_copy=0x11,
+	ghost_copy_data=0x12,
+	agents_events=0x13,
+	ghost_copy_count=0x14,
 	set_detailed_drawing=0x20,
 	set_detailed_reporting=0x21,
 	set_debug=0x23, // rendering debug
@@ -50,6 +65,7 @@ typedef enum {
 	finished=0x32, //All work done
 	mask_data=0x41,
 	float_image_data=0x42,
+	compressed_image_data=0x43,
 	ACK=0x80,
 	noop=0x81,
 	barrier=0x82,
@@ -74,6 +90,11 @@ public:
 
 		virtual void close() {}
 
+		/** marks this communicator as finished and unblocks the responder thread
+		    of this instance that might be waiting in detectFOMessage(false),
+		    the responder then finds isFinished() to be true and shall leave */
+		virtual void wakeUpResponder() = 0;
+
 		/*** Communication channel to the director ***/
 
 		virtual int sendDirector(void *data, int count, e_comm_tags tag) = 0;
@@ -109,6 +130,13 @@ public:
 		virtual bool receiveFOMessage(void * buffer, int &recv_size, int & instance_ID,  e_comm_tags &tag) = 0; //Single reception step, for response messages
 		virtual int sendFO(void *data, int count, int instance_ID, e_comm_tags tag) = 0;
 
+		/** like sendFO() but returns without waiting for the receiver, the 'data'
+		    must be kept intact until waitForPostedFOs() returns */
+		virtual int postFO(void *data, int count, int instance_ID, e_comm_tags tag) = 0;
+
+		/** blocks until all messages posted with postFO() are sent */
+		virtual void waitForPostedFOs() = 0;
+
 		inline int sendLastFO(void *data, int count, e_comm_tags tag) {
 			return sendFO(data, count, lastFOID, tag);
 		}
@@ -153,29 +181,43 @@ public:
 
 		/*** Specific communication methods ***/
 
-		virtual int getNextAvailAgentID() = 0;
+		// these are built only from the primitives above, and are therefore
+		// shared by all communicators (see DistributedCommunicator.cpp)
+
+		virtual int getNextAvailAgentID();
 		/*{
 			return (instance_ID << shift) | (++internal_agent_ID); //Recalculate better to take into account milions of cells!!!
 		}*/
 
 
-		virtual void startNewAgent(const int newAgentID, const int associatedFO, const bool wantsToAppearInCTCtracksTXTfile = true) = 0;
-		virtual void closeAgent(const int agentID, const int associatedFO) = 0;
-		virtual void startNewDaughterAgent(const int childID, const int parentID) = 0;
+		virtual void startNewAgent(const int newAgentID, const int associatedFO, const bool wantsToAppearInCTCtracksTXTfile = true);
+		virtual void closeAgent(const int agentID, const int associatedFO);
+		virtual void startNewDaughterAgent(const int childID, const int parentID);
+
+		/** sends the batch of agents lifecycle events (see FrontOfficer::agentsEvents)
+		    to the Director and waits until it has been registered there */
+		virtual void sendAgentsEvents(int* events, const int count);
+
+		virtual void publishAgentsAABBs(int FO);
+		virtual void waitFor_publishAgentsAABBs();
+		virtual void waitFor_renderNextFrame();
+
+		virtual void sendNextIDs(int firstID, int noOfIDs);
 
-		virtual void publishAgentsAABBs(int FO) = 0;
-		virtual void waitFor_publishAgentsAABBs() = 0;
-		virtual void waitFor_renderNextFrame() = 0;
+		virtual void setAgentsDetailedDrawingMode(int FO, int agentID, bool state);
+		virtual void setAgentsDetailedReportingMode(int FO, int agentID, bool state);
 
-		virtual void sendNextID(int id) = 0;
+		virtual size_t cntOfAABBs(int FO, bool broadcast=false );
+		virtual void sendCntOfAABBs(size_t count_AABBs, bool broadcast=false);
 
-		virtual void setAgentsDetailedDrawingMode(int FO, int agentID, bool state) = 0;
-		virtual void setAgentsDetailedReportingMode(int FO, int agentID, bool state) = 0;
+		virtual void renderNextFrame(int FO);
 
-		virtual size_t cntOfAABBs(int FO, bool broadcast=false ) = 0;
-		virtual void sendCntOfAABBs(size_t count_AABBs, bool broadcast=false) = 0;
+		/** enables compression of the large payloads that this instance sends (when
+		    it pays off, see PayloadCompression.h), receivers recognize compressed
+		    payloads on their own */
+		void setPayloadsCompression(const bool state) { compressPayloads = state; }
+		bool isCompressingPayloads() const { return compressPayloads; }
 
-		virtual void renderNextFrame(int FO) = 0;
 		virtual void mergeImages(int FO, int slice_size, int slices, unsigned short * maskPixelBuffer, float * phantomBuffer, float * opticsBuffer) = 0;
 
 		inline const char * tagName(e_comm_tags tag) {
@@ -197,6 +239,8 @@ public:
 					return "Count AABB";
 				case e_comm_tags::send_AABB:
 					return "Send AABB";
+				case e_comm_tags::dead_AABB:
+					return "Dead AABB";
 				case e_comm_tags::next_stage:
 					return "Next Stage";
 				case e_comm_tags::unblock_FO:
@@ -223,12 +267,26 @@ public:
 					return "Shadow copy";
 				case e_comm_tags::shadow_copy_data:
 					return "Shadow copy data";
+				case e_comm_tags::get_shadow_copies:
+					return "Get shadow copies";
+				case e_comm_tags::compact_AABB:
+					return "Compact AABBs";
+				case e_comm_tags::ghost_copy:
+					return "Ghost copy";
+				case e_comm_tags::ghost_copy_data:
+					return "Ghost copy data";
+				case e_comm_tags::ghost_copy_count:
+					return "Ghost copies count";
+				case e_comm_tags::agents_events:
+					return "Agents lifecycle events";
 				case e_comm_tags::render_frame:
 					return "Render frame";
 				case e_comm_tags::mask_data:
 					return "Mask image slice";
 				case e_comm_tags::float_image_data:
 					return "Float image slice";
+				case e_comm_tags::compressed_image_data:
+					return "Compressed image slice";
 				case e_comm_tags::barrier:
 					return "WaitSync barrier";
 				case e_comm_tags::unspecified:
@@ -247,7 +305,13 @@ protected:
 		int internal_agent_ID;
 		int lastFOID;
 		int hasSent;
-		bool finished;
+		std::atomic_bool finished;
+		bool compressPayloads = false;
+
+		/** the block of agent IDs this FO can hand out without asking the Director:
+		    [agentIDsBlockNext, agentIDsBlockEnd), and if another block has been asked for */
+		int agentIDsBlockNext = 0, agentIDsBlockEnd = 0;
+		bool agentIDsRequested = false;
 
 		//Unused now: int shift; // Shift ID by given number of bits, to reduce communication for getNextAvailAgentID, maybe rework later
 		static e_comm_tags messageType; // Message type enum for sending/receiving individual distributed messages
@@ -258,8 +322,9 @@ protected:
 
 };
 
-#ifdef DISTRIBUTED
+#if defined(DISTRIBUTED) && !defined(DISTRIBUTED_INPROCESS)
 #include <mpi.h>
+#include "PayloadCompression.h"
 
 class MPI_Communicator : public DistributedCommunicator
 {
@@ -273,23 +338,6 @@ public:
 		~MPI_Communicator();
 		inline const char * getProcessorName() { return processor_name;  }
 
-		virtual int getNextAvailAgentID();
-		virtual void startNewAgent(const int newAgentID, const int associatedFO, const bool wantsToAppearInCTCtracksTXTfile = true);
-		virtual void closeAgent(const int agentID, const int associatedFO);
-		virtual void startNewDaughterAgent(const int childID, const int parentID);
-
-		virtual void publishAgentsAABBs(int FO);
-		virtual void waitFor_publishAgentsAABBs();
-		virtual void waitFor_renderNextFrame();
-
-		virtual void sendNextID(int id);
-
-		virtual void setAgentsDetailedDrawingMode(int FO, int agentID, bool state);
-		virtual void setAgentsDetailedReportingMode(int FO, int agentID, bool state);
-		virtual size_t cntOfAABBs(int FO, bool broadcast=false);
-		virtual void sendCntOfAABBs(size_t count_AABB, bool broadcast=false);
-
-		virtual void renderNextFrame(int FO);
 		virtual size_t receiveRenderedFrame(int fromFO, int slice_size, int slices);
 		virtual void mergeImages(int FO, int slice_size, int slices, unsigned short * maskPixelBuffer, float * phantomBuffer, float * opticsBuffer);
 
@@ -308,6 +356,18 @@ public:
 			return sendMPIMessage(comm, data, count, tagMap(tag), instance_ID, tag);
 		}
 
+		virtual int postFO(void *data, int count, int instance_ID, e_comm_tags tag) {
+			MPI_Comm comm = tagCommMap(tag, director_comm);
+			debugMPIComm("Post", comm, count, instance_ID, tag);
+			postedSends.emplace_back();
+			return MPI_Isend(data, count, tagMap(tag), instance_ID, tag, comm, &postedSends.back());
+		}
+
+		virtual void waitForPostedFOs() {
+			MPI_Waitall((int)postedSends.size(), postedSends.data(), MPI_STATUSES_IGNORE);
+			postedSends.clear();
+		}
+
 		//boot receiveAndProcessDirectorMessagesForDirector(Director & director....
 		virtual bool receiveAndProcessDirectorMessage(void * buffer, int &recv_size, e_comm_tags &tag); //Probably not needed to run in cycle if notifications separate, only director needs cycle
 		virtual bool receiveDirectorMessage(void * buffer, int &recv_size, e_comm_tags &tag, bool async=true); //Single reception step, for request-response messages
@@ -323,6 +383,12 @@ public:
 
 		virtual void close();
 
+		virtual void wakeUpResponder() {
+			finished=true;
+			//a message to ourselves lets the blocking MPI_Probe() return
+			sendMPIMessage(director_comm, no_message, 0, MPI_BYTE, instance_ID, e_comm_tags::noop);
+		}
+
 protected:
 		char processor_name[MPI_MAX_PROCESSOR_NAME];
 		static char no_message[1];
@@ -330,6 +396,21 @@ protected:
 
 		int init(int argc, char **argv);
 
+		/** the sends posted with postFO() that are possibly still in progress */
+		std::vector<MPI_Request> postedSends;
+
+		/** image slices that mergeImages() sends, and reusable buffers to (de)compress them */
+		AdaptiveCompression imageSlicesCompression;
+		std::vector<char> slicePackedBuffer, sliceScratchBuffer;
+
+		/** sends the slice of 'items' elements of the 'elemSize' bytes, compressed
+		    (under e_comm_tags::compressed_image_data) if enabled and if it pays off */
+		void sendImageSlice(void* data, const int items, const size_t elemSize, const int peer, const e_comm_tags tag);
+
+		/** receives the slice sent with sendImageSlice() from any peer,
+		    'items' elements of 'elemSize' bytes are expected */
+		void receiveImageSlice(void* data, const int items, const size_t elemSize, const e_comm_tags tag);
+
 #ifdef DISTRIBUTED_DEBUG
 		inline void debugMPIComm(const char* what, MPI_Comm comm, int items, int peer=MPI_ANY_SOURCE, e_comm_tags tag = e_comm_tags::unspecified) {
 			int rlen=64;
@@ -359,17 +440,22 @@ protected:
 
 		inline MPI_Datatype tagMap(e_comm_tags tag) {
 			switch (tag) {
-				case e_comm_tags::new_agent: //int, int, bool - special datype?
-				case e_comm_tags::update_parent:
-				case e_comm_tags::close_agent:
 				case e_comm_tags::get_shadow_copy:
 					return MPI_INT64_T;				//Really? Or MPI_INT64_T or MPI_UINT64_T?
+				case e_comm_tags::new_agent: //int, int, bool
+				case e_comm_tags::update_parent:
+				case e_comm_tags::close_agent:
 				case e_comm_tags::next_ID:
 				case e_comm_tags::get_next_ID:
 				case e_comm_tags::count_new_type:
+				case e_comm_tags::dead_AABB:
+				case e_comm_tags::get_shadow_copies:
+				case e_comm_tags::agents_events:
 					return MPI_INT;
 				case e_comm_tags::count_AABB:
 				case e_comm_tags::shadow_copy:
+				case e_comm_tags::ghost_copy:
+				case e_comm_tags::ghost_copy_count:
 					return MPI_UINT64_T;
 				case e_comm_tags::send_AABB:
 					return MPI_AABB;			//Broadcast First Types, then AABBs
@@ -379,6 +465,9 @@ protected:
 				case e_comm_tags::finished:
 				case e_comm_tags::ACK:
 				case e_comm_tags::shadow_copy_data:
+				case e_comm_tags::ghost_copy_data:
+				case e_comm_tags::compact_AABB:
+				case e_comm_tags::compressed_image_data:
 					return MPI_CHAR;
 				case e_comm_tags::mask_data:
 					return MPI_UNSIGNED_SHORT;
@@ -400,14 +489,20 @@ protected:
 					return id_comm;
 				case e_comm_tags::count_AABB:
 				case e_comm_tags::send_AABB:
+				case e_comm_tags::dead_AABB:
+				case e_comm_tags::compact_AABB:
 				case e_comm_tags::shadow_copy_data:
 				case e_comm_tags::shadow_copy:
+				case e_comm_tags::ghost_copy_data:
+				case e_comm_tags::ghost_copy:
+				case e_comm_tags::ghost_copy_count:
 					return aabb_comm;			//Broadcast First Types, then AABBs
 				case e_comm_tags::count_new_type:
 				case e_comm_tags::new_type:
 					return type_comm;
 				case e_comm_tags::mask_data:
 				case e_comm_tags::float_image_data:
+				case e_comm_tags::compressed_image_data:
 					return image_comm;
 				case e_comm_tags::ACK:
 					return MPI_COMM_WORLD;
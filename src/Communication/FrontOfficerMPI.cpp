@@ -3,8 +3,20 @@
 #include "../Director.h"
 #include "../util/strings.h"
 #include "DistributedCommunicator.h"
+#include "CompactAABBs.h"
+#include <algorithm>
+#include <iterator>
 #include <chrono>
 #include <thread>
+#include <vector>
+
+/** makes sure the reusable buffer can hold at least 'size' items, it never shrinks */
+template <typename T>
+static T* reserveBuffer(std::vector<T>& buffer, const size_t size)
+{
+	if (buffer.size() < size) buffer.resize(size);
+	return buffer.data();
+}
 
 int FrontOfficer::request_getNextAvailAgentID()
 {
@@ -13,84 +25,244 @@ int FrontOfficer::request_getNextAvailAgentID()
 
 
 void FrontOfficer::request_startNewAgent(const int newAgentID,
-                                         const int associatedFO,
+                                         const int /*associatedFO*/,
                                          const bool wantsToAppearInCTCtracksTXTfile)
 {
-	communicator->startNewAgent(newAgentID,associatedFO,wantsToAppearInCTCtracksTXTfile);
+	//the Director learns about it with the next notify_agentsEvents(),
+	//the associatedFO is always this one (and the Director knows the sender)
+	agentsEvents.push_back(AGENT_EVENT_START);
+	agentsEvents.push_back(newAgentID);
+	agentsEvents.push_back(wantsToAppearInCTCtracksTXTfile ? 1 : 0);
 }
 
 
 void FrontOfficer::request_closeAgent(const int agentID,
-                                      const int associatedFO)
+                                      const int /*associatedFO*/)
 {
-	communicator->closeAgent(agentID,associatedFO);
+	agentsEvents.push_back(AGENT_EVENT_CLOSE);
+	agentsEvents.push_back(agentID);
+	agentsEvents.push_back(0);
 }
 
 
 void FrontOfficer::request_updateParentalLink(const int childID, const int parentID)
 {
-	communicator->startNewDaughterAgent(childID,parentID);
+	agentsEvents.push_back(AGENT_EVENT_PARENT);
+	agentsEvents.push_back(childID);
+	agentsEvents.push_back(parentID);
+}
+
+
+void FrontOfficer::notify_agentsEvents()
+{
+	//in chunks that fit into the Director's receiving buffer
+	const size_t maxChunk = (DIRECTOR_RECV_MAX/3)*3;
+	for (size_t off = 0; off < agentsEvents.size(); off += maxChunk)
+	{
+		const size_t cnt = std::min(maxChunk, agentsEvents.size()-off);
+		communicator->sendAgentsEvents(agentsEvents.data()+off, (int)cnt);
+	}
+	agentsEvents.clear();
 }
 
 
 void FrontOfficer::waitFor_publishAgentsAABBs()
 {
 	DEBUG_REPORT("FO #" << this->ID << " is running AABB reporting cycle with local size " << agents.size());
-	t_aabb * sentAABBs;
+
+	//every now and then, re-send everything as a safety net
+	const bool fullResync = (publishedAABBsRoundsCnt++ % AABB_FULL_RESYNC_PERIOD) == 0;
+
 	for (int i = 1 ; i <= FOsCount ; i++) {
 		if (i == ID)
+			broadcast_AABBsDelta(fullResync);
+		else
+			respond_AABBsDelta(i);
+	}
+
+	//the AABBs (and agentsToFOsMap) were cleared in prepareForUpdateAndPublishAgents(),
+	//rebuild them from the now up-to-date replica (own agents are added afterwards),
+	//and check on the way that the replica agrees with what the FOs have announced
+	std::vector<AgentsChecksum> replicaChecksums(FOsCount+1);
+	for (const auto& r : replicatedAABBs)
+	{
+		AABBs.push_back(r.second.box);
+		registerThatThisAgentIsAtThisFO(r.first,r.second.FOsID);
+		replicaChecksums[r.second.FOsID].add(r.first,r.second.version);
+	}
+	for (int i = 1 ; i <= FOsCount ; i++)
+	{
+		if (i != ID && replicaChecksums[i] != announcedChecksums[i])
+			throw ERROR_REPORT("FO #" << ID << " does not have a complete list of AABBs of FO #" << i
+			                   << " (" << replicaChecksums[i].count << " AABBs instead of "
+			                   << announcedChecksums[i].count << " or they differ)");
+	}
+
+	communicator->waitFor_publishAgentsAABBs();
+	DEBUG_REPORT("FO #" << this->ID << " has finished AABB reporting cycle with global size " << (AABBs.size() + agents.size()) );
+	broadcast_newAgentsTypes(); //Force-call it here?
+}
+
+void FrontOfficer::broadcast_AABBsDelta(const bool fullResync)
+{
+	//AABBs of agents that are new, or whose geometry or type has changed
+	std::vector<t_aabb> sentAABBs;
+	sentAABBs.reserve(agents.size());
+	AgentsChecksum checksum;
+	for (auto ag : agents)
+	{
+		const int    version = ag.second->getGeometry().version;
+		const size_t atype   = ag.second->getAgentTypeID();
+		checksum.add(ag.first,version);
+
+		const auto pub = publishedAABBs.find(ag.first);
+		if (!fullResync && pub != publishedAABBs.end()
+		    && pub->second.first == version && pub->second.second == atype) continue;
+
+		const AxisAlignedBoundingBox & aabb = ag.second->getAABB();
+		sentAABBs.emplace_back();
+		sentAABBs.back().minCorner = aabb.minCorner;
+		sentAABBs.back().maxCorner = aabb.maxCorner;
+		sentAABBs.back().version = version;
+		sentAABBs.back().id = ag.first;
+		sentAABBs.back().atype = atype;
+
+		publishedAABBs[ag.first] = std::make_pair(version,atype);
+	}
+
+	//IDs of agents that were broadcast before but are no longer here,
+	//in the full resync they are implied (receivers drop all our AABBs first)
+	std::vector<int> deadIDs;
+	auto pub = publishedAABBs.begin();
+	while (pub != publishedAABBs.end())
+	{
+		if (agents.find(pub->first) == agents.end())
 		{
-			int aabb_count = (int)agents.size(); //getSizeOfAABBsList(); is not returning correct results! (WHY? -> Because the AABB list is empty)
-			/* TBD: In future, will local AABB count in each FO always fit into integer? Otherwise we have a problem */
-			int j = 0;
-			communicator->sendCntOfAABBs(aabb_count, true);
-			//sentAABBs = new t_aabb[aabb_count];
-			sentAABBs = (t_aabb*) malloc(sizeof(t_aabb)*(aabb_count+1));
-			for (auto ag : agents)
+			if (!fullResync) deadIDs.push_back(pub->first);
+			pub = publishedAABBs.erase(pub);
+		}
+		else ++pub;
+	}
+
+	DEBUG_REPORT("FO #" << ID << " broadcasts " << sentAABBs.size() << " changed and "
+	             << deadIDs.size() << " dead AABBs out of " << agents.size() << (fullResync ? " (full resync)" : ""));
+
+	//try the compact format, if enabled and if all AABBs fit into its range
+	const bool compact = aabbsWireQuantum > 0
+	                  && CompactAABBs::encode(sentAABBs, deadIDs, scenario.params.constants.sceneOffset,
+	                                          aabbsWireQuantum, compactAABBsBuffer);
+
+	//header: count of changed AABBs, count of dead IDs, full resync flag,
+	//        size of the compact format in bytes (0 if the plain one is used),
+	//        checksum of all own agents (AgentsChecksum::headerItems)
+	uint64_t header[AABBS_HEADER_ITEMS] = { sentAABBs.size(), deadIDs.size(), fullResync ? 1u : 0u,
+	                                        compact ? compactAABBsBuffer.size() : 0u };
+	checksum.toHeader(header+4);
+	communicator->sendBroadcast(header, AABBS_HEADER_ITEMS, ID, e_comm_tags::count_AABB);
+	if (compact)
+	{
+		DEBUG_REPORT("FO #" << ID << " sends AABBs in " << header[3] << " bytes instead of "
+		             << sentAABBs.size()*sizeof(t_aabb) + deadIDs.size()*sizeof(int));
+		communicator->sendBroadcast(compactAABBsBuffer.data(), (int)header[3], ID, e_comm_tags::compact_AABB);
+		return;
+	}
+	communicator->sendBroadcast(sentAABBs.data(), (int)sentAABBs.size(), ID, e_comm_tags::send_AABB);
+	communicator->sendBroadcast(deadIDs.data(), (int)deadIDs.size(), ID, e_comm_tags::dead_AABB);
+}
+
+void FrontOfficer::respond_AABBsDelta(const int FOsID)
+{
+	uint64_t header[AABBS_HEADER_ITEMS] = {0};
+	int cnt = AABBS_HEADER_ITEMS;
+	communicator->receiveBroadcast(header, cnt, FOsID, e_comm_tags::count_AABB);
+
+	if (announcedChecksums.size() <= (size_t)FOsID) announcedChecksums.resize(FOsCount+1);
+	announcedChecksums[FOsID].fromHeader(header+4);
+
+	int aabb_count = (int)header[0];
+	int dead_count = (int)header[1];
+	DEBUG_REPORT("Receive " << aabb_count << " changed and " << dead_count << " dead AABBs at FO#" << ID
+	             << " from FO #" << FOsID << (header[2] ? " (full resync)" : ""));
+
+	//IDs of this FO's agents known before the full resync
+	std::vector<int> resyncedIDs;
+	if (header[2])
+	{
+		//full resync: forget everything we know about this FO's agents
+		auto r = replicatedAABBs.begin();
+		while (r != replicatedAABBs.end())
+		{
+			if (r->second.FOsID == FOsID)
 			{
-				const AxisAlignedBoundingBox & aabb = ag.second->getAABB();
-				//REPORT("Agent #" << j << " is running AABB reporting cycle with local size " << agents.size());
-				sentAABBs[j].minCorner = aabb.minCorner;
-				sentAABBs[j].maxCorner = aabb.maxCorner;
-				sentAABBs[j].version = ag.second->getGeometry().version;
-				sentAABBs[j].id = ag.second->getID();
-				sentAABBs[j].atype = ag.second->getAgentTypeID();
-				j++;
+				resyncedIDs.push_back(r->first);
+				r = replicatedAABBs.erase(r);
 			}
-			communicator->sendBroadcast(sentAABBs, aabb_count, i, e_comm_tags::send_AABB);
-			free(sentAABBs);
-			//delete [] sentAABBs;
+			else ++r;
 		}
-		else
+	}
+
+	std::vector<t_aabb> sentAABBs;
+	std::vector<int> deadIDs;
+	if (header[3])
+	{
+		int compact_size = (int)header[3];
+		communicator->receiveBroadcast(reserveBuffer(compactAABBsBuffer, header[3]),
+		                               compact_size, FOsID, e_comm_tags::compact_AABB);
+		CompactAABBs::decode(compactAABBsBuffer.data(), header[3], header[0], header[1], sentAABBs, deadIDs);
+	}
+	else
+	{
+		sentAABBs.resize(aabb_count);
+		communicator->receiveBroadcast(sentAABBs.data(), aabb_count, FOsID, e_comm_tags::send_AABB);
+		deadIDs.resize(dead_count);
+		communicator->receiveBroadcast(deadIDs.data(), dead_count, FOsID, e_comm_tags::dead_AABB);
+	}
+
+	for (const auto& a : sentAABBs)
+	{
+		ReplicatedAABB& r = replicatedAABBs[a.id];
+		r.box.minCorner = a.minCorner;
+		r.box.maxCorner = a.maxCorner;
+		r.box.ID        = a.id;
+		r.box.nameID    = a.atype;
+		r.FOsID         = FOsID;
+		r.version       = a.version;
+		agentsAndBroadcastGeomVersions[a.id] = a.version;
+	}
+
+	//the geometry of a dead agent will never be asked for again
+	auto disposeDeadAgent = [this](const int id)
+	{
+		auto sa = shadowAgents.find(id);
+		if (sa != shadowAgents.end())
 		{
-			int aabb_count = (int)communicator->cntOfAABBs(i, true);
-			//sentAABBs = new t_aabb[aabb_count];
-			DEBUG_REPORT("Receive " << aabb_count << " AABBs at FO#" << ID << " from FO #" << i);
-			sentAABBs = (t_aabb*) malloc(sizeof(t_aabb)*(aabb_count+1));
-			communicator->receiveBroadcast(sentAABBs, aabb_count, i, e_comm_tags::send_AABB);
-			for (int j=0; j < aabb_count; j++) {
-				AABBs.emplace_back();
-				AABBs.back().minCorner = sentAABBs[j].minCorner;
-				AABBs.back().maxCorner = sentAABBs[j].maxCorner;
-				/*DEBUG_REPORT("FO #" << ID << ", AABB #" << j
-				  << " Min: (" << sentAABBs[j].minCorner.x << "," << sentAABBs[j].minCorner.y << "," << sentAABBs[j].minCorner.z << ")"
-				  << " Max: (" << sentAABBs[j].maxCorner.x << "," << sentAABBs[j].maxCorner.y << "," << sentAABBs[j].maxCorner.z << ")"
-				);*/
-				AABBs.back().ID     = sentAABBs[j].id;
-				AABBs.back().nameID = sentAABBs[j].atype;
-				agentsAndBroadcastGeomVersions[sentAABBs[j].id] = sentAABBs[j].version;
-				/*DEBUG_REPORT("FO #" << ID << ", Agent #" << j << " ID: " << sentAABBs[j].id
-				  << " Name ID: " << sentAABBs[j].atype <<  ", Geometry version " <<sentAABBs[j].version
-				);*/
-				registerThatThisAgentIsAtThisFO(sentAABBs[j].id,i);
-			}
-			free(sentAABBs);
-//			delete [] sentAABBs;
+			forgetShadowAgent(id);
+			disposeShadowAgent(sa->second);
+			shadowAgents.erase(sa);
 		}
+	};
+
+	for (int id : deadIDs)
+	{
+		replicatedAABBs.erase(id);
+		disposeDeadAgent(id);
+	}
+
+	//dead IDs are not sent with the full resync, agents that
+	//are not in the resync anymore must have died meanwhile
+	if (!resyncedIDs.empty())
+	{
+		std::sort(resyncedIDs.begin(), resyncedIDs.end());
+		std::vector<int> sentIDs;
+		sentIDs.reserve(sentAABBs.size());
+		for (const auto& a : sentAABBs) sentIDs.push_back(a.id);
+		std::sort(sentIDs.begin(), sentIDs.end());
+
+		std::vector<int> goneIDs;
+		std::set_difference(resyncedIDs.begin(), resyncedIDs.end(),
+		                    sentIDs.begin(), sentIDs.end(), std::back_inserter(goneIDs));
+		for (int id : goneIDs) disposeDeadAgent(id);
 	}
-	communicator->waitFor_publishAgentsAABBs();
-	DEBUG_REPORT("FO #" << this->ID << " has finished AABB reporting cycle with global size " << (AABBs.size() + agents.size()) );
-	broadcast_newAgentsTypes(); //Force-call it here?
 }
 
 void FrontOfficer::notify_publishAgentsAABBs(const int /*FOsID*/)
@@ -202,27 +374,19 @@ void FrontOfficer::respond_newAgentsTypes(int /*noOfIncomingNewAgentTypes*/)
 
 ShadowAgent* FrontOfficer::request_ShadowAgentCopy(const int agentID, const int FOsID)
 {
-	size_t param_buff[4] =  {(size_t)agentID,0,0,0};
-	int cnt = 4; //sizeof(param_buff) / sizeof(long*);
+	size_t param_buff[5] =  {(size_t)agentID,0,0,0,0};
+	int cnt = 5; //sizeof(param_buff) / sizeof(long*);
 	int fo_back = FOsID;
-	int items;
 	e_comm_tags tag = e_comm_tags::shadow_copy;
 
 	communicator->sendFO(param_buff, 1, FOsID, e_comm_tags::get_shadow_copy);
 	communicator->receiveFOMessage(param_buff, cnt, fo_back, tag);
 	DEBUG_REPORT("Received shadow copy info at FO #"  << ID << ": ID=" << param_buff[0] << ", Type=" << param_buff[2] << ", Geom Type=" << param_buff[3]);
-	items= (int)param_buff[1];
-	char * data_buff = (char *) malloc(items);
+	char * data_buff = reserveBuffer(shadowCopiesRecvBuffer, param_buff[1]);
 
-	tag=e_comm_tags::shadow_copy_data;
-	communicator->receiveFOMessage(data_buff, items, fo_back, tag);
+	receiveShadowCopies(false, data_buff, param_buff[1], param_buff[4], fo_back);
 
-	int         gotThisAgentID   = (int) param_buff[0];
-	std::string gotThisAgentType = agentsTypesDictionary.translateIdToString((size_t)param_buff[2]);
-	Geometry*   gotThisGeom      = Geometry::createAndDeserializeFrom((int)param_buff[3], data_buff);
-	free(data_buff);
-
-	return new ShadowAgent(*gotThisGeom, gotThisAgentID,gotThisAgentType);
+	return storeShadowAgentCopy((int)param_buff[0], param_buff[2], (int)param_buff[3], data_buff);
 }
 
 
@@ -242,17 +406,248 @@ void FrontOfficer::respond_ShadowAgentCopy(const int agentID)
 	const size_t sendBackAgentType = aaRef.getAgentTypeID();
 	const int geom_type = (int) sendBackGeom.shapeForm;
 
-	size_t param_buff[4] =  {(size_t)sendBackAgentID, (size_t)geom_size, sendBackAgentType, (size_t)geom_type};
-	int cnt = 4; //sizeof(param_buff) / sizeof(long*);
+	char* buffer_to_send = reserveBuffer(shadowCopiesSendBuffers[0][foID], (size_t)geom_size);
+	sendBackGeom.serializeTo(buffer_to_send);
+
+	//the last item is the size of the compressed geometry (0 if not compressed)
+	size_t param_buff[5] =  {(size_t)sendBackAgentID, (size_t)geom_size, sendBackAgentType, (size_t)geom_type,
+	                         packShadowCopies(false, buffer_to_send, (size_t)geom_size, foID)};
+	int cnt = 5; //sizeof(param_buff) / sizeof(long*);
 
 	DEBUG_REPORT("Sent shadow copy info at FO #"  << ID << ": ID=" << param_buff[0] << ", Type=" << param_buff[2] << ", Geom Type=" << param_buff[3]);
 	communicator->sendFO(param_buff, cnt, foID, e_comm_tags::shadow_copy);
 
-	std::unique_ptr<char[]> buffer_to_send( new char[geom_size] );
-	//char buffer_to_send [geom_size];
-	sendBackGeom.serializeTo(buffer_to_send.get());
+	sendShadowCopies(false, buffer_to_send, (size_t)geom_size, param_buff[4], foID);
+}
+
 
-	communicator->sendFO(buffer_to_send.get(), (int)geom_size, foID, e_comm_tags::shadow_copy_data);
+void FrontOfficer::request_ShadowAgentCopies(const std::map<int,std::vector<int> >& fetchTheseIDsFromFOs)
+{
+	//post all requests first so that the asked FOs prepare their replies concurrently
+	for (const auto& req : fetchTheseIDsFromFOs)
+		communicator->sendFO((void*)req.second.data(), (int)req.second.size(), req.first, e_comm_tags::get_shadow_copies);
+
+	for (const auto& req : fetchTheseIDsFromFOs)
+		receive_ShadowAgentCopies((int)req.second.size(), req.first, false);
+}
+
+
+void FrontOfficer::respond_ShadowAgentCopies(const int* agentIDs, const int noOfAgents, const int FOsID)
+{
+	send_ShadowAgentCopies(agentIDs, noOfAgents, FOsID, false);
+}
+
+
+void FrontOfficer::exchange_ShadowAgentCopies(const std::map<int,std::vector<int> >& pushTheseIDsToFOs)
+{
+	//post all pushes first (the posting does not wait for the receivers),
+	//everyone gets a message (possibly an empty one) from everyone...
+	const auto start = std::chrono::steady_clock::now();
+	shadowCopiesPostedBytes = 0;
+	const std::vector<int> nothingToPush;
+	for (int j = 1 ; j <= FOsCount ; j++) {
+		if (j == ID) continue;
+		const auto push = pushTheseIDsToFOs.find(j);
+		const std::vector<int>& ids = push != pushTheseIDsToFOs.end() ? push->second : nothingToPush;
+		send_ShadowAgentCopies(ids.data(), (int)ids.size(), j, true);
+	}
+
+	//...and take the others' pushes in the order they come
+	for (int i = 1 ; i < FOsCount ; i++)
+		receive_ShadowAgentCopies(0, FO_INSTANCE_ANY, true);
+
+	//the posted buffers are re-used in the next round
+	communicator->waitForPostedFOs();
+	if (shadowCopiesPostedBytes > 0)
+		shadowCopiesCompression[1].reportTransfer(shadowCopiesPostedBytes,
+		      std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count());
+}
+
+
+void FrontOfficer::send_ShadowAgentCopies(const int* agentIDs, const int noOfAgents, const int FOsID, const bool asGhosts)
+{
+	//header: 4 items per agent and the size of the compressed geometries (or 0),
+	//followed by all geometries in one buffer,
+	//both are serialized directly into the buffers kept for this FO
+	size_t* param_buff = reserveBuffer(shadowCopiesSendHeaders[asGhosts ? 1 : 0][FOsID], 4*(size_t)noOfAgents+1);
+	size_t items = 0;
+	for (int i = 0; i < noOfAgents; ++i)
+	{
+		const auto ag = agents.find(agentIDs[i]);
+		if (ag == agents.end())
+			throw ERROR_REPORT("Cannot provide ShadowAgent for agent ID " << agentIDs[i]);
+
+		const Geometry& sendBackGeom = ag->second->getGeometry();
+		param_buff[4*i]   = (size_t)agentIDs[i];
+		param_buff[4*i+1] = (size_t)sendBackGeom.getSizeInBytes();
+		param_buff[4*i+2] = ag->second->getAgentTypeID();
+		param_buff[4*i+3] = (size_t)sendBackGeom.shapeForm;
+		items += param_buff[4*i+1];
+	}
+	if (asGhosts)
+	{
+		//the count first, the receiver does not know how many are coming
+		size_t& count = shadowCopiesSendCounts[FOsID];
+		count = (size_t)noOfAgents;
+		communicator->postFO(&count, 1, FOsID, e_comm_tags::ghost_copy_count);
+		if (noOfAgents == 0) return;
+	}
+	else if (noOfAgents == 0)
+	{
+		communicator->sendFO(param_buff, 0, FOsID, e_comm_tags::shadow_copy);
+		return;
+	}
+
+	char* const data_buff = reserveBuffer(shadowCopiesSendBuffers[asGhosts ? 1 : 0][FOsID], items);
+	char* data = data_buff;
+	for (int i = 0; i < noOfAgents; ++i)
+	{
+		agents.find(agentIDs[i])->second->getGeometry().serializeTo(data);
+		data += param_buff[4*i+1];
+	}
+	param_buff[4*noOfAgents] = packShadowCopies(asGhosts, data_buff, items, FOsID);
+
+	if (asGhosts)
+		communicator->postFO(param_buff, 4*noOfAgents+1, FOsID, e_comm_tags::ghost_copy);
+	else
+		communicator->sendFO(param_buff, 4*noOfAgents+1, FOsID, e_comm_tags::shadow_copy);
+	DEBUG_REPORT("Sent " << noOfAgents << (asGhosts ? " ghost" : " shadow") << " copies ("
+	             << items << " bytes, " << param_buff[4*noOfAgents] << " compressed) from FO #" << ID << " to FO #" << FOsID);
+	sendShadowCopies(asGhosts, data_buff, items, param_buff[4*noOfAgents], FOsID);
+}
+
+
+size_t FrontOfficer::packShadowCopies(const bool asGhosts, char* data, const size_t size, const int FOsID)
+{
+	const int pool = asGhosts ? 1 : 0;
+	if (!communicator->isCompressingPayloads() || !shadowCopiesCompression[pool].shouldCompress(size)) return 0;
+
+	//it must get smaller, otherwise it is not worth it
+	char* const packed = reserveBuffer(shadowCopiesPackedBuffers[pool][FOsID], size);
+	const auto start = std::chrono::steady_clock::now();
+	const size_t packedSize = ByteShuffleLZ::compress(data, size, sizeof(G_FLOAT),
+	                                                  shadowCopiesScratchBuffers[pool], packed, size);
+	shadowCopiesCompression[pool].reportCompression(size, packedSize,
+	      std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count());
+	return packedSize;
+}
+
+
+void FrontOfficer::sendShadowCopies(const bool asGhosts, char* data, const size_t size, const size_t packedSize,
+                                    const int FOsID)
+{
+	const int pool = asGhosts ? 1 : 0;
+	char* const payload = packedSize > 0 ? shadowCopiesPackedBuffers[pool][FOsID].data() : data;
+	const size_t payloadSize = packedSize > 0 ? packedSize : size;
+
+	//the pushes are only posted, and their transfer is measured for all of them at once
+	if (asGhosts)
+	{
+		communicator->postFO(payload, (int)payloadSize, FOsID, e_comm_tags::ghost_copy_data);
+		shadowCopiesPostedBytes += payloadSize;
+		return;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
+	communicator->sendFO(payload, (int)payloadSize, FOsID, e_comm_tags::shadow_copy_data);
+	shadowCopiesCompression[pool].reportTransfer(payloadSize,
+	      std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count());
+}
+
+
+void FrontOfficer::receiveShadowCopies(const bool asGhosts, char* data, const size_t size, const size_t packedSize,
+                                       const int FOsID)
+{
+	int fo_back = FOsID;
+	e_comm_tags tag = asGhosts ? e_comm_tags::ghost_copy_data : e_comm_tags::shadow_copy_data;
+	if (packedSize == 0)
+	{
+		int data_cnt = (int)size;
+		communicator->receiveFOMessage(data, data_cnt, fo_back, tag);
+		return;
+	}
+
+	int data_cnt = (int)packedSize;
+	communicator->receiveFOMessage(reserveBuffer(shadowCopiesRecvPacked, packedSize), data_cnt, fo_back, tag);
+	ByteShuffleLZ::decompress(shadowCopiesRecvPacked.data(), packedSize, sizeof(G_FLOAT),
+	                          shadowCopiesRecvScratch, data, size);
+}
+
+
+int FrontOfficer::receive_ShadowAgentCopies(const int maxNoOfAgents, const int FOsID, const bool asGhosts)
+{
+	int fo_back = FOsID;
+	int maxCnt = maxNoOfAgents;
+	if (asGhosts)
+	{
+		//the count comes first, from whoever is the first, the rest then from the same FO
+		size_t count = 0;
+		int cnt = 1;
+		fo_back = FO_INSTANCE_ANY;
+		e_comm_tags tag = e_comm_tags::ghost_copy_count;
+		communicator->receiveFOMessage(&count, cnt, fo_back, tag);
+		if (count == 0) return 0;
+		maxCnt = (int)count;
+	}
+
+	size_t* param_buff = reserveBuffer(shadowCopiesRecvHeader, 4*(size_t)maxCnt+1);
+	int cnt = 4*maxCnt+1;
+	e_comm_tags tag = asGhosts ? e_comm_tags::ghost_copy : e_comm_tags::shadow_copy;
+	communicator->receiveFOMessage(param_buff, cnt, fo_back, tag);
+
+	const int noOfAgents = cnt/4;
+	if (noOfAgents == 0) return 0;
+
+	size_t items = 0;
+	for (int i = 0; i < noOfAgents; ++i) items += param_buff[4*i+1];
+	char* const data_buff = reserveBuffer(shadowCopiesRecvBuffer, items);
+	receiveShadowCopies(asGhosts, data_buff, items, param_buff[4*noOfAgents], fo_back);
+	DEBUG_REPORT("Received " << noOfAgents << (asGhosts ? " ghost" : " shadow") << " copies ("
+	             << items << " bytes, " << param_buff[4*noOfAgents] << " compressed) at FO #" << ID << " from FO #" << fo_back);
+
+	char* data = data_buff;
+	for (int i = 0; i < noOfAgents; ++i)
+	{
+		storeShadowAgentCopy((int)param_buff[4*i], param_buff[4*i+2], (int)param_buff[4*i+3], data);
+		data += param_buff[4*i+1];
+	}
+	return noOfAgents;
+}
+
+
+ShadowAgent* FrontOfficer::storeShadowAgentCopy(const int agentID, const size_t agentTypeID,
+                                                const int geomType, char* geomBuffer)
+{
+	auto saItem = shadowAgents.find(agentID);
+	ShadowAgent* const oldSA = saItem != shadowAgents.end() ? saItem->second : NULL;
+
+	//the geometries of ShadowAgents are created (non-const) here, so we may update them
+	Geometry* const oldGeom = oldSA != NULL ? const_cast<Geometry*>(&oldSA->getGeometry()) : NULL;
+	Geometry* const newGeom = Geometry::updateOrCreateAndDeserializeFrom(oldGeom, geomType, geomBuffer);
+
+	//updated in place and nothing else has changed?
+	if (newGeom == oldGeom && oldSA->getAgentTypeID() == agentTypeID)
+	{
+		touchShadowAgent(agentID);
+		return oldSA;
+	}
+
+	ShadowAgent* const newSA = new ShadowAgent(*newGeom, agentID,
+	                               agentsTypesDictionary.translateIdToString(agentTypeID));
+	if (oldSA != NULL)
+	{
+		if (newGeom == oldGeom) delete oldSA; //keep the geometry, it is in use by the newSA
+		else disposeShadowAgent(oldSA);
+	}
+	shadowAgents[agentID] = newSA;
+	touchShadowAgent(agentID);
+	return newSA;
+}
+
+
+void FrontOfficer::setPayloadsCompression(const bool state)
+{
+	communicator->setPayloadsCompression(state);
 }
 
 
@@ -291,18 +686,10 @@ void FrontOfficer::respond_Loop()
 	do {
 		items = DIRECTOR_RECV_MAX;
 		int instance = FO_INSTANCE_ANY;
-		if ((tag = communicator->detectFOMessage(false/*we are runnung synchronously in the thread*/)) < 0) {
-			// Detect other FO messages (are there any?) and broadcasts here...
-			std::this_thread::sleep_for((std::chrono::milliseconds)10);
-			continue;
-		}
-		//tag=communicator->detectFOMessage(false);
-		if (communicator->isFinished()) { break; }
-		if (tag == e_comm_tags::ACK || tag == e_comm_tags::unblock_FO) {
-			REPORT("ACK/Unblock on Director Communicator on FO #" << ID);
-			std::this_thread::sleep_for((std::chrono::milliseconds)10);
-			continue;
-		}
+		//blocks until a request comes, or until wakeUpResponder() is called
+		tag = communicator->detectFOMessage(false/*we are runnung synchronously in the thread*/);
+		if (this->finished || communicator->isFinished()) { break; }
+		if (tag == e_comm_tags::unspecified) { continue; }
 		switch (tag) {
 			case e_comm_tags::set_detailed_drawing:
 				communicator->receiveDirectorMessage(buffer, items, tag);
@@ -326,6 +713,10 @@ void FrontOfficer::respond_Loop()
 				assert(items == 1);
 				respond_ShadowAgentCopy(ibuffer[0]);
 				break;
+			case e_comm_tags::get_shadow_copies:
+				communicator->receiveFOMessage(ibuffer, items, instance, tag);
+				respond_ShadowAgentCopies(ibuffer, items, instance);
+				break;
 			case e_comm_tags::send_AABB:
 				communicator->receiveFOMessage(ibuffer, items, instance, tag);
 				assert(items == 0);
@@ -350,6 +741,10 @@ void FrontOfficer::respond_Loop()
 				communicator->receiveFOMessage(buffer, items, instance, tag);
 				unblock_lvl++;
 				break;*/
+			case e_comm_tags::unblock_FO:
+			case e_comm_tags::noop:
+				communicator->receiveFOMessage(buffer, items, instance, tag);
+				break;
 			default:
 				REPORT("Unprocessed communication tag " << communicator->tagName(tag) << " on FO " << ID);
 				communicator->receiveFOMessage(buffer, items, instance, tag);
@@ -364,6 +759,7 @@ void FrontOfficer::respond_Loop()
 void FrontOfficer::waitHereUntilEveryoneIsHereToo() //Will this work without specification of stage as an argument?
 {
 	DEBUG_REPORT("Wait Here Until Everyone Is Here Too FO #" << ID);
+	if (!agentsEvents.empty()) notify_agentsEvents();
 	communicator->waitSync();
 }
 
@@ -427,6 +823,11 @@ void FrontOfficer::respond_setRenderingDebug()
 
 void FrontOfficer::close_communication()
 {
+	stopNearbyShadowAgentsExchanges();
+
+	//the responder, once woken up, leaves on its own
+	communicator->wakeUpResponder();
+	if (responder.joinable()) responder.join();
 	communicator->close();
 }
 
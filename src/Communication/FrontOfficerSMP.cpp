@@ -147,6 +147,30 @@ void FrontOfficer::respond_ShadowAgentCopy(const int)
 }
 
 
+void FrontOfficer::request_ShadowAgentCopies(const std::map<int,std::vector<int> >&)
+{
+	//this never happens here (as there is no other FO to talk to)
+}
+
+
+void FrontOfficer::respond_ShadowAgentCopies(const int*, const int, const int)
+{
+	//this never happens here (as there is no other FO to hear from)
+}
+
+
+void FrontOfficer::exchange_ShadowAgentCopies(const std::map<int,std::vector<int> >&)
+{
+	//this never happens here (as there is no other FO to talk to)
+}
+
+
+void FrontOfficer::setPayloadsCompression(const bool)
+{
+	//nothing is ever sent here
+}
+
+
 void FrontOfficer::respond_setDetailedDrawingMode()
 {
 	//this never happens (as Direktor here talks directly to the FO)
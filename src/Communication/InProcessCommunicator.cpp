@@ -0,0 +1,318 @@
+#include "InProcessCommunicator.h"
+#include <algorithm>
+#include <cstring>
+
+#ifdef DISTRIBUTED_INPROCESS
+InProcessHub::InProcessHub(const int noOfInstances)
+	: instances(noOfInstances)
+{
+	for (int i = 0; i < instances; ++i)
+		mailboxes.emplace_back(new Mailbox());
+}
+
+
+void InProcessHub::post(const int toInstance, Message&& msg)
+{
+#ifdef DEBUG
+	if (toInstance < 0 || toInstance >= instances)
+		throw ERROR_REPORT("Cannot send to instance #" << toInstance << ", there are only " << instances);
+#endif
+	Mailbox& mb = *mailboxes[toInstance];
+	{
+		std::lock_guard<std::mutex> l(mb.lock);
+		mb.messages.push_back(std::move(msg));
+	}
+	mb.arrived.notify_all();
+}
+
+
+bool InProcessHub::take(const int atInstance, const e_channel channel, const bool isBroadcast,
+                        const int source, const e_comm_tags tag, Message& msg)
+{
+	Mailbox& mb = *mailboxes[atInstance];
+	std::unique_lock<std::mutex> l(mb.lock);
+	while (true)
+	{
+		//the oldest matching message wins
+		for (auto m = mb.messages.begin(); m != mb.messages.end(); ++m)
+		{
+			if (m->channel != channel || m->isBroadcast != isBroadcast) continue;
+			if (source != -1 && m->source != source) continue;
+			if (!isBroadcast && tag != e_comm_tags::unspecified && m->tag != tag) continue;
+
+			msg = std::move(*m);
+			mb.messages.erase(m);
+			return true;
+		}
+
+		if (mb.closed) return false;
+		mb.arrived.wait(l);
+	}
+}
+
+
+e_comm_tags InProcessHub::probe(const int atInstance, const e_channel channel, const bool blocking)
+{
+	Mailbox& mb = *mailboxes[atInstance];
+	std::unique_lock<std::mutex> l(mb.lock);
+	while (true)
+	{
+		for (const auto& m : mb.messages)
+			if (m.channel == channel && !m.isBroadcast) return m.tag;
+
+		if (!blocking || mb.closed) return e_comm_tags::unspecified;
+		mb.arrived.wait(l);
+	}
+}
+
+
+void InProcessHub::barrier()
+{
+	std::unique_lock<std::mutex> l(barrierLock);
+	const long myGeneration = barrierGeneration;
+	if (++barrierCnt == instances)
+	{
+		//the last one to come releases everyone
+		barrierCnt = 0;
+		++barrierGeneration;
+		barrierReached.notify_all();
+	}
+	else
+		barrierReached.wait(l, [this,myGeneration] { return barrierGeneration != myGeneration; });
+}
+
+
+void InProcessHub::close(const int instance)
+{
+	Mailbox& mb = *mailboxes[instance];
+	{
+		std::lock_guard<std::mutex> l(mb.lock);
+		mb.closed = true;
+	}
+	mb.arrived.notify_all();
+}
+
+
+// ------------------------------------------------------------------------------
+int InProcessCommunicator::send(const InProcessHub::e_channel channel,
+                                const void *data, const int items, const int peer, const e_comm_tags tag)
+{
+	InProcessHub::Message msg;
+	msg.channel = channel;
+	msg.isBroadcast = false;
+	msg.source = instance_ID;
+	msg.tag = tag;
+	msg.data.resize((size_t)items * itemSize(tag));
+	if (items > 0) std::memcpy(msg.data.data(), data, msg.data.size());
+
+	hub.post(peer, std::move(msg));
+	hasSent = true;
+	return 0;
+}
+
+
+bool InProcessCommunicator::receive(const InProcessHub::e_channel channel,
+                                    void *data, int & items, int & peer, e_comm_tags & tag)
+{
+	InProcessHub::Message msg;
+	if (!hub.take(instance_ID, channel, false, peer, tag, msg)) return false;
+
+	const size_t size = itemSize(msg.tag);
+	if (msg.data.size() > (size_t)items * size)
+		throw ERROR_REPORT("Message " << tagName(msg.tag) << " from #" << msg.source << " at #" << instance_ID
+		                   << " is longer (" << msg.data.size()/size << " items) than the receiving buffer ("
+		                   << items << " items)");
+
+	if (!msg.data.empty()) std::memcpy(data, msg.data.data(), msg.data.size());
+	items = (int)(msg.data.size() / size);
+	peer  = msg.source;
+	tag   = msg.tag;
+	return true;
+}
+
+
+bool InProcessCommunicator::receiveAndProcessDirectorMessage(void * buffer, int &recv_size, e_comm_tags &tag)
+{
+	int peer = DIRECTOR_ID;
+	return receive(InProcessHub::director_comm, buffer, recv_size, peer, tag);
+}
+
+
+bool InProcessCommunicator::receiveDirectorMessage(void * buffer, int &recv_size, e_comm_tags &tag, bool /*async*/)
+{
+	int peer = DIRECTOR_ID;
+	return receive(channelOf(tag, InProcessHub::director_comm), buffer, recv_size, peer, tag);
+}
+
+
+bool InProcessCommunicator::receiveFOMessage(void * buffer, int &recv_size, int & instance_ID, e_comm_tags &tag)
+{
+	if (instance_ID == FO_INSTANCE_ANY) instance_ID = -1;
+	if (!receive(channelOf(tag, InProcessHub::director_comm), buffer, recv_size, instance_ID, tag)) return false;
+	lastFOID = instance_ID;
+	return true;
+}
+
+
+bool InProcessCommunicator::sendBroadcast(void *data, int count, int sender_id, e_comm_tags tag)
+{
+	InProcessHub::Message msg;
+	msg.channel = channelOf(tag);
+	msg.isBroadcast = true;
+	msg.source = sender_id;
+	msg.tag = tag;
+	msg.data.resize((size_t)count * itemSize(tag));
+	if (count > 0) std::memcpy(msg.data.data(), data, msg.data.size());
+
+	//everyone else gets its own copy
+	for (int i = 0; i < instances; ++i)
+		if (i != instance_ID) hub.post(i, InProcessHub::Message(msg));
+	return true;
+}
+
+
+bool InProcessCommunicator::receiveBroadcast(void *data, int & count, int sender_id, e_comm_tags tag)
+{
+	InProcessHub::Message msg;
+	if (!hub.take(instance_ID, channelOf(tag), true, sender_id, tag, msg)) return false;
+
+	//like with MPI_Bcast, the receiver must know how much is coming
+	const size_t size = std::min(msg.data.size(), (size_t)count * itemSize(tag));
+	if (size > 0) std::memcpy(data, msg.data.data(), size);
+	return true;
+}
+
+
+void InProcessCommunicator::mergeImages(int FO, int slice_size, int slices, unsigned short * maskPixelBuffer, float * phantomBuffer, float * opticsBuffer)
+{
+	//the same schema as with the MPI_Communicator: every FO adds its image to the one
+	//that arrives from the previous FO and passes the sum on, slice by slice, and the
+	//Director receives the final sum directly into its buffers
+	std::vector<unsigned short> mask_add(maskPixelBuffer ? slice_size : 0);
+	std::vector<float> phantom_add(phantomBuffer ? slice_size : 0);
+	std::vector<float> optics_add(opticsBuffer ? slice_size : 0);
+
+	DEBUG_REPORT("From #" << instance_ID << " to #" << FO << " merge images plane size " << slice_size << " slices " << slices);
+	for (int slice = 0 ; slice < slices; slice++) {
+		unsigned short * mask_start = maskPixelBuffer+(size_t)slice*slice_size;
+		float * phantom_start = phantomBuffer+(size_t)slice*slice_size;
+		float * optics_start = opticsBuffer+(size_t)slice*slice_size;
+
+		if (instance_ID) { // Front officer - receives and send later
+			int items, peer;
+			e_comm_tags tag;
+			if (maskPixelBuffer) {
+				items = slice_size; peer = -1; tag = e_comm_tags::mask_data;
+				receive(InProcessHub::image_comm, mask_add.data(), items, peer, tag);
+			}
+			if (phantomBuffer) {
+				items = slice_size; peer = -1; tag = e_comm_tags::float_image_data;
+				receive(InProcessHub::image_comm, phantom_add.data(), items, peer, tag);
+			}
+			if (opticsBuffer) {
+				items = slice_size; peer = -1; tag = e_comm_tags::float_image_data;
+				receive(InProcessHub::image_comm, optics_add.data(), items, peer, tag);
+			}
+			for (int idx=0; idx < slice_size; idx++) {
+				if (maskPixelBuffer) { mask_start[idx] += mask_add[idx]; }
+				if (phantomBuffer)   { phantom_start[idx] += phantom_add[idx]; }
+				if (opticsBuffer)    { optics_start[idx] += optics_add[idx]; }
+			}
+		}
+
+		if (maskPixelBuffer) { send(InProcessHub::image_comm, mask_start, slice_size, FO, e_comm_tags::mask_data); }
+		if (phantomBuffer) { send(InProcessHub::image_comm, phantom_start, slice_size, FO, e_comm_tags::float_image_data); }
+		if (opticsBuffer) { send(InProcessHub::image_comm, optics_start, slice_size, FO, e_comm_tags::float_image_data); }
+
+		if (!instance_ID) { // Director - receives last, directly apply to the buffer
+			int items, peer;
+			e_comm_tags tag;
+			if (maskPixelBuffer) {
+				items = slice_size; peer = -1; tag = e_comm_tags::mask_data;
+				receive(InProcessHub::image_comm, mask_start, items, peer, tag);
+			}
+			if (phantomBuffer) {
+				items = slice_size; peer = -1; tag = e_comm_tags::float_image_data;
+				receive(InProcessHub::image_comm, phantom_start, items, peer, tag);
+			}
+			if (opticsBuffer) {
+				items = slice_size; peer = -1; tag = e_comm_tags::float_image_data;
+				receive(InProcessHub::image_comm, optics_start, items, peer, tag);
+			}
+		}
+	}
+	DEBUG_REPORT("From #" << instance_ID << " to #" << FO << " done ");
+}
+
+
+void InProcessCommunicator::close()
+{
+	finished=true;
+	hub.close(instance_ID);
+}
+
+
+InProcessHub::e_channel InProcessCommunicator::channelOf(e_comm_tags tag, InProcessHub::e_channel def)
+{
+	switch (tag) {
+		case e_comm_tags::next_ID:
+			return InProcessHub::id_comm;
+		case e_comm_tags::count_AABB:
+		case e_comm_tags::send_AABB:
+		case e_comm_tags::dead_AABB:
+		case e_comm_tags::compact_AABB:
+		case e_comm_tags::shadow_copy_data:
+		case e_comm_tags::shadow_copy:
+		case e_comm_tags::ghost_copy_data:
+		case e_comm_tags::ghost_copy:
+		case e_comm_tags::ghost_copy_count:
+			return InProcessHub::aabb_comm;
+		case e_comm_tags::count_new_type:
+		case e_comm_tags::new_type:
+			return InProcessHub::type_comm;
+		case e_comm_tags::mask_data:
+		case e_comm_tags::float_image_data:
+			return InProcessHub::image_comm;
+		case e_comm_tags::ACK:
+			return InProcessHub::world_comm;
+		case e_comm_tags::barrier:
+			return InProcessHub::barrier_comm;
+		default:
+			return def;
+	}
+}
+
+
+size_t InProcessCommunicator::itemSize(e_comm_tags tag)
+{
+	switch (tag) {
+		case e_comm_tags::get_shadow_copy:
+			return sizeof(int64_t);
+		case e_comm_tags::new_agent:
+		case e_comm_tags::update_parent:
+		case e_comm_tags::close_agent:
+		case e_comm_tags::next_ID:
+		case e_comm_tags::get_next_ID:
+		case e_comm_tags::count_new_type:
+		case e_comm_tags::dead_AABB:
+		case e_comm_tags::get_shadow_copies:
+		case e_comm_tags::agents_events:
+			return sizeof(int);
+		case e_comm_tags::count_AABB:
+		case e_comm_tags::shadow_copy:
+		case e_comm_tags::ghost_copy:
+		case e_comm_tags::ghost_copy_count:
+			return sizeof(uint64_t);
+		case e_comm_tags::send_AABB:
+			return sizeof(t_aabb);
+		case e_comm_tags::mask_data:
+			return sizeof(unsigned short);
+		case e_comm_tags::float_image_data:
+			return sizeof(float);
+		case e_comm_tags::new_type:
+			return sizeof(t_hashed_str);
+		default:
+			return 1;
+	}
+}
+#endif /*DISTRIBUTED_INPROCESS*/
@@ -0,0 +1,154 @@
+#ifndef INPROCESSCOMMUNICATOR_H
+#define INPROCESSCOMMUNICATOR_H
+
+#include "DistributedCommunicator.h"
+
+#ifdef DISTRIBUTED_INPROCESS
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/** The shared "network" of the InProcessCommunicators: one mailbox per
+    instance (the Director is instance 0, FOs are 1..N) into which the other
+    instances deposit (copies of) their messages. The matching of messages
+    follows MPI: point-to-point messages are matched by channel, source and tag,
+    broadcasts by channel and root only, and messages from the same source on
+    the same channel never overtake each other. */
+class InProcessHub
+{
+public:
+	InProcessHub(const int noOfInstances);
+
+	/** the Director and all FOs */
+	const int instances;
+
+	/** mimics the distinct MPI communicators of the MPI_Communicator */
+	typedef enum { world_comm, director_comm, aabb_comm, type_comm, image_comm, barrier_comm, id_comm } e_channel;
+
+	typedef struct {
+		e_channel channel;
+		bool isBroadcast;
+		int source;
+		e_comm_tags tag;
+		std::vector<char> data;
+	} Message;
+
+	/** deposits the message into the mailbox of the given instance, never blocks */
+	void post(const int toInstance, Message&& msg);
+
+	/** blocks until a matching message appears in the mailbox of the given instance,
+	    and moves it out to the 'msg'; 'source' or 'tag' may be -1 to match any,
+	    the 'tag' is ignored for broadcasts; returns false if the mailbox has been
+	    closed before any such message has arrived */
+	bool take(const int atInstance, const e_channel channel, const bool isBroadcast,
+	          const int source, const e_comm_tags tag, Message& msg);
+
+	/** checks (blocking or not) for any point-to-point message on the given channel,
+	    returns its tag, or e_comm_tags::unspecified if there's none (or if the
+	    mailbox has been closed while waiting) */
+	e_comm_tags probe(const int atInstance, const e_channel channel, const bool blocking);
+
+	/** blocks until all instances have called it */
+	void barrier();
+
+	/** closes the mailbox of the given instance, which also releases
+	    anyone who is waiting in the mailbox for a message */
+	void close(const int instance);
+
+private:
+	typedef struct {
+		std::mutex lock;
+		std::condition_variable arrived;
+		std::list<Message> messages;
+		bool closed = false;
+	} Mailbox;
+
+	std::vector< std::unique_ptr<Mailbox> > mailboxes;
+
+	std::mutex barrierLock;
+	std::condition_variable barrierReached;
+	int barrierCnt = 0;
+	long barrierGeneration = 0;
+};
+
+
+/** The DistributedCommunicator for running the Director and all FOs as threads
+    of one process, it is an in-memory replacement of the MPI_Communicator;
+    every thread has its own instance of this class, all of them share the hub */
+class InProcessCommunicator : public DistributedCommunicator
+{
+public:
+		InProcessCommunicator(InProcessHub& sharedHub, const int instanceID)
+			: DistributedCommunicator(), hub(sharedHub)
+		{
+				instances   = hub.instances;
+				instance_ID = instanceID;
+				lastFOID = -1;
+		}
+
+		/*** Communication channel to the director ***/
+		virtual int sendDirector(void *data, int count, e_comm_tags tag) {
+			return send(channelOf(tag, InProcessHub::director_comm), data, count, DIRECTOR_ID, tag);
+		}
+
+		virtual bool receiveAndProcessDirectorMessage(void * buffer, int &recv_size, e_comm_tags &tag);
+		virtual bool receiveDirectorMessage(void * buffer, int &recv_size, e_comm_tags &tag, bool async=true);
+
+		virtual size_t receiveRenderedFrame(int /*fromFO*/, int /*slice_size*/, int /*slices*/) {
+			/* Unused right now due to mergeImages method*/
+			return 0;
+		}
+		virtual void mergeImages(int FO, int slice_size, int slices, unsigned short * maskPixelBuffer, float * phantomBuffer, float * opticsBuffer);
+
+		virtual void waitSync(e_comm_tags = e_comm_tags::barrier) {
+			hub.barrier();
+		}
+
+		/*** Front officer communication channels */
+		virtual e_comm_tags detectFOMessage(bool async=true) {
+			return hub.probe(instance_ID, InProcessHub::director_comm, !async);
+		}
+
+		virtual bool receiveFOMessage(void * buffer, int &recv_size, int & instance_ID,  e_comm_tags &tag);
+
+		virtual int sendFO(void *data, int count, int instance_ID, e_comm_tags tag) {
+			return send(channelOf(tag, InProcessHub::director_comm), data, count, instance_ID, tag);
+		}
+
+		/** the sendFO() does not wait for the receiver already (the message is copied) */
+		virtual int postFO(void *data, int count, int instance_ID, e_comm_tags tag) {
+			return sendFO(data, count, instance_ID, tag);
+		}
+		virtual void waitForPostedFOs() {}
+
+		/*** Broadcast channel ***/
+		virtual bool sendBroadcast(void *data, int count, int sender_id, e_comm_tags tag);
+		virtual bool receiveBroadcast(void *data, int & count, int sender_id, e_comm_tags tag);
+
+		virtual void close();
+
+		virtual void wakeUpResponder() {
+			finished=true;
+			send(InProcessHub::director_comm, NULL, 0, instance_ID, e_comm_tags::noop);
+		}
+
+protected:
+		InProcessHub& hub;
+
+		int send(const InProcessHub::e_channel channel, const void *data, const int items, const int peer, const e_comm_tags tag);
+
+		/** 'peer' and 'tag' may be -1 (to match any), they are updated after the reception,
+		    'items' is the capacity of the 'data' and becomes the number of received items */
+		bool receive(const InProcessHub::e_channel channel, void *data, int & items, int & peer, e_comm_tags & tag);
+
+		/** follows the MPI_Communicator::tagCommMap() */
+		InProcessHub::e_channel channelOf(e_comm_tags tag, InProcessHub::e_channel def = InProcessHub::world_comm);
+
+		/** follows the MPI_Communicator::tagMap(), returns size of one item in bytes */
+		size_t itemSize(e_comm_tags tag);
+};
+#endif /*DISTRIBUTED_INPROCESS*/
+
+#endif
@@ -0,0 +1,266 @@
+#ifndef PAYLOADCOMPRESSION_H
+#define PAYLOADCOMPRESSION_H
+
+#include "../util/report.h"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+/** payloads shorter than this [bytes] are never compressed */
+#define PAYLOAD_COMPRESSION_THRESHOLD (1<<16)
+
+/** every this-th payload is compressed regardless of the estimates, to keep them fresh */
+#define PAYLOAD_COMPRESSION_PROBE_PERIOD 16
+
+/**
+ * Fast lossless codec for large payloads, such as serialized image geometries
+ * or image slices. The bytes are first shuffled so that the i-th bytes of all
+ * elements (of the given size) come together, which turns slowly varying
+ * numbers (and large zero areas) into long runs, and then an LZ77-style
+ * compression (in the spirit of LZ4) is applied.
+ *
+ * Neither the original size nor the element size is stored in the compressed
+ * stream, the caller has to send them along.
+ */
+class ByteShuffleLZ
+{
+public:
+	/** compresses 'size' bytes from 'in' into 'out' that has the 'outCapacity' bytes,
+	    returns the compressed size or 0 if it wouldn't fit into the 'outCapacity',
+	    the 'scratch' is a reusable helper buffer */
+	static size_t compress(const char* in, const size_t size, const size_t elemSize,
+	                       std::vector<char>& scratch, char* out, const size_t outCapacity)
+	{
+		const unsigned char* src = (const unsigned char*)in;
+		if (elemSize > 1)
+		{
+			if (scratch.size() < size) scratch.resize(size);
+			shuffle(in, size, elemSize, scratch.data());
+			src = (const unsigned char*)scratch.data();
+		}
+		return lzCompress(src, size, (unsigned char*)out, outCapacity);
+	}
+
+	/** restores exactly 'size' bytes into 'out' from the 'packedSize' bytes of 'in' */
+	static void decompress(const char* in, const size_t packedSize, const size_t elemSize,
+	                       std::vector<char>& scratch, char* out, const size_t size)
+	{
+		if (elemSize > 1)
+		{
+			if (scratch.size() < size) scratch.resize(size);
+			lzDecompress((const unsigned char*)in, packedSize, (unsigned char*)scratch.data(), size);
+			unshuffle(scratch.data(), size, elemSize, out);
+		}
+		else
+			lzDecompress((const unsigned char*)in, packedSize, (unsigned char*)out, size);
+	}
+
+protected:
+	static void shuffle(const char* in, const size_t size, const size_t elemSize, char* out)
+	{
+		const size_t cnt = size / elemSize;
+		for (size_t b = 0; b < elemSize; ++b)
+			for (size_t i = 0; i < cnt; ++i) out[b*cnt + i] = in[i*elemSize + b];
+		if (size > cnt*elemSize) std::memcpy(out + cnt*elemSize, in + cnt*elemSize, size - cnt*elemSize);
+	}
+
+	static void unshuffle(const char* in, const size_t size, const size_t elemSize, char* out)
+	{
+		const size_t cnt = size / elemSize;
+		for (size_t b = 0; b < elemSize; ++b)
+			for (size_t i = 0; i < cnt; ++i) out[i*elemSize + b] = in[b*cnt + i];
+		if (size > cnt*elemSize) std::memcpy(out + cnt*elemSize, in + cnt*elemSize, size - cnt*elemSize);
+	}
+
+	// -------------- the LZ part --------------
+	// The stream is a sequence of: token (literals count in the upper nibble,
+	// match length-4 in the lower one, 15 means "more follows in extra bytes
+	// of 255s terminated by a smaller one"), literals, 2B offset of the match.
+	// The last sequence has only the literals.
+	static const int HASH_BITS = 12;
+	static const size_t MIN_MATCH = 4;
+	static const size_t MAX_OFFSET = 65535;
+
+	static uint32_t hash4(const unsigned char* p)
+	{
+		uint32_t v;
+		std::memcpy(&v, p, 4);
+		return (v * 2654435761u) >> (32 - HASH_BITS);
+	}
+
+	/** writes the (token-)extra bytes of the 'len', returns false if out of space */
+	static bool putLength(size_t len, unsigned char*& op, const unsigned char* const oend)
+	{
+		while (len >= 255)
+		{
+			if (op == oend) return false;
+			*op++ = 255;
+			len -= 255;
+		}
+		if (op == oend) return false;
+		*op++ = (unsigned char)len;
+		return true;
+	}
+
+	static size_t getLength(const unsigned char*& ip, const unsigned char* const iend)
+	{
+		size_t len = 0;
+		unsigned char b;
+		do {
+			if (ip == iend) throw ERROR_REPORT("Corrupted compressed payload: truncated length");
+			b = *ip++;
+			len += b;
+		} while (b == 255);
+		return len;
+	}
+
+	static bool putSequence(const unsigned char* lit, const size_t litLen,
+	                        const size_t offset, const size_t matchLen,
+	                        unsigned char*& op, const unsigned char* const oend)
+	{
+		if (op == oend) return false;
+		unsigned char* const token = op++;
+		*token = (unsigned char)((litLen < 15 ? litLen : 15) << 4);
+		if (litLen >= 15 && !putLength(litLen-15, op, oend)) return false;
+
+		if ((size_t)(oend - op) < litLen) return false;
+		if (litLen > 0) std::memcpy(op, lit, litLen);
+		op += litLen;
+
+		if (matchLen == 0) return true; //the last sequence
+		if (oend - op < 2) return false;
+		*op++ = (unsigned char)(offset & 0xff);
+		*op++ = (unsigned char)(offset >> 8);
+
+		const size_t ml = matchLen - MIN_MATCH;
+		*token |= (unsigned char)(ml < 15 ? ml : 15);
+		if (ml >= 15 && !putLength(ml-15, op, oend)) return false;
+		return true;
+	}
+
+	static size_t lzCompress(const unsigned char* in, const size_t size,
+	                         unsigned char* out, const size_t outCapacity)
+	{
+		uint32_t table[1 << HASH_BITS];
+		std::memset(table, 0xff, sizeof(table));
+
+		unsigned char* op = out;
+		const unsigned char* const oend = out + outCapacity;
+		size_t anchor = 0, ip = 0;
+
+		while (size >= MIN_MATCH && ip <= size - MIN_MATCH)
+		{
+			const uint32_t h = hash4(in+ip);
+			const size_t cand = table[h];
+			table[h] = (uint32_t)ip;
+
+			if (cand == 0xffffffffu || ip - cand > MAX_OFFSET || std::memcmp(in+cand, in+ip, MIN_MATCH) != 0)
+			{
+				++ip;
+				continue;
+			}
+
+			size_t len = MIN_MATCH;
+			while (ip+len < size && in[cand+len] == in[ip+len]) ++len;
+
+			if (!putSequence(in+anchor, ip-anchor, ip-cand, len, op, oend)) return 0;
+			ip += len;
+			anchor = ip;
+		}
+
+		if (!putSequence(in+anchor, size-anchor, 0, 0, op, oend)) return 0;
+		return (size_t)(op - out);
+	}
+
+	static void lzDecompress(const unsigned char* in, const size_t packedSize,
+	                         unsigned char* out, const size_t size)
+	{
+		const unsigned char* ip = in;
+		const unsigned char* const iend = in + packedSize;
+		size_t op = 0;
+
+		while (ip < iend)
+		{
+			const unsigned char token = *ip++;
+			size_t litLen = token >> 4;
+			if (litLen == 15) litLen += getLength(ip, iend);
+			if ((size_t)(iend - ip) < litLen || size - op < litLen)
+				throw ERROR_REPORT("Corrupted compressed payload: literals overrun");
+			if (litLen > 0) std::memcpy(out+op, ip, litLen);
+			ip += litLen;
+			op += litLen;
+
+			if (ip == iend) break; //the last sequence
+
+			if (iend - ip < 2) throw ERROR_REPORT("Corrupted compressed payload: truncated offset");
+			const size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+			ip += 2;
+			size_t matchLen = (token & 15);
+			if (matchLen == 15) matchLen += getLength(ip, iend);
+			matchLen += MIN_MATCH;
+
+			if (offset == 0 || offset > op || size - op < matchLen)
+				throw ERROR_REPORT("Corrupted compressed payload: bad match");
+			//byte by byte as the match may overlap with itself
+			for (size_t i = 0; i < matchLen; ++i, ++op) out[op] = out[op-offset];
+		}
+
+		if (op != size)
+			throw ERROR_REPORT("Corrupted compressed payload: got " << op << " bytes instead of " << size);
+	}
+};
+
+
+/**
+ * Decides whether a payload of the given size shall be compressed before it
+ * is sent: it pays off if compressing (and decompressing on the other side)
+ * and sending the smaller payload takes shorter than sending the original one.
+ * The decision is based on running averages of the measured throughput of the
+ * link, of the codec and of the achieved compression ratio.
+ *
+ * Every user (thread) should own its instance, it is not thread-safe.
+ */
+class AdaptiveCompression
+{
+public:
+	/** returns true if the payload of the given size is worth to compress */
+	bool shouldCompress(const size_t bytes)
+	{
+		if (bytes < PAYLOAD_COMPRESSION_THRESHOLD) return false;
+
+		//without estimates, or once in a while, try it to learn
+		if (linkSpeed <= 0 || codecSpeed <= 0 || (++decisionsCnt % PAYLOAD_COMPRESSION_PROBE_PERIOD) == 0)
+			return true;
+
+		//compression + decompression (which is faster, but let's be conservative) + smaller transfer
+		const double packedTime = 2.0*(double)bytes/codecSpeed + ratio*(double)bytes/linkSpeed;
+		return packedTime < (double)bytes/linkSpeed;
+	}
+
+	/** reports how long [s] it took to send the given number of bytes (as they were on the wire) */
+	void reportTransfer(const size_t bytes, const double seconds)
+	{
+		if (bytes < PAYLOAD_COMPRESSION_THRESHOLD/4 || seconds <= 0) return;
+		update(linkSpeed, (double)bytes/seconds);
+	}
+
+	/** reports how long [s] it took to compress the 'bytes' into the 'packedBytes',
+	    the 'packedBytes' is 0 if the compression didn't pay off at all */
+	void reportCompression(const size_t bytes, const size_t packedBytes, const double seconds)
+	{
+		if (seconds > 0) update(codecSpeed, (double)bytes/seconds);
+		update(ratio, packedBytes > 0 ? (double)packedBytes/(double)bytes : 1.0);
+	}
+
+	/** running averages: [bytes/s], [bytes/s], and packed/original size */
+	double linkSpeed = 0, codecSpeed = 0, ratio = 1.0;
+
+private:
+	long decisionsCnt = 0;
+
+	static void update(double& avg, const double val)
+	{
+		avg = avg > 0 ? 0.8*avg + 0.2*val : val;
+	}
+};
+#endif
@@ -2,6 +2,7 @@
 #include <thread>
 #include "util/Vector3d.h"
 #include "util/synthoscopy/SNR.h"
+#include "util/Checkpoint.h"
 #include "FrontOfficer.h"
 #include "Director.h"
 
@@ -50,8 +51,13 @@ void Director::init1_SMP(void)
 	}
 
 	scenario.initializeScene();
+	SetRandomStreamsSeed(scenario.params.constants.randomSeed);
 	scenario.initializePhaseIIandIII();
 
+	const char* restartCheckpoint = scenario.getRestartCheckpoint();
+	if (restartCheckpoint != NULL) loadCheckpoint(restartCheckpoint);
+	lastCheckpointTime = currTime;
+
 	//"reminder" test
 	if (scenario.params.imagesSaving_isEnabledForImgPhantom()
 	 || scenario.params.imagesSaving_isEnabledForImgOptics())
@@ -88,9 +94,10 @@ void Director::init3_SMP(void)
 	//    just wanted that in the SMP case the rendering happens
 	//    as the very last operation of the entire init phase
 
-	//will block itself until the full rendering is complete
+	//will block itself until the full rendering is complete,
+	//the restarted simulation has rendered this frame already
 #ifndef DISTRIBUTED
-	renderNextFrame();
+	if (scenario.getRestartCheckpoint() == NULL) renderNextFrame();
 #endif
 }
 
@@ -108,22 +115,68 @@ void Director::close(void)
 	isProperlyClosedFlag = true;
 	DEBUG_REPORT("running the closing sequence");
 
-	//TODO: should close/kill the service thread too
+	//NB: the responder (service) thread is woken up and joined in close_communication()
 
 	//close tracks of all agents
-	for (auto ag : agents)
+	agents.forEach([this](const int agentID, const int)
 	{
 		//CTC logging?
-		if ( tracks.isTrackFollowed(ag.first)      //was part of logging?
-		&&  !tracks.isTrackClosed(ag.first) )      //wasn't closed yet?
-			tracks.closeTrack(ag.first,frameCnt-1);
-	}
+		if ( tracks.isTrackFollowed(agentID)      //was part of logging?
+		&&  !tracks.isTrackClosed(agentID) )      //wasn't closed yet?
+			tracks.closeTrack(agentID,frameCnt-1);
+	});
 
 	tracks.exportAllToFile("tracks.txt");
 	DEBUG_REPORT("tracks.txt was saved...");
 }
 
 
+void Director::saveCheckpoint(const std::string& filenamePrefix)
+{
+	CheckpointWriter cp(filenamePrefix+"_Direktor.bin", "Direktor");
+	cp.put(FOsCount);
+	cp.put(currTime);
+	cp.put(frameCnt);
+	cp.put(lastUsedAgentID);
+
+	cp.put((uint64_t)tracks.size());
+	for (const auto& t : tracks)
+	{
+		cp.put(t.second.ID);
+		cp.put(t.second.fromTimeStamp);
+		cp.put(t.second.toTimeStamp);
+		cp.put(t.second.parentID);
+	}
+
+	cp.close();
+	REPORT("Direktor saved checkpoint of " << agents.size() << " agents at " << currTime << " min");
+}
+
+
+void Director::loadCheckpoint(const std::string& filenamePrefix)
+{
+	CheckpointReader cp(filenamePrefix+"_Direktor.bin", "Direktor");
+	const int savedFOsCount = cp.get<int>();
+	currTime = cp.get<float>();
+	frameCnt = cp.get<int>();
+	lastUsedAgentID = cp.get<int>();
+
+	tracks.clear();
+	for (uint64_t i = cp.get<uint64_t>(); i > 0; --i)
+	{
+		TrackRecord_CTC t;
+		t.ID            = cp.get<int>();
+		t.fromTimeStamp = cp.get<int>();
+		t.toTimeStamp   = cp.get<int>();
+		t.parentID      = cp.get<int>();
+		tracks[t.ID] = t;
+	}
+
+	REPORT("Direktor restarts from the checkpoint of " << savedFOsCount << " FOs at " << currTime
+	       << " min (frame " << frameCnt << ", " << tracks.size() << " tracks)");
+}
+
+
 void Director::execute(void)
 {
 	REPORT("Direktor has just started the simulation");
@@ -188,6 +241,14 @@ void Director::execute(void)
 		FO->executeEndSub2();
 #endif
 		scenario.updateScene( currTime );
+
+		//the FOs decide the same on their own
+		const float checkpointTime = scenario.params.constants.checkpointTime;
+		if (checkpointTime > 0 && currTime >= lastCheckpointTime+checkpointTime)
+		{
+			saveCheckpoint(scenario.params.constants.checkpoint_filenamePrefix);
+			lastCheckpointTime = currTime;
+		}
 		waitHereUntilEveryoneIsHereToo();
 	}
 }
@@ -215,17 +276,13 @@ void Director::updateAndPublishAgents()
 	//there will be no (network) traffic now because all necessary
 	//notifications had been transferred during the recent simulation
 
-	//remove dead agents from both lists
-	auto ag = deadAgents.begin();
-	while (ag != deadAgents.end())
-	{
-		//remove if agentID matches
-		agents.remove_if([ag](std::pair<int,int> p){ return p.first == ag->first; });
-		ag = deadAgents.erase(ag);
-	}
+	//register new agents first as some of them might have already
+	//managed to become dead ones too, and then remove the dead agents
+	for (const auto& ag : newAgents) agents.add(ag.first,ag.second);
+	newAgents.clear();
 
-	//move new agents between both lists
-	agents.splice(agents.begin(), newAgents);
+	for (const auto& ag : deadAgents) agents.remove(ag.first);
+	deadAgents.clear();
 
 	//now tell the FOs to start interchanging AABBs of their active agents:
 	//notice that every FO should be "prepared" for this since all
@@ -239,23 +296,22 @@ void Director::updateAndPublishAgents()
 	//that his broadcasting is over
 	waitFor_publishAgentsAABBs();
 
-#ifdef DISTRIBUTED
-	//now that we were assured that all FOs have broadcast their AABBs,
-	//but the messages sent by the last FO might still being processed
-	//by some FOs and so wait here a bit and then ask FO, one by one,
-	//to tell us how many AABBs it currently has
-	DEBUG_REPORT("Waiting 1 second before checking all FOs...");
-	std::this_thread::sleep_for((std::chrono::milliseconds)1000);
-#endif
-
-	//all FOs except myself (assuming i=0 addresses the Direktor)
+	//in the distributed case, the consistency has been verified already along the
+	//exchange: the Director and every FO compared the checksums of agents announced
+	//in the broadcast headers with what they have registered/replicated
 #ifndef DISTRIBUTED
+	//otherwise, ask explicitly every FO (except myself, assuming i=0 addresses the Direktor),
+	//but only every now and then as the agents are not moving anywhere in between
+#ifndef DEBUG
+	if (agentsUpdatesCnt % AABBS_EXPLICIT_CHECK_PERIOD == 0)
+#endif
 	for (int i = 1; i <= FOsCount; ++i)
 	{
 		if (request_CntOfAABBs(i) != agents.size())
 			throw ERROR_REPORT("FO #" << i << " does not have a complete list of AABBs");
 	}
 #endif
+	++agentsUpdatesCnt;
 }
 
 void Director::postprocessAfterUpdateAndPublishAgents()
@@ -274,6 +330,14 @@ int Director::getNextAvailAgentID()
 }
 
 
+int Director::getNextAvailAgentIDs(const int noOfIDs)
+{
+	const int firstID = lastUsedAgentID+1;
+	lastUsedAgentID += noOfIDs;
+	return firstID;
+}
+
+
 void Director::startNewAgent(const int agentID,
                              const int associatedFO,
                              const bool wantsToAppearInCTCtracksTXTfile)
@@ -308,12 +372,8 @@ void Director::startNewDaughterAgent(const int childID, const int parentID)
 
 int Director::getFOsIDofAgent(const int agentID)
 {
-	auto ag = agents.begin();
-	while (ag != agents.end())
-	{
-		if (ag->first == agentID) return ag->second;
-		++ag;
-	}
+	const int FO = agents.getFO(agentID);
+	if (FO >= 0) return FO;
 
 	throw ERROR_REPORT("Couldn't find a record about agent " << agentID);
 }
@@ -399,13 +459,19 @@ void Director::renderNextFrame()
 	{
 		sprintf(fn,sc.constants.imgFinal_filenameTemplate,frameCnt);
 		REPORT("Creating " << fn << ", hold on...");
+		scenario.imgFinalSNR.clear();
+		scenario.imgFinalFrameNo = frameCnt;
 		scenario.doPhaseIIandIII();
 		REPORT("Saving " << fn << ", hold on...");
 		sc.imgFinal.SaveImage(fn);
 
 		sc.displayChannel_transferImgFinal();
 
-		if (sc.isProducingOutput(sc.imgMask)) mitogen::ComputeSNR(sc.imgFinal,sc.imgMask);
+		if (sc.isProducingOutput(sc.imgMask))
+		{
+			if (!scenario.imgFinalSNR.isEmpty()) scenario.imgFinalSNR.report();
+			else mitogen::ComputeSNR(sc.imgFinal,sc.imgMask);
+		}
 	}
 
 	++frameCnt;
@@ -481,11 +547,10 @@ void Director::renderNextFrame()
 				if (std::cin.good())
 				{
 					key = 'y'; //to detect if some agent has been modified
-					for (auto c : agents)
-					if (c.first == id)
+					if (agents.contains(id))
 					{
-						if (ivwKey != 'I') setAgentsDetailedDrawingMode(c.first,state);
-						if (ivwKey != 'V') setAgentsDetailedReportingMode(c.first,state);
+						if (ivwKey != 'I') setAgentsDetailedDrawingMode(id,state);
+						if (ivwKey != 'V') setAgentsDetailedReportingMode(id,state);
 						REPORT((ivwKey != 'I' ? "vizu " : "")
 						    << (ivwKey != 'V' ? "console " : "")
 						    << "inspection" << (ivwKey == 'W'? "s " : " ")
@@ -532,6 +597,7 @@ void Director::renderNextFrame()
 void Director::reportAgentsAllocation()
 {
 	REPORT("I now recognize these agents:");
-	for (const auto& AgFO : agents)
-		REPORT("agent ID " << AgFO.first << " at FO #" << AgFO.second);
+	for (int FO = 1; FO <= FOsCount; ++FO)
+		for (int agentID : agents.getAgentsOfFO(FO))
+			REPORT("agent ID " << agentID << " at FO #" << FO);
 }
@@ -4,6 +4,8 @@
 #include <list>
 #include <utility>
 #include "util/report.h"
+#include "util/rnd_generators.h"
+#include "AgentsRegistry.h"
 #include "TrackRecord_CTC.h"
 #include "Scenarios/common/Scenario.h"
 
@@ -11,6 +13,11 @@
 #  include <thread>
 #endif
 
+/** every this-th update of agents, the Director explicitly asks FOs how many
+    AABBs they hold; in debug builds it asks every time; not used in the
+    distributed case where the AABBs exchange carries checksums itself */
+#define AABBS_EXPLICIT_CHECK_PERIOD 20
+
 
 class FrontOfficer;
 class DistributedCommunicator;
@@ -29,6 +36,10 @@ public:
 	{
 		scenario.declareDirektorContext();
 		//TODO: create an extra thread to execute/service the respond_...() methods
+
+		//the Direktor's synthoscopy draws from the rndStreams too; this is
+		//again set in init1_SMP() as the scenario may change it in initializeScene()
+		SetRandomStreamsSeed(scenario.params.constants.randomSeed);
 	}
 
 protected:
@@ -68,12 +79,19 @@ public:
 	/** frees simulation agents, writes the tracks.txt file */
 	void close(void);
 
+	/** writes the Direktor's portion of the checkpoint into '<filenamePrefix>_Direktor.bin':
+	    the global time, frame counter, last used agent ID and the CTC tracks; the registry
+	    of agents is not saved as it is rebuilt when FOs restart their agents */
+	void saveCheckpoint(const std::string& filenamePrefix);
+
+	/** restores what saveCheckpoint() has written, the checkpoint
+	    could have been written with a different number of FOs */
+	void loadCheckpoint(const std::string& filenamePrefix);
+
 	/** attempts to clean up, if not done earlier */
 	~Director(void)
 	{
 #ifdef DISTRIBUTED
-		pthread_cancel(responder.native_handle());
-		responder.join();
 		close_communication();
 #endif
 		DEBUG_REPORT("Direktor already closed? " << (isProperlyClosedFlag ? "yes":"no"));
@@ -84,6 +102,10 @@ public:
 	/** new available, not-yet-used, unique agent ID is created here */
 	int getNextAvailAgentID();
 
+	/** reserves a block of 'noOfIDs' new, not-yet-used, consecutive agent IDs,
+	    and returns the first of them */
+	int getNextAvailAgentIDs(const int noOfIDs);
+
 	/** introduces a new agent into the universe of this simulation, and,
 	    optionally, it can log this event into the CTC tracking file */
 	void startNewAgent(const int agentID, const int associatedFO,
@@ -152,11 +174,14 @@ protected:
 		 maps between agent ID and FO ID associated with this agent */
 	std::list< std::pair<int,int> > newAgents, deadAgents;
 
+	/** counter of the updateAndPublishAgents() calls */
+	int agentsUpdatesCnt = 0;
+
 	/** map of all agents currently active in the simulation,
 	    maps between agent ID and FO ID associated with this agent,
 	    the main purpose of this map is to know which FO to ask when
 	    detailed geometry (in a form of the ShadowAgent) is needed */
-	std::list< std::pair<int,int> > agents;
+	AgentsRegistry agents;
 
 	/** structure to hold durations of tracks and the mother-daughter relations */
 	TrackRecords_CTC tracks;
@@ -167,6 +192,9 @@ protected:
 	/** counter of exports/snapshots, used to numerate frames and output image files */
 	int frameCnt = 0;
 
+	/** global time [min] of the last checkpoint (or of the start of the simulation) */
+	float lastCheckpointTime = 0.0f;
+
 	/** flag if the renderNextFrame() will be called after this simulation round */
 	bool willRenderNextFrameFlag = false;
 
@@ -204,12 +232,16 @@ protected:
 
 	void waitHereUntilEveryoneIsHereToo();
 
-	void respond_getNextAvailAgentID();
+	void respond_getNextAvailAgentIDs(const int noOfIDs);
 
 	void respond_startNewAgent(int FO); //TBD - add parameters from start*
 	void respond_closeAgent(int FO);
 	void respond_updateParentalLink(int FO);
 
+	/** registers the batch of agents lifecycle events from the given FO,
+	    see FrontOfficer::agentsEvents */
+	void respond_agentsEvents(int FO, const int* events, const int count);
+
 	//void respond_willRenderNextFrameFlag();
 
 	void notify_publishAgentsAABBs(const int FOsID);
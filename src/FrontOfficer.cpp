@@ -1,4 +1,8 @@
+#include <memory>
 #include "Agents/AbstractAgent.h"
+#include "Agents/util/AgentsFactory.h"
+#include "util/Checkpoint.h"
+#include "util/rnd_generators.h"
 #include "FrontOfficer.h"
 #include "Director.h"
 
@@ -10,9 +14,15 @@ void FrontOfficer::init1_SMP()
 {
 	REPORT("FO #" << ID << " initializing now...");
 	currTime = scenario.params.constants.initTime;
-
 	scenario.initializeScene();
-	scenario.initializeAgents(this,ID,FOsCount);
+	SetRandomStreamsSeed(scenario.params.constants.randomSeed);
+
+	const char* restartCheckpoint = scenario.getRestartCheckpoint();
+	if (restartCheckpoint != NULL)
+		loadCheckpoint(restartCheckpoint);
+	else
+		scenario.initializeAgents(this,ID,FOsCount);
+	lastCheckpointTime = currTime;
 }
 
 void FrontOfficer::init2_SMP()
@@ -52,6 +62,8 @@ void FrontOfficer::reportSituation()
 	  << agents.size() << " in this FO #" << ID << " / "
 	  << AABBs.size() << " AABBs (entire world), "
 	  << shadowAgents.size() << " cached geometries) ---------------");
+	DEBUG_REPORT("cached geometries take " << shadowAgentsCacheBytes << " bytes, hits: " << shadowAgentsCacheHits
+	          << ", misses: " << shadowAgentsCacheMisses << ", evictions: " << shadowAgentsCacheEvictions);
 }
 
 
@@ -63,6 +75,11 @@ void FrontOfficer::close(void)
 
 	//TODO: should close/kill the service thread too
 
+#ifdef DISTRIBUTED
+	//the background exchange must not touch the agents we're about to delete
+	if (shadowAgentsExchange.joinable()) shadowAgentsExchange.join();
+#endif
+
 	//delete all agents... also later from newAgents & deadAgents, note that
 	//the same agent may exist on the agents and deadAgents lists simultaneously
 	DEBUG_REPORT("will remove " << agents.size() << " active agents");
@@ -100,10 +117,13 @@ void FrontOfficer::close(void)
 	DEBUG_REPORT("will remove " << shadowAgents.size() << " shadow agents");
 	for (auto sh : shadowAgents)
 	{
-		delete sh.second;
+		disposeShadowAgent(sh.second);
 		sh.second = NULL;
 	}
 	shadowAgents.clear();
+	shadowAgentsCacheEntries.clear();
+	shadowAgentsLRU.clear();
+	shadowAgentsCacheBytes = 0;
 
 	//clean up aux attribs
 	delete __agentTypeBuf;
@@ -172,6 +192,122 @@ void FrontOfficer::executeEndSub2()
 {
 	//this was promised to happen after every simulation round is over
 	scenario.updateScene( currTime );
+
+	//the Direktor decides the same on its own
+	const float checkpointTime = scenario.params.constants.checkpointTime;
+	if (checkpointTime > 0 && currTime >= lastCheckpointTime+checkpointTime)
+	{
+		saveCheckpoint(scenario.params.constants.checkpoint_filenamePrefix);
+		lastCheckpointTime = currTime;
+	}
+}
+
+
+void FrontOfficer::saveCheckpoint(const std::string& filenamePrefix)
+{
+	if (!newAgents.empty() || !deadAgents.empty())
+		throw ERROR_REPORT("Cannot save checkpoint while agents are being added or removed");
+
+	CheckpointWriter cp(buildStringFromStream(filenamePrefix << "_FO" << ID << ".bin"), "FO");
+	cp.put(ID);
+	cp.put(FOsCount);
+	cp.put(currTime);
+	cp.put(frameCnt);
+
+	std::vector<char> rngState;
+	GetRandomGeneratorState(rngState);
+	cp.putVector(rngState);
+
+	//all known agent types, not only those of own agents
+	const auto& knownTypes = agentsTypesDictionary.showKnownDictionary();
+	const auto& newTypes   = agentsTypesDictionary.showNewDictionary();
+	cp.put((uint64_t)(knownTypes.size()+newTypes.size()));
+	for (const auto& t : knownTypes) cp.putString(t.second);
+	for (const auto& t : newTypes)   cp.putString(t.second);
+
+	cp.put((uint64_t)agents.size());
+	for (const auto& a : agents)
+	{
+		const AbstractAgent& ag = *a.second;
+		const char* className = ag.getCheckpointClassName();
+		if (className == NULL)
+			throw ERROR_REPORT("Agent " << ag.ID << " of type " << ag.getAgentType() << " cannot be checkpointed");
+
+		//the ID goes first so that the readers can skip agents that are not theirs
+		cp.beginRecord();
+		cp.put(ag.ID);
+		cp.putString(className);
+		cp.putString(ag.getAgentType());
+		cp.put(ag.getLocalTime());
+		cp.putGeometry(ag.getGeometry());
+		ag.saveCheckpoint(cp);
+		cp.endRecord();
+	}
+
+	cp.close();
+	REPORT("FO #" << ID << " saved checkpoint of " << agents.size() << " agents at " << currTime << " min");
+}
+
+
+void FrontOfficer::loadCheckpoint(const std::string& filenamePrefix)
+{
+	const float incrTime = scenario.params.constants.incrTime;
+
+	//the number of FOs that wrote the checkpoint is learned from the first file
+	int savedFOsCount = 1;
+	size_t adoptedAgents = 0;
+	for (int savedFO = 1; savedFO <= savedFOsCount; ++savedFO)
+	{
+		CheckpointReader cp(buildStringFromStream(filenamePrefix << "_FO" << savedFO << ".bin"), "FO");
+		const int   savedID       = cp.get<int>();
+		const int   savedCount    = cp.get<int>();
+		const float savedTime     = cp.get<float>();
+		const int   savedFrameCnt = cp.get<int>();
+		if (savedFO == 1)
+		{
+			savedFOsCount = savedCount;
+			currTime = savedTime;
+			frameCnt = savedFrameCnt;
+		}
+		if (savedID != savedFO || savedCount != savedFOsCount || savedTime != currTime || savedFrameCnt != frameCnt)
+			throw ERROR_REPORT(cp.getFileName() << " does not belong to the same checkpoint as "
+			                   << filenamePrefix << "_FO1.bin");
+
+		std::vector<char> rngState;
+		cp.getVector(rngState);
+		if (savedFO == ID) SetRandomGeneratorState(rngState);
+
+		for (uint64_t types = cp.get<uint64_t>(); types > 0; --types)
+			agentsTypesDictionary.registerThisString(cp.getString());
+
+		for (uint64_t savedAgents = cp.get<uint64_t>(); savedAgents > 0; --savedAgents)
+		{
+			cp.beginRecord();
+			const int agentID = cp.get<int>();
+			if (agentID % FOsCount +1 != ID)
+			{
+				cp.skipRecord();
+				continue;
+			}
+
+			const std::string className = cp.getString();
+			const std::string agentType = cp.getString();
+			const float localTime = cp.get<float>();
+			std::unique_ptr<Geometry> geom(cp.getGeometry());
+
+			std::unique_ptr<AbstractAgent> ag(
+				AgentsFactory::create(className, agentID,agentType, *geom, localTime,incrTime) );
+			ag->loadCheckpoint(cp);
+			cp.endRecord();
+
+			//the tracks are restored by the Direktor
+			startNewAgent(ag.release(), false);
+			++adoptedAgents;
+		}
+	}
+
+	REPORT("FO #" << ID << " restarted " << adoptedAgents << " agents from the checkpoint of "
+	       << savedFOsCount << " FOs at " << currTime << " min");
 }
 
 void FrontOfficer::executeInternals()
@@ -208,14 +344,49 @@ void FrontOfficer::executeExternals()
 	reportAABBs();
 #endif
 #endif
-	//react (unwillingly) to the new geometries... (can run in parallel),
-	//the agents' (external at least!) geometries must not change during this phase
+	//boxes around agents of every other FO, agents farther than the halo
+	//distance from all of them are not expected to ask for foreign geometries
+	//(if they do, e.g. when searching farther than the halo distance, they
+	//wait in getNearbyAgent() for the exchange and then fetch them on demand)
+	std::map<int,AxisAlignedBoundingBox> foreignBoxesBounds;
+	for (const auto& b : AABBs)
+	{
+		if (agents.find(b.ID) != agents.end()) continue;
+		AxisAlignedBoundingBox& bounds = foreignBoxesBounds[agentsToFOsMap[b.ID]];
+		bounds.minCorner.elemMin(b.minCorner);
+		bounds.maxCorner.elemMax(b.maxCorner);
+	}
+	const float maxDist2 = shadowAgentsPrefetchDistance*shadowAgentsPrefetchDistance;
+
+	//make the nearby foreign geometries available before they are asked for,
+	//while this is happening, the agents far from the foreign ones can
+	//already react (unwillingly) to the new geometries...
+	startNearbyShadowAgentsExchange();
+
+	std::vector<AbstractAgent*> boundaryAgents;
 	std::map<int,AbstractAgent*>::iterator c=agents.begin();
 	for (; c != agents.end(); c++)
 	{
-		c->second->collectExtForces();
+		bool isNearForeignAgents = false;
+		for (const auto& fb : foreignBoxesBounds)
+			if (fb.second.minDistance(c->second->getAABB()) < maxDist2) { isNearForeignAgents = true; break; }
+
+		if (isNearForeignAgents) boundaryAgents.push_back(c->second);
+		else c->second->collectExtForces();
 	}
 
+	//...and the remaining ones once the exchange is over
+	//(can run in parallel), the agents' (external at least!)
+	//geometries must not change during this phase
+	finishNearbyShadowAgentsExchange();
+	for (auto ag : boundaryAgents)
+	{
+		ag->collectExtForces();
+	}
+
+	//no one holds any ShadowAgent now
+	evictShadowAgents();
+
 	//propagate current internal geometries to the exported ones... (can run in parallel)
 	c=agents.begin();
 	for (; c != agents.end(); c++)
@@ -453,6 +624,13 @@ void FrontOfficer::getNearbyAgents(const ShadowAgent* const fromSA,   //referenc
 }
 
 
+void FrontOfficer::disposeShadowAgent(ShadowAgent* sa)
+{
+	delete &sa->getGeometry();
+	delete sa;
+}
+
+
 const ShadowAgent* FrontOfficer::getNearbyAgent(const int fetchThisID)
 {
 	//is the requested agent living in the same (*this) FO?
@@ -460,6 +638,8 @@ const ShadowAgent* FrontOfficer::getNearbyAgent(const int fetchThisID)
 	if (ag != agents.end()) return ag->second;
 
 	//no, the requested agent is somewhere outside...
+	//(and the exchange of the nearby ones must not be running in the meantime)
+	finishNearbyShadowAgentsExchange();
 #ifdef DEBUG
 	//btw: must have been broadcasted and we must therefore see the agent in our data structures
 	if (agentsToFOsMap.find(fetchThisID) == agentsToFOsMap.end())
@@ -473,18 +653,26 @@ const ShadowAgent* FrontOfficer::getNearbyAgent(const int fetchThisID)
 	int storedVersion = (saItem != shadowAgents.end()) ? saItem->second->getGeometry().version : -1000000;
 
 	//if we have a recent geometry by us, let's just return this one
-	if (storedVersion == agentsAndBroadcastGeomVersions[fetchThisID]) return saItem->second;
+	if (storedVersion == agentsAndBroadcastGeomVersions[fetchThisID])
+	{
+		++shadowAgentsCacheHits;
+		touchShadowAgent(fetchThisID);
+		return saItem->second;
+	}
+	++shadowAgentsCacheMisses;
 
 	//else, we have to obtain the most recent copy...
+	//(in the push mode, this happens only for agents beyond the halo distance)
 	const int contactThisFO = agentsToFOsMap[fetchThisID];
 	DEBUG_REPORT("Requesting agent ID " << fetchThisID << " from FO #" << contactThisFO);
 	ShadowAgent* const saCopy = request_ShadowAgentCopy(fetchThisID, contactThisFO);
 
-	//delete the now-old content first (if there was some)
-	if (saItem != shadowAgents.end()) delete saItem->second;
+	//delete the now-old content first (if there was some and if it was not updated in place)
+	if (saItem != shadowAgents.end() && saItem->second != saCopy) disposeShadowAgent(saItem->second);
 
 	//store the new reference
 	shadowAgents[fetchThisID] = saCopy;
+	touchShadowAgent(fetchThisID);
 
 #ifdef DEBUG
 	//now the broadcast version must match the one we actually have got
@@ -498,6 +686,237 @@ const ShadowAgent* FrontOfficer::getNearbyAgent(const int fetchThisID)
 }
 
 
+void FrontOfficer::touchShadowAgent(const int agentID)
+{
+	const long bytes = shadowAgents[agentID]->getGeometry().getSizeInBytes();
+
+	auto e = shadowAgentsCacheEntries.find(agentID);
+	if (e == shadowAgentsCacheEntries.end())
+	{
+		shadowAgentsLRU.push_front(agentID);
+		shadowAgentsCacheEntries[agentID] = ShadowAgentCacheEntry{shadowAgentsLRU.begin(), bytes};
+		shadowAgentsCacheBytes += bytes;
+		return;
+	}
+
+	shadowAgentsLRU.splice(shadowAgentsLRU.begin(), shadowAgentsLRU, e->second.lruPos);
+	shadowAgentsCacheBytes += bytes - e->second.bytes;
+	e->second.bytes = bytes;
+}
+
+
+void FrontOfficer::forgetShadowAgent(const int agentID)
+{
+	auto e = shadowAgentsCacheEntries.find(agentID);
+	if (e == shadowAgentsCacheEntries.end()) return;
+
+	shadowAgentsCacheBytes -= e->second.bytes;
+	shadowAgentsLRU.erase(e->second.lruPos);
+	shadowAgentsCacheEntries.erase(e);
+}
+
+
+void FrontOfficer::evictShadowAgents()
+{
+	if (shadowAgentsMemoryBudget <= 0) return;
+
+	while (shadowAgentsCacheBytes > shadowAgentsMemoryBudget && !shadowAgentsLRU.empty())
+	{
+		const int agentID = shadowAgentsLRU.back();
+		forgetShadowAgent(agentID);
+
+		auto sa = shadowAgents.find(agentID);
+		disposeShadowAgent(sa->second);
+		shadowAgents.erase(sa);
+		++shadowAgentsCacheEvictions;
+	}
+}
+
+
+void FrontOfficer::startNearbyShadowAgentsExchange()
+{
+#ifdef DISTRIBUTED
+	//the worker is re-used in every round (rather than spawned anew)
+	if (!shadowAgentsExchange.joinable())
+		shadowAgentsExchange = std::thread(&FrontOfficer::runNearbyShadowAgentsExchanges, this);
+
+	{
+		std::lock_guard<std::mutex> lock(shadowAgentsExchangeMutex);
+		shadowAgentsExchangeError = nullptr;
+		shadowAgentsExchangePending = true;
+	}
+	shadowAgentsExchangeSignal.notify_all();
+#else
+	if (scenario.params.constants.shadowAgentsPushMode) pushNearbyShadowAgents();
+	else prefetchNearbyShadowAgents();
+#endif
+}
+
+
+void FrontOfficer::finishNearbyShadowAgentsExchange()
+{
+#ifdef DISTRIBUTED
+	std::unique_lock<std::mutex> lock(shadowAgentsExchangeMutex);
+	shadowAgentsExchangeSignal.wait(lock, [this]{ return !shadowAgentsExchangePending; });
+	if (shadowAgentsExchangeError)
+	{
+		std::exception_ptr e = shadowAgentsExchangeError;
+		shadowAgentsExchangeError = nullptr;
+		std::rethrow_exception(e);
+	}
+#endif
+}
+
+
+#ifdef DISTRIBUTED
+void FrontOfficer::runNearbyShadowAgentsExchanges()
+{
+	std::unique_lock<std::mutex> lock(shadowAgentsExchangeMutex);
+	while (true)
+	{
+		shadowAgentsExchangeSignal.wait(lock, [this]
+			{ return shadowAgentsExchangePending || shadowAgentsExchangeQuit; });
+		if (!shadowAgentsExchangePending) return;
+
+		//the main thread is waiting in finishNearbyShadowAgentsExchange()
+		//or is not touching the ShadowAgents in the meantime
+		lock.unlock();
+		std::exception_ptr error;
+		try
+		{
+			if (scenario.params.constants.shadowAgentsPushMode) pushNearbyShadowAgents();
+			else prefetchNearbyShadowAgents();
+		}
+		catch (...)
+		{
+			error = std::current_exception();
+		}
+		lock.lock();
+
+		shadowAgentsExchangeError = error;
+		shadowAgentsExchangePending = false;
+		shadowAgentsExchangeSignal.notify_all();
+	}
+}
+
+
+void FrontOfficer::stopNearbyShadowAgentsExchanges()
+{
+	if (!shadowAgentsExchange.joinable()) return;
+	{
+		std::lock_guard<std::mutex> lock(shadowAgentsExchangeMutex);
+		shadowAgentsExchangeQuit = true;
+	}
+	shadowAgentsExchangeSignal.notify_all();
+	shadowAgentsExchange.join();
+}
+#endif
+
+
+void FrontOfficer::prefetchNearbyShadowAgents()
+{
+	//no foreign agents at all?
+	if (FOsCount < 2 || agents.empty()) return;
+
+	//box around all our agents to quickly skip the far away foreign boxes
+	AxisAlignedBoundingBox localBox;
+	for (auto ag : agents)
+	{
+		localBox.minCorner.elemMin(ag.second->getAABB().minCorner);
+		localBox.maxCorner.elemMax(ag.second->getAABB().maxCorner);
+	}
+
+	const float maxDist2 = shadowAgentsPrefetchDistance*shadowAgentsPrefetchDistance;
+	std::map<int,std::vector<int> > fetchTheseIDsFromFOs;
+	int fetchCnt = 0;
+
+	for (const auto& b : AABBs)
+	{
+		//own agent, or too far from all our agents?
+		if (agents.find(b.ID) != agents.end()) continue;
+		if (localBox.minDistance(b) >= maxDist2) continue;
+
+		//do we have a recent copy already?
+		const auto saItem = shadowAgents.find(b.ID);
+		if (saItem != shadowAgents.end()
+		    && saItem->second->getGeometry().version == agentsAndBroadcastGeomVersions[b.ID]) continue;
+
+		for (auto ag : agents)
+		if (ag.second->getAABB().minDistance(b) < maxDist2)
+		{
+			fetchTheseIDsFromFOs[agentsToFOsMap[b.ID]].push_back(b.ID);
+			++fetchCnt;
+			break;
+		}
+	}
+
+	if (fetchTheseIDsFromFOs.empty()) return;
+	DEBUG_REPORT("FO #" << ID << " prefetches " << fetchCnt << " ShadowAgents from "
+	             << fetchTheseIDsFromFOs.size() << " FOs");
+	request_ShadowAgentCopies(fetchTheseIDsFromFOs);
+}
+
+
+void FrontOfficer::pushNearbyShadowAgents()
+{
+	if (FOsCount < 2) return;
+
+	//AABBs of agents of every other FO, and a box around them all
+	std::map<int,std::list<const NamedAxisAlignedBoundingBox*> > foreignBoxes;
+	std::map<int,AxisAlignedBoundingBox> foreignBoxesBounds;
+	for (const auto& b : AABBs)
+	{
+		if (agents.find(b.ID) != agents.end()) continue;
+		const int FOsID = agentsToFOsMap[b.ID];
+		foreignBoxes[FOsID].push_back(&b);
+
+		AxisAlignedBoundingBox& bounds = foreignBoxesBounds[FOsID];
+		bounds.minCorner.elemMin(b.minCorner);
+		bounds.maxCorner.elemMax(b.maxCorner);
+	}
+
+	const float maxDist2 = shadowAgentsPrefetchDistance*shadowAgentsPrefetchDistance;
+	std::map<int,std::vector<int> > pushTheseIDsToFOs;
+	int pushCnt = 0;
+
+	for (const auto& fb : foreignBoxes)
+	{
+		std::map<int,int>& pushedVersions = pushedShadowAgentsVersions[fb.first];
+		for (auto ag : agents)
+		{
+			//is the FO already aware of this version?
+			const int version = ag.second->getGeometry().version;
+			const auto pv = pushedVersions.find(ag.first);
+			if (pv != pushedVersions.end() && pv->second == version) continue;
+
+			const AxisAlignedBoundingBox& aabb = ag.second->getAABB();
+			if (foreignBoxesBounds[fb.first].minDistance(aabb) >= maxDist2) continue;
+
+			for (auto b : fb.second)
+			if (b->minDistance(aabb) < maxDist2)
+			{
+				pushTheseIDsToFOs[fb.first].push_back(ag.first);
+				pushedVersions[ag.first] = version;
+				++pushCnt;
+				break;
+			}
+		}
+
+		//forget about the agents that are no longer here
+		auto pv = pushedVersions.begin();
+		while (pv != pushedVersions.end())
+		{
+			if (agents.find(pv->first) == agents.end()) pv = pushedVersions.erase(pv);
+			else ++pv;
+		}
+	}
+
+	DEBUG_REPORT("FO #" << ID << " pushes " << pushCnt << " ShadowAgents to "
+	             << pushTheseIDsToFOs.size() << " FOs");
+	exchange_ShadowAgentCopies(pushTheseIDsToFOs);
+}
+
+
 void FrontOfficer::renderNextFrame()
 {
 	REPORT("Rendering time point " << frameCnt);
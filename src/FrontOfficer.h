@@ -3,6 +3,8 @@
 
 #include <list>
 #include <map>
+#include <unordered_map>
+#include <vector>
 #include "util/report.h"
 #include "util/strings.h"
 #include "Scenarios/common/Scenario.h"
@@ -10,7 +12,12 @@
 
 #ifdef DISTRIBUTED
 #  include <thread>
+#  include <mutex>
+#  include <condition_variable>
 #  include <atomic>
+#  include <exception>
+#  include "Communication/PayloadCompression.h"
+#  include "Communication/AgentsChecksum.h"
 #endif
 
 class AbstractAgent;
@@ -82,12 +89,21 @@ public:
 	/** frees simulation agents */
 	void close(void);
 
+	/** writes this FO's portion of the checkpoint into '<filenamePrefix>_FO<ID>.bin':
+	    the global time, frame counter, agent types, state of the default random generator,
+	    and all its agents (which all must be checkpointable, see AbstractAgent::getCheckpointClassName());
+	    it must be called in between the simulation rounds */
+	void saveCheckpoint(const std::string& filenamePrefix);
+
+	/** re-creates agents from the FO files of the checkpoint, which could have been written
+	    by any number of FOs; this FO adopts agents for which 'agentID % FOsCount +1 == ID',
+	    the agents are created via the AgentsFactory and are started with startNewAgent() */
+	void loadCheckpoint(const std::string& filenamePrefix);
+
 	/** attempts to clean up, if not done earlier */
 	~FrontOfficer(void)
 	{
 #ifdef DISTRIBUTED
-		pthread_cancel(responder.native_handle());
-		responder.join();
 		close_communication();
 #endif
 		DEBUG_REPORT("FrontOfficer #" << ID << " already closed? " << (isProperlyClosedFlag ? "yes":"no"));
@@ -182,6 +198,39 @@ public:
 
 	size_t getSizeOfAABBsList() const;
 
+	/** sets the distance [micrometer] between AABBs of a foreign and of any of
+	    this FO's agents under which the foreign agent's ShadowAgent is fetched
+	    in advance (in one batch) before agents start collecting their external
+	    forces, it should match the distances agents use with getNearbyAABBs();
+	    in the push mode (see SceneControls::Constants::shadowAgentsPushMode),
+	    this is the width of the halo around other FOs' agents */
+	void setShadowAgentsPrefetchDistance(const float maxDist)
+	{ shadowAgentsPrefetchDistance = maxDist; }
+
+	/** limits the memory [bytes] taken by geometries of the ShadowAgents cached
+	    in this FO: once per round (after all agents have collected their external
+	    forces), the least recently used ones are dropped until the budget is met,
+	    and they are fetched again if they are needed later; 0 means no limit,
+	    which is the default */
+	void setShadowAgentsMemoryBudget(const long bytes)
+	{ shadowAgentsMemoryBudget = bytes; }
+
+	/** enables the compact wire format of the AABBs that FOs broadcast to each
+	    other every round: corners are sent as 16-bit multiples of the 'quantum'
+	    [micrometer] relative to the scene offset, rounded outward, so the AABBs
+	    of foreign agents may appear up to one quantum larger; the broadcasts
+	    that don't fit into the 16-bit range fall back to the plain format;
+	    0 disables it, which is the default; no scenario enables it as of now,
+	    the format is exercised by src/tests/CompactAABBs.cpp */
+	void setAABBsWireQuantum(const float quantum)
+	{ aabbsWireQuantum = quantum; }
+
+	/** enables lossless compression of the large payloads (geometries of
+	    ShadowAgents, rendered image slices) that this FO sends, a payload is
+	    compressed only if it pays off given the measured throughput of the link;
+	    receivers recognize compressed payloads on their own */
+	void setPayloadsCompression(const bool state);
+
 	/** returns the state of the 'willRenderNextFrameFlag', that is if the
 	    current simulation round with end up with the call to renderNextFrame() */
 	bool willRenderNextFrame(void) const
@@ -227,6 +276,90 @@ protected:
 	    that are computed elsewhere (managed by foreign FO) */
 	std::map<int,ShadowAgent*> shadowAgents;
 
+	/** deletes the ShadowAgent from this->shadowAgents together with its geometry
+	    (which is owned by the ShadowAgent, unlike it is with the AbstractAgents) */
+	void disposeShadowAgent(ShadowAgent* sa);
+
+	/** bookkeeping of this->shadowAgents for the memory budget: the position in
+	    the shadowAgentsLRU and the (serialized) size of the geometry [bytes] */
+	struct ShadowAgentCacheEntry
+	{
+		std::list<int>::iterator lruPos;
+		long bytes;
+	};
+	std::unordered_map<int,ShadowAgentCacheEntry> shadowAgentsCacheEntries;
+
+	/** IDs of agents in this->shadowAgents, the most recently used first */
+	std::list<int> shadowAgentsLRU;
+
+	/** see setShadowAgentsMemoryBudget() [bytes], and the current usage */
+	long shadowAgentsMemoryBudget = 0;
+	long shadowAgentsCacheBytes = 0;
+
+	/** statistics of the getNearbyAgent() for foreign agents: served from the cache,
+	    fetched on demand, and ShadowAgents dropped due to the memory budget */
+	size_t shadowAgentsCacheHits = 0, shadowAgentsCacheMisses = 0, shadowAgentsCacheEvictions = 0;
+
+	/** marks the agent's ShadowAgent (which must be in this->shadowAgents) as the most
+	    recently used one, and updates its size; call it whenever it is stored or used */
+	void touchShadowAgent(const int agentID);
+
+	/** removes the agent from the bookkeeping (not from this->shadowAgents) */
+	void forgetShadowAgent(const int agentID);
+
+	/** disposes the least recently used ShadowAgents until the memory budget is met,
+	    no ShadowAgent obtained with getNearbyAgent() may be in use at that moment */
+	void evictShadowAgents();
+
+	/** see setShadowAgentsPrefetchDistance() [micrometer] */
+	float shadowAgentsPrefetchDistance = 10.0f;
+
+	/** fetches, in one batch per foreign FO, ShadowAgents of all foreign agents
+	    that are within the shadowAgentsPrefetchDistance from any of this FO's
+	    agents and whose cached copies are outdated or missing, this way the
+	    getNearbyAgent() typically only reads from this->shadowAgents */
+	void prefetchNearbyShadowAgents();
+
+	/** see setAABBsWireQuantum() [micrometer] */
+	float aabbsWireQuantum = 0.0f;
+
+	/** versions of own agents' geometries as they were last pushed to the
+	    particular FO (outer key), the inner map is agentID -> geometry version */
+	std::map<int,std::map<int,int> > pushedShadowAgentsVersions;
+
+	/** determines for every other FO which of own agents are within the halo
+	    distance from its agents and were not yet pushed in their current version,
+	    and exchanges them (all FOs must call this at the same time) */
+	void pushNearbyShadowAgents();
+
+	/** starts the pushNearbyShadowAgents() or the prefetchNearbyShadowAgents(),
+	    in the distributed case in the background so that the agents far from
+	    all foreign agents can collectExtForces() in the meantime */
+	void startNearbyShadowAgentsExchange();
+
+	/** blocks until the exchange started with startNearbyShadowAgentsExchange()
+	    is over (and rethrows its error if any), returns immediately if there's none */
+	void finishNearbyShadowAgentsExchange();
+
+#ifdef DISTRIBUTED
+	/** the long-lived worker that runs the exchange of the nearby ShadowAgents
+	    whenever startNearbyShadowAgentsExchange() asks for it, it is started
+	    with the first exchange and stopped with stopNearbyShadowAgentsExchanges() */
+	std::thread shadowAgentsExchange;
+	void runNearbyShadowAgentsExchanges();
+	void stopNearbyShadowAgentsExchanges();
+
+	/** guards the flags below, and signals their changes */
+	std::mutex shadowAgentsExchangeMutex;
+	std::condition_variable shadowAgentsExchangeSignal;
+	/** set when an exchange is asked for, cleared by the worker when it is over */
+	bool shadowAgentsExchangePending = false;
+	/** set to make the worker leave */
+	bool shadowAgentsExchangeQuit = false;
+	/** the error of the last exchange, if any */
+	std::exception_ptr shadowAgentsExchangeError;
+#endif
+
 	/** a complete map of all agents in the simulation (includes even earlier agents)
 	    and their versions of their geometries that were broadcast the most recently,
 		 this attribute works in conjunction with 'shadowAgents' and getNearbyAgent() */
@@ -241,12 +374,106 @@ protected:
 	    it should be called only from the AABB broadcast receiving methods */
 	void registerThatThisAgentIsAtThisFO(const int agentID, const int FOsID);
 
+#ifdef DISTRIBUTED
+	/** an AABB of a foreign agent as it was last broadcast by its FO */
+	struct ReplicatedAABB
+	{
+		NamedAxisAlignedBoundingBox box;
+		int FOsID;
+		int version;
+	};
+
+	/** persistent replica of AABBs of all agents that are managed by foreign FOs,
+	    it is updated only with the changes (deltas) broadcast by the other FOs
+	    and its content is poured into this->AABBs after every AABBs exchange */
+	std::map<int,ReplicatedAABB> replicatedAABBs;
+
+	/** geometry versions and agent type IDs of this FO's agents as they were
+	    broadcast the most recently, used to determine what has changed since */
+	std::map<int,std::pair<int,size_t> > publishedAABBs;
+
+	/** counter of AABBs exchanges, every AABB_FULL_RESYNC_PERIOD-th one is a full one */
+	int publishedAABBsRoundsCnt = 0;
+
+	/** checksums of all agents of every FO as they were announced (indexed by FO's ID)
+	    in the most recent AABBs exchange, to verify this->replicatedAABBs against */
+	std::vector<AgentsChecksum> announcedChecksums;
+
+	/** reusable buffer for the AABBs in the compact wire format, see setAABBsWireQuantum() */
+	std::vector<char> compactAABBsBuffer;
+
+	/** broadcasts AABBs of own agents that are new or that have changed since
+	    the last broadcast, and IDs of own agents that have ceased to exist;
+	    if 'fullResync' is set, AABBs of all own agents are broadcast instead */
+	void broadcast_AABBsDelta(const bool fullResync);
+
+	/** receives and applies the changes broadcast by the given FO */
+	void respond_AABBsDelta(const int FOsID);
+
+	/** sends geometries (serialized) of the listed own agents to the given FO,
+	    'asGhosts' distinguishes pushed copies from the requested ones; the pushed
+	    ones are only posted (see DistributedCommunicator::postFO()), preceded
+	    by their count, and their buffers must not be reused until the posted
+	    messages are sent */
+	void send_ShadowAgentCopies(const int* agentIDs, const int noOfAgents, const int FOsID, const bool asGhosts);
+
+	/** receives at most 'maxNoOfAgents' geometries from the given FO and stores them,
+	    as ShadowAgents, into this->shadowAgents, returns how many were received;
+	    the pushed copies (asGhosts) are received from whichever FO comes first
+	    ('FOsID' and 'maxNoOfAgents' are ignored, the count comes with them) */
+	int receive_ShadowAgentCopies(const int maxNoOfAgents, const int FOsID, const bool asGhosts);
+
+	/** deserializes the geometry into this->shadowAgents, reusing the existing
+	    ShadowAgent (and its geometry) of the same agent whenever possible,
+	    returns the up-to-date ShadowAgent */
+	ShadowAgent* storeShadowAgentCopy(const int agentID, const size_t agentTypeID,
+	                                  const int geomType, char* geomBuffer);
+
+	/** reusable (grown, never shrunk) per-peer buffers for the headers and serialized
+	    geometries that are sent to the FO given as the key, [0] is for the requested
+	    copies (used by the responder thread), [1] for the pushed ghost copies */
+	std::map<int,std::vector<size_t> > shadowCopiesSendHeaders[2];
+	std::map<int,std::vector<char> >   shadowCopiesSendBuffers[2];
+	/** the counts that precede the pushed copies, per-peer as well */
+	std::map<int,size_t> shadowCopiesSendCounts;
+
+	/** reusable buffers for receiving the headers and serialized geometries,
+	    used only by the main thread */
+	std::vector<size_t> shadowCopiesRecvHeader;
+	std::vector<char>   shadowCopiesRecvBuffer;
+
+	/** decisions and reusable buffers for compressing the serialized geometries,
+	    [0] and [1] are used as with the shadowCopiesSendBuffers (and the packed
+	    ones are per-peer too, for the posted pushes to different FOs) */
+	AdaptiveCompression shadowCopiesCompression[2];
+	std::map<int,std::vector<char> > shadowCopiesPackedBuffers[2];
+	std::vector<char>   shadowCopiesScratchBuffers[2];
+	std::vector<char>   shadowCopiesRecvPacked, shadowCopiesRecvScratch;
+
+	/** how many bytes have been posted with the pushed copies in this round */
+	size_t shadowCopiesPostedBytes = 0;
+
+	/** compresses the serialized geometries for the given FO if enabled and if it pays off,
+	    returns the size of the compressed payload or 0 if it is to be sent as it is; the size
+	    must be announced to the receiver before the payload is sent with sendShadowCopies() */
+	size_t packShadowCopies(const bool asGhosts, char* data, const size_t size, const int FOsID);
+	void sendShadowCopies(const bool asGhosts, char* data, const size_t size, const size_t packedSize,
+	                      const int FOsID);
+
+	/** counterpart of the sendShadowCopies(), the 'packedSize' is the one announced */
+	void receiveShadowCopies(const bool asGhosts, char* data, const size_t size, const size_t packedSize,
+	                         const int FOsID);
+#endif
+
 	/** current global simulation time [min] */
 	float currTime = 0.0f;
 
 	/** counter of exports/snapshots, used to numerate frames and output image files */
 	int frameCnt = 0;
 
+	/** global time [min] of the last checkpoint (or of the start of the simulation) */
+	float lastCheckpointTime = 0.0f;
+
 	/** flag if the renderNextFrame() will be called after this simulation round */
 	bool willRenderNextFrameFlag = false;
 
@@ -285,6 +512,18 @@ protected:
 	void request_closeAgent(const int agentID, const int associatedFO);
 	void request_updateParentalLink(const int childID, const int parentID);
 
+#ifdef DISTRIBUTED
+	/** agents lifecycle events (started, closed agents, parental links) that
+	    happened since they were last sent to the Director, in the order in which
+	    they happened; three ints per event: AGENT_EVENT_*, agent ID, extra param */
+	std::vector<int> agentsEvents;
+
+	/** sends the agentsEvents in one go to the Director, it happens before every
+	    waitHereUntilEveryoneIsHereToo() so that the Director has learned about
+	    all of them before it proceeds */
+	void notify_agentsEvents();
+#endif
+
 	//bool request_willRenderNextFrame();
 
 	void waitFor_publishAgentsAABBs();
@@ -303,6 +542,17 @@ protected:
 	ShadowAgent* request_ShadowAgentCopy(const int agentID, const int FOsID);
 	void respond_ShadowAgentCopy(const int agentID);
 
+	/** batched variant of the request_ShadowAgentCopy(): asks every FO in the map
+	    (key) for ShadowAgents of the listed agents (value) and stores them right
+	    away into this->shadowAgents (replacing any older copies) */
+	void request_ShadowAgentCopies(const std::map<int,std::vector<int> >& fetchTheseIDsFromFOs);
+	void respond_ShadowAgentCopies(const int* agentIDs, const int noOfAgents, const int FOsID);
+
+	/** sends ShadowAgents of the own agents listed in the value of the map
+	    to the FO given in the key, and receives ShadowAgents the other FOs
+	    have decided to push here (stored into this->shadowAgents) */
+	void exchange_ShadowAgentCopies(const std::map<int,std::vector<int> >& pushTheseIDsToFOs);
+
 	void waitFor_renderNextFrame(const int FOsID);
 	void request_renderNextFrame(const int FOsID);
 
@@ -6,23 +6,36 @@
 #include "VectorImg.h"
 
 
-template <typename T>
-void AxisAlignedBoundingBox::adaptImage(i3d::Image3d<T>& img,
-                                        const Vector3d<float>& res,
-                                        const Vector3d<short>& pxFrameWidth) const
+void AxisAlignedBoundingBox::adaptGrid(Vector3d<float>& offset,
+                                       Vector3d<size_t>& size,
+                                       const Vector3d<float>& res,
+                                       const Vector3d<short>& pxFrameWidth) const
 {
 	const Vector3d<float> umFrameWidth( Vector3d<float>().from(pxFrameWidth).elemDivBy(res) );
 
-	Vector3d<float> tmp(minCorner.to<float>());
-	tmp -= umFrameWidth;
-
-	img.SetResolution( i3d::Resolution(res.toI3dVector3d()) );
-	img.SetOffset( tmp.toI3dVector3d() );
+	offset.from(minCorner);
+	offset -= umFrameWidth;
 
+	Vector3d<float> tmp;
 	tmp.from(maxCorner-minCorner);
 	tmp += 2.0f * umFrameWidth;
 	tmp.elemMult(res).elemCeil();
-	img.MakeRoom( tmp.to<size_t>().toI3dVector3d() );
+	size = tmp.to<size_t>();
+}
+
+
+template <typename T>
+void AxisAlignedBoundingBox::adaptImage(i3d::Image3d<T>& img,
+                                        const Vector3d<float>& res,
+                                        const Vector3d<short>& pxFrameWidth) const
+{
+	Vector3d<float> offset;
+	Vector3d<size_t> size;
+	adaptGrid(offset,size, res,pxFrameWidth);
+
+	img.SetResolution( i3d::Resolution(res.toI3dVector3d()) );
+	img.SetOffset( offset.toI3dVector3d() );
+	img.MakeRoom( size.toI3dVector3d() );
 
 	DEBUG_REPORT("from AABB: minCorner=" << minCorner << " um --> maxCorner=" << maxCorner << " um");
 	DEBUG_REPORT(" to image: imgOffset=" << img.GetOffset() << " um, imgSize="
@@ -131,3 +144,13 @@ void AxisAlignedBoundingBox::exportInPixelCoords(const i3d::Image3d<double>& img
 				return NULL;
 		}
 }
+
+/*static*/ Geometry * Geometry::updateOrCreateAndDeserializeFrom(Geometry* geom, int g_type, char * buffer)
+{
+	if (geom != NULL && (int)geom->shapeForm == g_type && geom->canDeserializeFrom(buffer))
+	{
+		geom->deserializeFrom(buffer);
+		return geom;
+	}
+	return createAndDeserializeFrom(g_type, buffer);
+}
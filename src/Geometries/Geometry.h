@@ -54,6 +54,13 @@ public:
 	                const Vector3d<float>& res,                                      //px/um
 	                const Vector3d<short>& pxFrameWidth = Vector3d<short>(2)) const; //px
 
+	/** provides the offset and size of the image that adaptImage() would
+	    create, without creating any image (e.g., to sweep just the grid) */
+	void adaptGrid(Vector3d<float>& offset,                                         //um
+	               Vector3d<size_t>& size,                                          //px
+	               const Vector3d<float>& res,                                      //px/um
+	               const Vector3d<short>& pxFrameWidth = Vector3d<short>(2)) const; //px
+
 	/** exports this AABB as a "sweeping" box that is given
 	    with the output 'minSweep' and 'maxSweep' corners and
 	    that is appropriate for (that is, intersected with)
@@ -216,8 +223,10 @@ protected:
 	    derived class such as Spheres, Mesh, ScalarImg or VectorImg. */
 	Geometry(const ListOfShapeForms _shapeForm) : shapeForm(_shapeForm), AABB() {};
 
-
 public:
+	/** geometries of ShadowAgents are disposed via pointers to this class */
+	virtual ~Geometry() {};
+
 	/** choosen form of shape representation */
 	const ListOfShapeForms shapeForm;
 
@@ -307,9 +316,19 @@ public:
 
 	virtual void serializeTo(char* buffer) const =0;
 	virtual void deserializeFrom(char* buffer) =0;
+
+	/** returns true if this (existing) object can be filled with deserializeFrom()
+	    from the given buffer, that is, without being re-created */
+	virtual bool canDeserializeFrom(char* /*buffer*/) const
+	{ return false; }
 	
 	static Geometry * createAndDeserializeFrom(/*ListOfShapeForms*/ int g_type, char * buffer);
 
+	/** fills the given 'geom' from the buffer in place, if it is possible, and returns
+	    it; otherwise a new geometry is created and returned, the caller then has to
+	    dispose the 'geom' (which may be NULL) */
+	static Geometry * updateOrCreateAndDeserializeFrom(Geometry* geom, /*ListOfShapeForms*/ int g_type, char * buffer);
+
 	// ----------------- support for rasterization -----------------
 	virtual void renderIntoMask(i3d::Image3d<i3d::GRAY16>& mask, const i3d::GRAY16 drawID) const =0;
 };
@@ -3,6 +3,7 @@
 #include "Spheres.h"
 #include "ScalarImg.h"
 #include "util/Serialization.h"
+#include "util/SharedImages.h"
 
 /** calculate min surface distance between myself and some foreign agent */
 void ScalarImg::getDistance(const Geometry& otherGeometry,
@@ -63,7 +64,7 @@ void ScalarImg::getDistanceToSpheres(const class Spheres* otherSpheres,
 
 	//the sweeping box in pixels, in coordinates of this distImg
 	Vector3d<size_t> curPos, minSweepPX,maxSweepPX;
-	sweepBox.exportInPixelCoords(distImg, minSweepPX,maxSweepPX);
+	sweepBox.exportInPixelCoords(*distImg, minSweepPX,maxSweepPX);
 
 	//(squared) voxel's volume half-diagonal vector and its length
 	//(for detection of voxels that coincide with sphere's surface)
@@ -116,7 +117,7 @@ void ScalarImg::getDistanceToSpheres(const class Spheres* otherSpheres,
 				{
 					//hooray, a voxel whose volume is intersecting with i-th sphere's surface
 					//let's inspect the distImg at this position
-					const G_FLOAT dist = distImg.GetVoxel(curPos.x,curPos.y,curPos.z);
+					const G_FLOAT dist = distImg->GetVoxel(curPos.x,curPos.y,curPos.z);
 
 					if (dist < distances[i])
 					{
@@ -137,16 +138,16 @@ void ScalarImg::getDistanceToSpheres(const class Spheres* otherSpheres,
 		Vector3d<G_FLOAT> grad;
 
 		//default value at the coinciding voxel to be used whenever we cannot retrieve proper value
-		const G_FLOAT defValue = distImg.GetVoxel(hints[i].x,hints[i].y,hints[i].z);
+		const G_FLOAT defValue = distImg->GetVoxel(hints[i].x,hints[i].y,hints[i].z);
 
 		//distance between voxels that occur in the difference calculation
 		char span = 2;
-		if (hints[i].x+1 < distImg.GetSizeX())
-			grad.x  = distImg.GetVoxel(hints[i].x+1,hints[i].y,hints[i].z);
+		if (hints[i].x+1 < distImg->GetSizeX())
+			grad.x  = distImg->GetVoxel(hints[i].x+1,hints[i].y,hints[i].z);
 		else
 			grad.x  = defValue, span--;
 		if (hints[i].x > 0)
-			grad.x -= distImg.GetVoxel(hints[i].x-1,hints[i].y,hints[i].z);
+			grad.x -= distImg->GetVoxel(hints[i].x-1,hints[i].y,hints[i].z);
 		else
 			grad.x -= defValue, span--;
 		grad.x *= (float)(3-span); //missing /2.0
@@ -154,23 +155,23 @@ void ScalarImg::getDistanceToSpheres(const class Spheres* otherSpheres,
 		//    and leaves it at zero when GetSizeX() == 1 because grad.x == defValue - defValue
 
 		span = 2;
-		if (hints[i].y+1 < distImg.GetSizeY())
-			grad.y  = distImg.GetVoxel(hints[i].x,hints[i].y+1,hints[i].z);
+		if (hints[i].y+1 < distImg->GetSizeY())
+			grad.y  = distImg->GetVoxel(hints[i].x,hints[i].y+1,hints[i].z);
 		else
 			grad.y  = defValue, span--;
 		if (hints[i].y > 0)
-			grad.y -= distImg.GetVoxel(hints[i].x,hints[i].y-1,hints[i].z);
+			grad.y -= distImg->GetVoxel(hints[i].x,hints[i].y-1,hints[i].z);
 		else
 			grad.y -= defValue, span--;
 		grad.y *= (float)(3-span); //missing /2.0
 
 		span = 2;
-		if (hints[i].z+1 < distImg.GetSizeZ())
-			grad.z  = distImg.GetVoxel(hints[i].x,hints[i].y,hints[i].z+1);
+		if (hints[i].z+1 < distImg->GetSizeZ())
+			grad.z  = distImg->GetVoxel(hints[i].x,hints[i].y,hints[i].z+1);
 		else
 			grad.z  = defValue, span--;
 		if (hints[i].z > 0)
-			grad.z -= distImg.GetVoxel(hints[i].x,hints[i].y,hints[i].z-1);
+			grad.z -= distImg->GetVoxel(hints[i].x,hints[i].y,hints[i].z-1);
 		else
 			grad.z -= defValue, span--;
 		grad.z *= (float)(3-span); //missing /2.0
@@ -191,7 +192,7 @@ void ScalarImg::getDistanceToSpheres(const class Spheres* otherSpheres,
 		//this is from ScalarImg perspective (local = ScalarImg, other = Sphere),
 		//it reports index of the relevant foreign sphere
 		l.emplace_back( surfPoint+grad,surfPoint,
-		  distances[i], (signed)distImg.GetIndex(hints[i].x,hints[i].y,hints[i].z),i );
+		  distances[i], (signed)distImg->GetIndex(hints[i].x,hints[i].y,hints[i].z),i );
 	}
 
 	delete[] distances;
@@ -213,10 +214,10 @@ void ScalarImg::updateThisAABB(AxisAlignedBoundingBox& AABB) const
 		const Vector3d<G_FLOAT> oneVxSize( Vector3d<G_FLOAT>(1).elemDivBy(distImgRes) );
 
 		Vector3d<size_t> pxPos;
-		const float* f = distImg.GetFirstVoxelAddr();
-		for (pxPos.z = 0; pxPos.z < distImg.GetSizeZ(); ++pxPos.z)
-		for (pxPos.y = 0; pxPos.y < distImg.GetSizeY(); ++pxPos.y)
-		for (pxPos.x = 0; pxPos.x < distImg.GetSizeX(); ++pxPos.x)
+		const float* f = distImg->GetFirstVoxelAddr();
+		for (pxPos.z = 0; pxPos.z < distImg->GetSizeZ(); ++pxPos.z)
+		for (pxPos.y = 0; pxPos.y < distImg->GetSizeY(); ++pxPos.y)
+		for (pxPos.x = 0; pxPos.x < distImg->GetSizeX(); ++pxPos.x)
 		{
 			if (*f < 0)
 			{
@@ -246,14 +247,16 @@ void ScalarImg::updateThisAABB(AxisAlignedBoundingBox& AABB) const
 template <class MT>
 void ScalarImg::updateWithNewMask(const i3d::Image3d<MT>& _mask)
 {
-	//allocates the distance image, voxel values are not initiated
-	distImg.CopyMetaData(_mask);
+	//allocates the distance image (unless we can rewrite the current one),
+	//voxel values are not initiated
+	SharedImages<float>::makeWritable(distImg, distImgPooledHash);
+	distImg->CopyMetaData(_mask);
 	updateDistImgResOffFarEnd();
 
 	//running pointers (dimension independent code)
 	const MT* m = _mask.GetFirstVoxelAddr();
-	float*    f = distImg.GetFirstVoxelAddr();
-	float* const fE = f + distImg.GetImageSize();
+	float*    f = distImg->GetFirstVoxelAddr();
+	float* const fE = f + distImg->GetImageSize();
 
 	//do DT inside the mask?
 	if (model == GradIN_GradOUT || model == GradIN_ZeroOUT)
@@ -270,12 +273,12 @@ void ScalarImg::updateWithNewMask(const i3d::Image3d<MT>& _mask)
 	}
 
 	//distance _transform_ non-zero part
-	i3d::FastSaito(distImg, 1.0f, true);
+	i3d::FastSaito(*distImg, 1.0f, true);
 
 	//if the "inside" was DT'ed, we need to "inverse" the distances
 	if (model == GradIN_GradOUT || model == GradIN_ZeroOUT)
 	{
-		f = distImg.GetFirstVoxelAddr();
+		f = distImg->GetFirstVoxelAddr();
 		while (f != fE)
 			*f++ *= -1.0f;
 	}
@@ -299,7 +302,7 @@ void ScalarImg::updateWithNewMask(const i3d::Image3d<MT>& _mask)
 		i3d::FastSaito(dtImg, 1.0f, true);
 
 		//now copy non-zero values from dtImg into zero values of distImg
-		f = distImg.GetFirstVoxelAddr();
+		f = distImg->GetFirstVoxelAddr();
 		ff = dtImg.GetFirstVoxelAddr();
 		while (f != fE)
 		{
@@ -307,13 +310,15 @@ void ScalarImg::updateWithNewMask(const i3d::Image3d<MT>& _mask)
 			++f; ++ff;
 		}
 	}
+
+	distImg = SharedImages<float>::share(distImg, distImgPooledHash);
 }
 
 
 // ----------------- support for serialization and deserealization -----------------
 long ScalarImg::getSizeInBytes() const
 {
-	long size = Serialization::getSizeInBytes(distImg);
+	long size = Serialization::getSizeInBytes(*distImg);
 	return size + 2*sizeof(int);
 }
 
@@ -321,7 +326,7 @@ long ScalarImg::getSizeInBytes() const
 void ScalarImg::serializeTo(char* buffer) const
 {
 	long off = Serialization::toBuffer((int)model,buffer);
-	off += Serialization::toBuffer(distImg,buffer+off);
+	off += Serialization::toBuffer(*distImg,buffer+off);
 
 	Serialization::toBuffer(version, buffer+off);
 }
@@ -337,7 +342,14 @@ void ScalarImg::deserializeFrom(char* buffer)
 			<< this->model << " with model " << (DistanceModel)mmodel
 			<< " from the buffer" );
 
-	off += Deserialization::fromBuffer(buffer+off,distImg);
+	SharedImages<float>::makeWritable(distImg, distImgPooledHash);
+	off += Deserialization::fromBuffer(buffer+off,*distImg);
+#ifdef DISTRIBUTED_INPROCESS
+	//the received copies are worth pooling only if other FOs of
+	//this process may receive the same ones, otherwise the hashing
+	//would just slow down this (frequent) receiving of ShadowAgents
+	distImg = SharedImages<float>::share(distImg, distImgPooledHash);
+#endif
 	updateDistImgResOffFarEnd();
 
 	//update Geometry attribs:
@@ -1,6 +1,8 @@
 #ifndef GEOMETRY_SCALARIMG_H
 #define GEOMETRY_SCALARIMG_H
 
+#include <cstdint>
+#include <memory>
 #include <i3d/image3d.h>
 #include "Geometry.h"
 class Spheres;
@@ -41,6 +43,11 @@ class Spheres;
  * inherits from this one, overrides the getDistance() method, and
  * declares shapeForm = Geometry::ListOfShapeForms::undefGeometry.
  *
+ * The distance image is never modified once it is computed, copies of this
+ * geometry therefore share it, and identical images are shared even among
+ * unrelated ScalarImgs (e.g. built from the same mask, or, in the in-process
+ * build, shadow copies of the same agent held by several FOs), see SharedImages.
+ *
  * Author: Vladimir Ulman, 2018
  */
 class ScalarImg: public Geometry
@@ -56,8 +63,12 @@ public:
 
 private:
 	/** Image with precomputed distances, it is of the same offset, size, resolution
-	    (see docs of class ScalarImg) as the one given during construction of this object */
-	i3d::Image3d<float> distImg;
+	    (see docs of class ScalarImg) as the one given during construction of this object;
+	    the image is shared and immutable, see SharedImages::makeWritable() */
+	std::shared_ptr< i3d::Image3d<float> > distImg;
+
+	/** the hash under which the distImg is in the SharedImages pool, 0 if it is not there */
+	uint64_t distImgPooledHash = 0;
 
 	/** (cached) resolution of the distImg [pixels per micrometer] */
 	Vector3d<G_FLOAT> distImgRes;
@@ -90,7 +101,7 @@ public:
 	/** just for debug purposes: save the distance image to a filename */
 	void saveDistImg(const char* filename)
 	{
-		distImg.SaveImage(filename);
+		distImg->SaveImage(filename);
 	}
 
 
@@ -139,7 +150,7 @@ public:
 	// ------------- get/set methods -------------
 	const i3d::Image3d<float>& getDistImg(void) const
 	{
-		return distImg;
+		return *distImg;
 	}
 
 	const Vector3d<G_FLOAT>& getDistImgRes(void) const
@@ -172,13 +183,13 @@ private:
 	    to the current ScalarImg::distImg */
 	void updateDistImgResOffFarEnd(void)
 	{
-		distImgRes.fromI3dVector3d( distImg.GetResolution().GetRes() );
+		distImgRes.fromI3dVector3d( distImg->GetResolution().GetRes() );
 
 		//"min" corner
-		distImgOff.fromI3dVector3d( distImg.GetOffset() );
+		distImgOff.fromI3dVector3d( distImg->GetOffset() );
 
 		//this mask image's "max" corner in micrometers
-		distImgFarEnd.from( Vector3d<size_t>(distImg.GetSize()) )
+		distImgFarEnd.from( Vector3d<size_t>(distImg->GetSize()) )
 		             .toMicrons(distImgRes,distImgOff);
 	}
 
@@ -189,6 +200,9 @@ public:
 	void serializeTo(char* buffer) const override;
 	void deserializeFrom(char* buffer) override;
 
+	bool canDeserializeFrom(char* buffer) const override
+	{ return *((int*)buffer) == (int)model; }
+
 	static ScalarImg* createAndDeserializeFrom(char* buffer);
 
 	// ----------------- support for rasterization -----------------
@@ -132,12 +132,9 @@ void Spheres::serializeTo(char* buffer) const
 	//store noOfSpheres
 	long off = Serialization::toBuffer(noOfSpheres, buffer);
 
-	//store individual spheres
-	for (int i=0; i < noOfSpheres; ++i)
-	{
-		off += Serialization::toBuffer(centres[i], buffer+off);
-		off += Serialization::toBuffer(radii[i],   buffer+off);
-	}
+	//store individual spheres, array by array
+	off += Serialization::toBuffer(centres, noOfSpheres, buffer+off);
+	off += Serialization::toBuffer(radii,   noOfSpheres, buffer+off);
 
 	Serialization::toBuffer(version, buffer+off);
 }
@@ -152,12 +149,9 @@ void Spheres::deserializeFrom(char* buffer)
 			<< noOfSpheres << " spheres from the buffer with "
 			<< recv_noOfSpheres << " spheres" );
 
-	//read and setup individual spheres
-	for (int i=0; i < noOfSpheres; ++i)
-	{
-		off += Deserialization::fromBuffer(buffer+off, centres[i]);
-		off += Deserialization::fromBuffer(buffer+off, radii[i]);
-	}
+	//read and setup individual spheres, directly into the existing arrays
+	off += Deserialization::fromBuffer(buffer+off, centres, noOfSpheres);
+	off += Deserialization::fromBuffer(buffer+off, radii,   noOfSpheres);
 
 	//update Geometry attribs:
 	Deserialization::fromBuffer(buffer+off, version);
@@ -168,6 +168,9 @@ public:
 	void serializeTo(char* buffer) const override;
 	void deserializeFrom(char* buffer) override;
 
+	bool canDeserializeFrom(char* buffer) const override
+	{ return *((int*)buffer) == noOfSpheres; }
+
 	static Spheres* createAndDeserializeFrom(char* buffer);
 
 	// ----------------- support for rasterization -----------------
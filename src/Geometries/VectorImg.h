@@ -248,6 +248,9 @@ public:
 	void serializeTo(char* buffer) const override;
 	void deserializeFrom(char* buffer) override;
 
+	bool canDeserializeFrom(char* buffer) const override
+	{ return *((int*)buffer) == (int)policy; }
+
 	static VectorImg* createAndDeserializeFrom(char* buffer);
 
 	// ----------------- support for rasterization -----------------
@@ -3,6 +3,7 @@
 
 #include "../../util/Vector3d.h"
 #include <i3d/image3d.h>
+#include <cstring>
 
 /**
  * This is a container to represent a methods that convert various
@@ -79,6 +80,26 @@ public:
 		return 3*sizeof(FT);
 	}
 
+	// -------------- arrays --------------
+	/** stores the whole array in one go, the buffer ends up with the
+	    same layout as if toBuffer() were called item by item */
+	template <typename FT>
+	static long toBuffer(const Vector3d<FT>* vectors, const int count, char* buffer)
+	{
+		static_assert(sizeof(Vector3d<FT>) == 3*sizeof(FT), "Vector3d must be plain three FTs");
+		const long size = (long)count * (long)sizeof(Vector3d<FT>);
+		if (size > 0) std::memcpy(buffer, vectors, (size_t)size);
+		return size;
+	}
+
+	template <typename FT>
+	static long toBuffer(const FT* numbers, const int count, char* buffer)
+	{
+		const long size = (long)count * (long)sizeof(FT);
+		if (size > 0) std::memcpy(buffer, numbers, (size_t)size);
+		return size;
+	}
+
 	// -------------- images --------------
 	template <typename VT>
 	static long toBuffer(const i3d::Image3d<VT>& image, char* buffer)
@@ -98,14 +119,7 @@ public:
 		off += toBuffer(vecFloat.fromI3dVector3d(image.GetResolution().GetRes()), buffer+off);
 		off += toBuffer(vecSizet.fromScalars( image.GetSizeX(),image.GetSizeY(),image.GetSizeZ() ), buffer+off);
 
-		VT* bufferView = (VT*)(buffer+off);
-		const VT* voxel = image.GetFirstVoxelAddr();
-		for (size_t i=0; i < image.GetImageSize(); ++i)
-		{
-			*bufferView = *voxel;
-			++bufferView;
-			++voxel;
-		}
+		std::memcpy(buffer+off, image.GetFirstVoxelAddr(), image.GetImageSize()*sizeof(VT));
 
 		return off + (image.GetImageSize()*sizeof(VT));
 	}
@@ -182,6 +196,25 @@ public:
 		return 3*sizeof(FT);
 	}
 
+	// -------------- arrays --------------
+	/** fills the whole (existing) array in one go, see Serialization::toBuffer() */
+	template <typename FT>
+	static long fromBuffer(char* buffer, Vector3d<FT>* vectors, const int count)
+	{
+		static_assert(sizeof(Vector3d<FT>) == 3*sizeof(FT), "Vector3d must be plain three FTs");
+		const long size = (long)count * (long)sizeof(Vector3d<FT>);
+		if (size > 0) std::memcpy((void*)vectors, buffer, (size_t)size);
+		return size;
+	}
+
+	template <typename FT>
+	static long fromBuffer(char* buffer, FT* numbers, const int count)
+	{
+		const long size = (long)count * (long)sizeof(FT);
+		if (size > 0) std::memcpy(numbers, buffer, (size_t)size);
+		return size;
+	}
+
 	// -------------- images --------------
 	template <typename VT>
 	static long fromBuffer(char* buffer, i3d::Image3d<VT>& image)
@@ -212,14 +245,7 @@ public:
 		off += fromBuffer(buffer+off, vecSizet);
 		image.MakeRoom(vecSizet.x,vecSizet.y,vecSizet.z);
 
-		VT* bufferView = (VT*)(buffer+off);
-		VT* voxel = image.GetFirstVoxelAddr();
-		for (size_t i=0; i < image.GetImageSize(); ++i)
-		{
-			*voxel = *bufferView;
-			++bufferView;
-			++voxel;
-		}
+		std::memcpy(image.GetFirstVoxelAddr(), buffer+off, image.GetImageSize()*sizeof(VT));
 
 		return off + (image.GetImageSize()*sizeof(VT));
 	}
@@ -0,0 +1,150 @@
+#ifndef GEOMETRY_UTIL_SHAREDIMAGES_H
+#define GEOMETRY_UTIL_SHAREDIMAGES_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <i3d/image3d.h>
+
+/**
+ * Process-wide pool of immutable images that geometries can share instead of
+ * holding each its own copy of the same content, e.g., when several shadow
+ * copies of the same (static) agent live in FOs that run as threads of one
+ * process, or when several agents are created from the same mask image.
+ *
+ * Images are reference-counted (std::shared_ptr) and copy-on-write: an image
+ * obtained via share() must not be modified directly, the holder first calls
+ * makeWritable() which either withdraws the image from the pool (if no one
+ * else holds it) or replaces it with a fresh (empty) one. The pool itself
+ * holds no references, images vanish from it once their last holder is gone.
+ *
+ * Pooling costs a pass over the voxels (the hash) plus a comparison on a hit,
+ * the holder therefore keeps the hash along with the image so that it need
+ * not be computed again when the image is to be withdrawn.
+ */
+template <typename VT>
+class SharedImages
+{
+public:
+	typedef i3d::Image3d<VT> Image;
+	typedef std::shared_ptr<Image> ImagePtr;
+
+	/** returns an already pooled image of the same content as the 'img' (and
+	    'img' can be released), or pools the 'img' itself and returns it; the
+	    'pooledHash' is set to identify the returned image in the pool */
+	static ImagePtr share(const ImagePtr& img, uint64_t& pooledHash)
+	{
+		const uint64_t h = hash(*img);
+		pooledHash = h;
+
+		Pool& p = pool();
+		std::lock_guard<std::mutex> lock(p.lock);
+
+		auto range = p.images.equal_range(h);
+		auto it = range.first;
+		while (it != range.second)
+		{
+			ImagePtr candidate = it->second.lock();
+			if (!candidate)
+			{
+				it = p.images.erase(it);
+				continue;
+			}
+			if (candidate == img || isEqual(*candidate,*img)) return candidate;
+			++it;
+		}
+
+		p.images.emplace(h, std::weak_ptr<Image>(img));
+		return img;
+	}
+
+	/** makes sure the 'img' is held exclusively by the caller and is not in the
+	    pool anymore, so that it can be modified; if it is held also by someone
+	    else, the 'img' is replaced with a fresh image (the content is not copied
+	    as the callers typically overwrite it completely anyway); the 'pooledHash'
+	    is the one given by share() for the 'img', or 0 if it was not pooled,
+	    and it is reset to 0 */
+	static void makeWritable(ImagePtr& img, uint64_t& pooledHash)
+	{
+		const uint64_t h = pooledHash;
+		pooledHash = 0;
+
+		//held also by someone else? no need to look into the pool then
+		if (!img || img.use_count() > 1)
+		{
+			img = std::make_shared<Image>();
+			return;
+		}
+
+		//not in the pool, no one else can obtain it
+		if (h == 0) return;
+
+		Pool& p = pool();
+		std::lock_guard<std::mutex> lock(p.lock);
+
+		//the pool hands out images only under the lock, it could
+		//have done it before we've got the lock, but not anymore
+		if (img.use_count() > 1)
+		{
+			img = std::make_shared<Image>();
+			return;
+		}
+
+		auto range = p.images.equal_range(h);
+		auto it = range.first;
+		while (it != range.second)
+		{
+			ImagePtr candidate = it->second.lock();
+			if (!candidate || candidate == img) it = p.images.erase(it);
+			else ++it;
+		}
+	}
+
+private:
+	struct Pool
+	{
+		std::mutex lock;
+		std::unordered_multimap<uint64_t, std::weak_ptr<Image> > images;
+	};
+
+	static Pool& pool()
+	{
+		static Pool p;
+		return p;
+	}
+
+	static bool isEqual(const Image& a, const Image& b)
+	{
+		return a.GetSize() == b.GetSize()
+		    && a.GetOffset() == b.GetOffset()
+		    && a.GetResolution().GetRes() == b.GetResolution().GetRes()
+		    && std::memcmp(a.GetFirstVoxelAddr(), b.GetFirstVoxelAddr(), a.GetImageSize()*sizeof(VT)) == 0;
+	}
+
+	/** FNV-1a over the image geometry and the voxels (processed in 8-byte words),
+	    never 0 (which is reserved for images that are not pooled) */
+	static uint64_t hash(const Image& img)
+	{
+		uint64_t h = 14695981039346656037ull;
+		auto mix = [&h](const uint64_t v) { h = (h ^ v) * 1099511628211ull; };
+
+		mix(img.GetSizeX()); mix(img.GetSizeY()); mix(img.GetSizeZ());
+
+		const char* const bytes = (const char*)img.GetFirstVoxelAddr();
+		const size_t size = img.GetImageSize()*sizeof(VT);
+		uint64_t w;
+		size_t i = 0;
+		for (; i+8 <= size; i += 8)
+		{
+			std::memcpy(&w, bytes+i, 8);
+			mix(w);
+		}
+		w = 0;
+		std::memcpy(&w, bytes+i, size-i);
+		mix(w);
+		return h != 0 ? h : 1;
+	}
+};
+#endif
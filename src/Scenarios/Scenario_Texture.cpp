@@ -4,6 +4,7 @@
 #include "common/Scenarios.h"
 #include "../Agents/NucleusAgent.h"
 #include "../Agents/util/Texture.h"
+#include "../Agents/util/AgentsFactory.h"
 #include "../util/texture/texture.h"
 
 class myTexturedNucleus: public NucleusAgent, Texture
@@ -27,8 +28,29 @@ public:
 	{
 		renderIntoPhantom(phantom);
 	}
+
+	const char* getCheckpointClassName(void) const override
+	{ return "myTexturedNucleus"; }
+
+	void saveCheckpoint(CheckpointWriter& cp) const override
+	{
+		NucleusAgent::saveCheckpoint(cp);
+		saveTextureCheckpoint(cp);
+	}
+
+	void loadCheckpoint(CheckpointReader& cp) override
+	{
+		NucleusAgent::loadCheckpoint(cp);
+		loadTextureCheckpoint(cp);
+	}
 };
 
+static AgentsFactory::Registration myTexturedNucleusRegistration("myTexturedNucleus",
+	[](const int ID, const std::string& type, const Geometry& geom, const float currTime, const float incrTime)
+	{
+		return new myTexturedNucleus(ID,type, AgentsFactory::expectGeometry<Spheres>(geom,ID), currTime,incrTime);
+	});
+
 
 //==========================================================================
 void Scenario_withTexture::initializeAgents(FrontOfficer* fo,int p,int)
@@ -70,8 +70,10 @@ public:
 	/// internal affairs: flag that the agent should move
 	void advanceAndBuildIntForces(const float)
 	{
-		//random duration (in full 2-10 seconds) pause here to pretend "some work"
-		const int waitingTime = (int)GetRandomUniform(0,20);
+		//random duration (in full 2-10 seconds) pause here to pretend "some work",
+		//the same in every run regardless of how the agents are spread over the FOs
+		rndStream rnd = getRandomStream(0);
+		const int waitingTime = (int)GetRandomUniform(0,20, rnd);
 		REPORT(IDSIGN << "pretends work that would last for " << waitingTime << " milisecond(s)");
 		std::this_thread::sleep_for(std::chrono::milliseconds( (long long)waitingTime ));
 
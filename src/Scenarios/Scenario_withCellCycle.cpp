@@ -3,6 +3,7 @@
 #include "../Geometries/Spheres.h"
 #include "../Agents/NucleusAgent.h"
 #include "../Agents/util/CellCycle.h"
+#include "../Agents/util/AgentsFactory.h"
 #include "common/Scenarios.h"
 
 
@@ -25,6 +26,21 @@ public:
 		triggerCycleMethods(gTime);
 	}
 
+	const char* getCheckpointClassName(void) const override
+	{ return "myNucleusC"; }
+
+	void saveCheckpoint(CheckpointWriter& cp) const override
+	{
+		NucleusAgent::saveCheckpoint(cp);
+		saveCellCycleCheckpoint(cp);
+	}
+
+	void loadCheckpoint(CheckpointReader& cp) override
+	{
+		NucleusAgent::loadCheckpoint(cp);
+		loadCellCycleCheckpoint(cp);
+	}
+
 	//this is how you can override lenghts of the cell phases
 	void determinePhaseDurations(void) override
 	{
@@ -72,6 +88,12 @@ public:
 	void closeCytokinesis(void) override { REPORT("do some work"); }
 };
 
+static AgentsFactory::Registration myNucleusCRegistration("myNucleusC",
+	[](const int ID, const std::string& type, const Geometry& geom, const float currTime, const float incrTime)
+	{
+		return new myNucleusC(ID,type, AgentsFactory::expectGeometry<Spheres>(geom,ID), currTime,incrTime);
+	});
+
 
 //==========================================================================
 void Scenario_withCellCycle::initializeAgents(FrontOfficer* fo,int p,int)
@@ -7,10 +7,23 @@ SceneControls DefaultSceneControls;
   #include "../../util/synthoscopy/finalpreview.h"
 #elif defined ENABLE_FILOGEN_PHASEIIandIII
   #include "../../util/synthoscopy/FiloGen_VM.h"
+  #include "../../util/synthoscopy/GaussIIR.h"
+  #include "../../util/synthoscopy/parallel.h"
 #endif
 #include <i3d/filters.h>
 
 
+const char* Scenario::getRestartCheckpoint() const
+{
+	static const std::string restartSwitch("-restart");
+
+	//locate the switch string, and return the parameter that follows it
+	int argPos = 1;
+	while (argPos < argc && restartSwitch != argv[argPos]) ++argPos;
+	return argPos+1 < argc ? argv[argPos+1] : NULL;
+}
+
+
 void Scenario::initializePhaseIIandIII()
 {
 	DEBUG_REPORT("This scenario is using the default initialization routine.");
@@ -47,7 +60,7 @@ void Scenario::doPhaseIIandIII()
 {
 #if defined ENABLE_MITOGEN_FINALPREVIEW
 	REPORT("using default MitoGen synthoscopy");
-	mitogen::PrepareFinalPreviewImage(params.imgPhantom,params.imgFinal);
+	mitogen::PrepareFinalPreviewImage(params.imgPhantom,params.imgFinal,imgFinalFrameNo);
 
 #elif defined ENABLE_FILOGEN_PHASEIIandIII
 	REPORT("using default FiloGen synthoscopy");
@@ -65,14 +78,16 @@ void Scenario::doPhaseIIandIII()
 			<< xySigma * params.imgPhantom.GetResolution().GetX() << " x "
 			<< xySigma * params.imgPhantom.GetResolution().GetY() << " x "
 			<<  zSigma * params.imgPhantom.GetResolution().GetZ() << " pixels");
-		i3d::GaussIIR<float>(params.imgPhantom,
+		ParallelGaussIIR(params.imgPhantom,
 			xySigma * params.imgPhantom.GetResolution().GetX(),
 			xySigma * params.imgPhantom.GetResolution().GetY(),
-			 zSigma * params.imgPhantom.GetResolution().GetZ());
+			 zSigma * params.imgPhantom.GetResolution().GetZ(),
+			getSynthoscopyThreads());
 	}
 	//
 	// phase III
-	filogen::PhaseIII(params.imgPhantom, params.imgFinal);
+	filogen::PhaseIII(params.imgPhantom, params.imgFinal, imgFinalFrameNo, params.constants.backgroundDriftFrames,
+		params.imagesSaving_isEnabledForImgMask() ? &params.imgMask : NULL, &imgFinalSNR);
 
 #else
 	REPORT("WARNING: Empty function, no synthoscopy is going on.");
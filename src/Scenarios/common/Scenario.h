@@ -1,12 +1,14 @@
 #ifndef SCENARIO_H
 #define SCENARIO_H
 
+#include <cstdint>
 #include <map>
 #include <set>
 #include <TransferImage.h>
 #include <i3d/image3d.h>
 #include "../../util/Vector3d.h"
 #include "../../util/report.h"
+#include "../../util/synthoscopy/SNR.h"
 #include "../../DisplayUnits/BroadcasterDisplayUnit.h"
 
 //instead of the #include statement, the FrontOfficer type is only declared to exists,
@@ -107,6 +109,34 @@ public:
 			 should be multiple of incrTime to obtain regular sampling */
 		float expoTime = 0.5f;
 
+		/** seed of the counter-based random streams (see rndStream and
+			 AbstractAgent::getRandomStream()), runs with the same seed draw the same
+			 numbers regardless of the number of FOs and of the order of the agents */
+		uint64_t randomSeed = 0;
+
+		/** switches between the pull mode (false), in which every FO fetches
+		    the ShadowAgents it needs from their owners, and the push mode (true), in which
+		    owners send geometries of their agents that have changed to every FO that has
+		    an agent within the halo distance (see FrontOfficer::setShadowAgentsPrefetchDistance())
+		    of them; in the push mode, getNearbyAgent() does not need to contact anyone
+		    for agents within the halo distance (agents beyond it are still fetched on
+		    demand, blocking, from their owners); it is a constant so that all FOs
+		    are in the same mode, they would otherwise wait for each other forever */
+		bool shadowAgentsPushMode = false;
+
+		/** save the complete simulation state (a checkpoint) always after this amount
+			 of global time, [min]; zero disables the checkpointing */
+		float checkpointTime = 0.0f;
+
+		/** file name prefix of the checkpoints: the Direktor writes '<prefix>_Direktor.bin'
+		    and every FO writes '<prefix>_FO<ID>.bin', every new checkpoint overwrites the previous one */
+		const char* checkpoint_filenamePrefix = "checkpoint";
+
+		/** synthoscopy: over how many output images the non-specific background
+		    crossfades into a new one (and that into another...); zero keeps
+		    the same background for all images */
+		int backgroundDriftFrames = 0;
+
 		/** output filename pattern in the printf() notation
 		    that includes exactly one '%u' parameter: instance masks */
 		const char* imgMask_filenameTemplate = "mask%03u.tif";
@@ -421,6 +451,12 @@ public:
 		this->argv = argv;
 	}
 
+	/** returns the file name prefix of the checkpoint given on the command line
+	    via the "-restart prefix" switch, the simulation is then restarted from
+	    this checkpoint and the initializeAgents() is not called at all;
+	    returns NULL if no restart was requested */
+	const char* getRestartCheckpoint() const;
+
 	/** provides (to the outside world) only a read-only look into
 	    the current state of this scenario's controls */
 	const SceneControls& seeCurrentControls() const
@@ -481,6 +517,18 @@ public:
 	    because this one is used for computation of the SNR. */
 	virtual void doPhaseIIandIII();
 
+	/** The SNR of the params.imgFinal if it was computed already within the
+	    doPhaseIIandIII() (e.g., along the noise generation), in which case the
+	    Direktor does not scan the final image again to compute it. It is cleared
+	    before every doPhaseIIandIII(). */
+	mitogen::SNRstats imgFinalSNR;
+
+	/** The index of the frame whose params.imgFinal the doPhaseIIandIII() is
+	    producing, it keys the random streams of the synthoscopy so that the frame
+	    looks the same no matter what was rendered before it (e.g., after a restart
+	    from a checkpoint). It is set before every doPhaseIIandIII(). */
+	int imgFinalFrameNo = 0;
+
 private:
 	/** Context in which this particular scenario object is executed. It is actually
 	    merely a symbolic value that shall be positive whenever this object is living
@@ -66,6 +66,7 @@ void Scenario_PerlinShowCase::initializeAgents(FrontOfficer*,int p,int)
 			if (argc == 3)
 			{
 				doPhaseIIandIII();
+				++imgFinalFrameNo; //every image gets its own noise
 				sprintf(fn,"PerlinFinalPreview_%02.2f_%02.2f_%02.2f_%d.ics",var,alpha,beta,n);
 				REPORT("Saving Perlin final image: " << fn);
 				params.imgFinal.SaveImage(fn);
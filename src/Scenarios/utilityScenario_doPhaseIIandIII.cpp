@@ -63,6 +63,7 @@ void Scenario_phaseIIandIII::initializeAgents(FrontOfficer*,int p,int)
 			params.imgFinal.CopyMetaData(params.imgPhantom);
 
 			//populate and save it...
+			imgFinalFrameNo = frameCnt;
 			doPhaseIIandIII();
 			sprintf(fn,params.constants.imgFinal_filenameTemplate,frameCnt);
 			params.imgFinal.SaveImage(fn);
@@ -6,6 +6,12 @@
 #include "Scenarios/common/Scenarios.h"
 #include "Director.h"
 #include "FrontOfficer.h"
+#ifdef DISTRIBUTED_INPROCESS
+#  include <cstdlib>
+#  include <thread>
+#  include <vector>
+#  include "Communication/InProcessCommunicator.h"
+#endif
 
 #ifdef DISTRIBUTED
 	#define REPORT_EXCEPTION(x) \
@@ -18,6 +24,55 @@
 		std::cout << x << "\n\n";
 #endif
 
+#ifdef DISTRIBUTED_INPROCESS
+/** the in-process FOs are threads, they cannot return their exceptions
+    to the main() and so they have to report them themselves; the FO's
+    broadcast_throwException() then terminates the whole process */
+void reportFrontOfficerException(FrontOfficer* fo)
+{
+	Director* d = NULL;
+	try { throw; }
+	catch (const char* e)
+	{
+		REPORT_EXCEPTION("Got this message: " << e)
+	}
+	catch (std::string& e)
+	{
+		REPORT_EXCEPTION("Got this message: " << e)
+	}
+	catch (std::runtime_error* e)
+	{
+		REPORT_EXCEPTION("RuntimeError: " << e->what())
+	}
+	catch (i3d::IOException* e)
+	{
+		REPORT_EXCEPTION("i3d::IOException: " << e->what)
+	}
+	catch (i3d::LibException* e)
+	{
+		REPORT_EXCEPTION("i3d::LibException: " << e->what)
+	}
+	catch (std::bad_alloc&)
+	{
+		REPORT_EXCEPTION("Not enough memory.")
+	}
+	catch (...)
+	{
+		REPORT_EXCEPTION("System exception.")
+	}
+	exit(-1);
+}
+
+/** how many FOs shall run in this process, the EMBRYOGEN_FOS
+    environment variable can override the number of CPU cores */
+int getNoOfInProcessFrontOfficers()
+{
+	const char* envFOs = std::getenv("EMBRYOGEN_FOS");
+	int FOs = envFOs != NULL ? std::atoi(envFOs) : (int)std::thread::hardware_concurrency();
+	return FOs > 0 ? FOs : 1;
+}
+#endif
+
 int main(int argc, char** argv)
 {
 	std::cout << "This is EmbryoGen at commit rev " << gitCommitHash << ".\n";
@@ -30,7 +85,46 @@ int main(int argc, char** argv)
 		//the Scenario object paradigm: there's always (independent) one per Direktor
 		//and each FO; thus, it is always created inline in respective c'tor calls
 
-#ifdef DISTRIBUTED
+#ifdef DISTRIBUTED_INPROCESS
+		//the Director lives in this thread, every FO lives in its own thread,
+		//and they all talk to each other only via their communicators
+		const int FOsCount = getNoOfInProcessFrontOfficers();
+		InProcessHub hub(FOsCount+1);
+		REPORT("Single node case, " << FOsCount << " FOs in threads");
+
+		//the Director is created first, it sets the seed of the rndStreams
+		//before any FO thread starts (see SetRandomStreamsSeed())
+		d = new Director(Scenarios(argc,argv).getScenario(), 1,FOsCount, new InProcessCommunicator(hub,DIRECTOR_ID));
+
+		std::vector<std::thread> FOs;
+		for (int thisFOsID = 1; thisFOsID <= FOsCount; ++thisFOsID)
+			FOs.emplace_back([&hub,thisFOsID,FOsCount,argc,argv] {
+				FrontOfficer* fo = NULL;
+				try
+				{
+					//builds the round robin schema, the last FO sends data back to the Direktor
+					const int nextFOsID = thisFOsID < FOsCount ? thisFOsID+1 : 0;
+					fo = new FrontOfficer(Scenarios(argc,argv).getScenario(), nextFOsID, thisFOsID,FOsCount,
+					                      new InProcessCommunicator(hub,thisFOsID));
+					fo->initMPI(); //populate/create my part of the scene
+					fo->execute(); //wait for Direktor's events
+					fo->close();   //deletes my agents
+					delete fo;
+				}
+				catch (...)
+				{
+					reportFrontOfficerException(fo);
+				}
+			});
+
+		auto timeHandle = tic();
+		d->initMPI();  //init the simulation, and render the first frame
+		d->execute();  //execute the simulation, and render frames
+		d->close();    //close the simulation, deletes agents, and save tracks.txt
+
+		for (auto& t : FOs) t.join();
+		REPORT("simulation required " << toc(timeHandle));
+#elif defined(DISTRIBUTED)
 		DistributedCommunicator * dc = new MPI_Communicator(argc, argv);
 
 		//these two has to come from MPI stack,
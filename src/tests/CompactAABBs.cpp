@@ -0,0 +1,144 @@
+//
+// compile:
+//
+// g++ -o test -Wall -std=gnu++11 -DDISTRIBUTED -DDISTRIBUTED_INPROCESS CompactAABBs.cpp ../util/report.cpp -li3dalgo -li3dcore
+//
+// Round-trips AABBs and dead IDs through the CompactAABBs wire format and checks
+// that the decoded boxes enclose the original ones; returns non-zero if any fails.
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include "../Communication/CompactAABBs.h"
+
+int failures = 0;
+
+void check(const bool ok, const char* what)
+{
+	if (!ok) ++failures;
+	std::cout << (ok ? "ok     " : "FAILED ") << what << "\n";
+}
+
+t_aabb makeAABB(const int id, const unsigned long long type, const int version,
+                const Vector3d<G_FLOAT>& minC, const Vector3d<G_FLOAT>& maxC)
+{
+	t_aabb a;
+	a.id = id;
+	a.atype = type;
+	a.version = version;
+	a.minCorner = minC;
+	a.maxCorner = maxC;
+	return a;
+}
+
+/** encodes and decodes, and compares with the originals: the same IDs, types,
+    versions and dead IDs, and the decoded boxes enclose the original ones
+    and are at most one quantum larger */
+bool roundTrip(const std::vector<t_aabb>& aabbs, const std::vector<int>& deadIDs,
+               const Vector3d<G_FLOAT>& origin, const G_FLOAT quantum)
+{
+	std::vector<char> wire;
+	if (!CompactAABBs::encode(aabbs,deadIDs, origin,quantum, wire)) return false;
+
+	std::vector<t_aabb> gotAABBs;
+	std::vector<int> gotDeadIDs;
+	CompactAABBs::decode(wire.data(),wire.size(), aabbs.size(),deadIDs.size(), gotAABBs,gotDeadIDs);
+
+	if (gotDeadIDs != deadIDs) return false;
+	for (size_t i = 0; i < aabbs.size(); ++i)
+	{
+		const t_aabb &a = aabbs[i], &g = gotAABBs[i];
+		if (g.id != a.id || g.atype != a.atype || g.version != a.version) return false;
+
+		if (g.minCorner.x > a.minCorner.x || g.minCorner.y > a.minCorner.y || g.minCorner.z > a.minCorner.z
+		 || g.maxCorner.x < a.maxCorner.x || g.maxCorner.y < a.maxCorner.y || g.maxCorner.z < a.maxCorner.z)
+			return false;
+
+		const double tol = 1.001 * (double)quantum;
+		if ((double)a.minCorner.x - (double)g.minCorner.x > tol || (double)g.maxCorner.x - (double)a.maxCorner.x > tol
+		 || (double)a.minCorner.y - (double)g.minCorner.y > tol || (double)g.maxCorner.y - (double)a.maxCorner.y > tol
+		 || (double)a.minCorner.z - (double)g.minCorner.z > tol || (double)g.maxCorner.z - (double)a.maxCorner.z > tol)
+			return false;
+	}
+	return true;
+}
+
+int main(void)
+{
+	const Vector3d<G_FLOAT> origin(-10.f,20.f,0.5f);
+	const G_FLOAT quantum = 0.1f;
+
+	//sorted IDs, repeated types, negative and large versions
+	std::vector<t_aabb> aabbs;
+	aabbs.push_back( makeAABB(  3, 7ull<<40, 0,      Vector3d<G_FLOAT>(-9.f,21.f,1.f), Vector3d<G_FLOAT>(-5.f,25.f,4.f)) );
+	aabbs.push_back( makeAABB( 17, 12345ull,  1,     Vector3d<G_FLOAT>( 0.f,30.f,2.f), Vector3d<G_FLOAT>( 2.f,31.f,3.f)) );
+	aabbs.push_back( makeAABB(400, 7ull<<40, -5,     Vector3d<G_FLOAT>(10.f,40.f,5.f), Vector3d<G_FLOAT>(11.f,41.f,6.f)) );
+	aabbs.push_back( makeAABB(1<<30, 12345ull, 1<<29, Vector3d<G_FLOAT>(1.f,22.f,1.f), Vector3d<G_FLOAT>(3.f,23.f,2.f)) );
+	std::vector<int> deadIDs = { 1, 2, 100, 5000000 };
+	check( roundTrip(aabbs,deadIDs, origin,quantum), "sorted IDs round trip" );
+
+	//unsorted IDs (negative deltas)
+	std::vector<t_aabb> unsorted = { aabbs[3], aabbs[0], aabbs[2], aabbs[1] };
+	std::vector<int> unsortedDead = { 5000000, 2, 100, 1 };
+	check( roundTrip(unsorted,unsortedDead, origin,quantum), "unsorted IDs round trip" );
+
+	//nothing at all
+	check( roundTrip(std::vector<t_aabb>(),std::vector<int>(), origin,quantum), "empty round trip" );
+
+	//corners exactly at, and a hair off, the multiples of the quantum
+	std::vector<t_aabb> boundary;
+	for (int k = 0; k < 1000; ++k)
+	{
+		const G_FLOAT v = CompactAABBs::dequantize(origin.x,quantum,k);
+		const G_FLOAT vy = CompactAABBs::dequantize(origin.y,quantum,k);
+		const G_FLOAT vz = CompactAABBs::dequantize(origin.z,quantum,k);
+		boundary.push_back( makeAABB(k, 1ull, k, Vector3d<G_FLOAT>(v,vy,vz), Vector3d<G_FLOAT>(v,vy,vz)) );
+		boundary.push_back( makeAABB(k+1000, 1ull, k,
+			Vector3d<G_FLOAT>(std::nextafter(v,v+1.f),std::nextafter(vy,vy+1.f),std::nextafter(vz,vz+1.f)),
+			Vector3d<G_FLOAT>(std::nextafter(v+quantum,v),std::nextafter(vy+quantum,vy),std::nextafter(vz+quantum,vz))) );
+	}
+	check( roundTrip(boundary,std::vector<int>(), origin,quantum), "corners at quantum boundaries are enclosed" );
+
+	//random boxes within the range
+	std::srand(42);
+	std::vector<t_aabb> randomBoxes;
+	for (int i = 0; i < 5000; ++i)
+	{
+		Vector3d<G_FLOAT> minC( origin.x + (G_FLOAT)(std::rand()%600000)/100.f,
+		                        origin.y + (G_FLOAT)(std::rand()%600000)/100.f,
+		                        origin.z + (G_FLOAT)(std::rand()%600000)/100.f );
+		Vector3d<G_FLOAT> maxC( minC.x + (G_FLOAT)(std::rand()%1000)/997.f,
+		                        minC.y + (G_FLOAT)(std::rand()%1000)/997.f,
+		                        minC.z + (G_FLOAT)(std::rand()%1000)/997.f );
+		randomBoxes.push_back( makeAABB(std::rand(), (unsigned long long)(std::rand()%5), std::rand()-RAND_MAX/2, minC,maxC) );
+	}
+	check( roundTrip(randomBoxes,std::vector<int>(), origin,quantum), "random boxes are enclosed" );
+
+	//beyond the 16-bit range: the encoder must refuse (and the caller falls back to the plain format)
+	std::vector<char> wire;
+	std::vector<t_aabb> tooFar = { makeAABB(1, 1ull, 0, Vector3d<G_FLOAT>(0.f,21.f,1.f),
+	                                        Vector3d<G_FLOAT>(origin.x + 65536.f*quantum, 22.f, 2.f)) };
+	check( !CompactAABBs::encode(tooFar,std::vector<int>(), origin,quantum, wire), "overflow above the range is refused" );
+	std::vector<t_aabb> below = { makeAABB(1, 1ull, 0, Vector3d<G_FLOAT>(origin.x - quantum,21.f,1.f),
+	                                       Vector3d<G_FLOAT>(0.f,22.f,2.f)) };
+	check( !CompactAABBs::encode(below,std::vector<int>(), origin,quantum, wire), "underflow below the origin is refused" );
+	std::vector<t_aabb> lastOne = { makeAABB(1, 1ull, 0, Vector3d<G_FLOAT>(0.f,21.f,1.f),
+	                                         Vector3d<G_FLOAT>(CompactAABBs::dequantize(origin.x,quantum,65535), 22.f, 2.f)) };
+	check( roundTrip(lastOne,std::vector<int>(), origin,quantum), "the last representable corner round trips" );
+
+	//truncated message must be detected
+	CompactAABBs::encode(aabbs,deadIDs, origin,quantum, wire);
+	bool thrown = false;
+	try
+	{
+		std::vector<t_aabb> gotAABBs;
+		std::vector<int> gotDeadIDs;
+		CompactAABBs::decode(wire.data(),wire.size()-1, aabbs.size(),deadIDs.size(), gotAABBs,gotDeadIDs);
+	}
+	catch (std::runtime_error* e) { delete e; thrown = true; }
+	check( thrown, "truncated message is detected" );
+
+	std::cout << (failures == 0 ? "all tests passed\n" : "SOME TESTS FAILED\n");
+	return failures == 0 ? 0 : 1;
+}
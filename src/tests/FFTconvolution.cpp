@@ -0,0 +1,161 @@
+//
+// compile:
+//
+// g++ -o test -Wall -O2 -std=gnu++11 FFTconvolution.cpp ../util/synthoscopy/FFTconvolution.cpp ../util/synthoscopy/GaussIIR.cpp ../util/report.cpp -li3dalgo -li3dcore -lpthread
+//
+// Compares FFTConvolution() with the direct convolution, and ParallelGaussIIR() with
+// the sampled Gaussian, for several numbers of workers; returns non-zero if any fails.
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <i3d/image3d.h>
+#include "../util/synthoscopy/FFTconvolution.h"
+#include "../util/synthoscopy/GaussIIR.h"
+
+int failures = 0;
+
+void prepareImage(i3d::Image3d<float>& img, const size_t x, const size_t y, const size_t z)
+{
+	img.SetResolution( i3d::Resolution(i3d::Vector3d<float>(1.f,1.f,1.f)) );
+	img.MakeRoom(x,y,z);
+}
+
+void fillRandomly(i3d::Image3d<float>& img)
+{
+	float* v = img.GetFirstVoxelAddr();
+	for (size_t i = 0; i < img.GetImageSize(); ++i)
+		v[i] = (float)(std::rand() % 1000) / 1000.f;
+}
+
+/** the reference: the PSF's centre is its middle voxel, outside the image is zero */
+void directConvolution(const i3d::Image3d<float>& img, const i3d::Image3d<float>& psf,
+                       i3d::Image3d<float>& out)
+{
+	const long nx = (long)img.GetSizeX(), ny = (long)img.GetSizeY(), nz = (long)img.GetSizeZ();
+	const long kx = (long)psf.GetSizeX(), ky = (long)psf.GetSizeY(), kz = (long)psf.GetSizeZ();
+	const float* const I = img.GetFirstVoxelAddr();
+	const float* const K = psf.GetFirstVoxelAddr();
+
+	prepareImage(out, img.GetSizeX(),img.GetSizeY(),img.GetSizeZ());
+	float* O = out.GetFirstVoxelAddr();
+
+	for (long z = 0; z < nz; ++z)
+	for (long y = 0; y < ny; ++y)
+	for (long x = 0; x < nx; ++x, ++O)
+	{
+		double sum = 0;
+		for (long w = 0; w < kz; ++w)
+		for (long v = 0; v < ky; ++v)
+		for (long u = 0; u < kx; ++u)
+		{
+			const long X = x - (u - kx/2), Y = y - (v - ky/2), Z = z - (w - kz/2);
+			if (X < 0 || X >= nx || Y < 0 || Y >= ny || Z < 0 || Z >= nz) continue;
+			sum += (double)K[(w*ky + v)*kx + u] * (double)I[(Z*ny + Y)*nx + X];
+		}
+		*O = (float)sum;
+	}
+}
+
+void testFFTConvolution(const size_t nx, const size_t ny, const size_t nz,
+                        const size_t kx, const size_t ky, const size_t kz)
+{
+	i3d::Image3d<float> img, psf, ref;
+	prepareImage(img, nx,ny,nz); fillRandomly(img);
+	prepareImage(psf, kx,ky,kz); fillRandomly(psf);
+	directConvolution(img,psf, ref);
+
+	for (int threads : {1,2,3,8})
+	{
+		i3d::Image3d<float> res;
+		prepareImage(res, nx,ny,nz);
+		std::copy(img.GetFirstVoxelAddr(), img.GetFirstVoxelAddr()+img.GetImageSize(), res.GetFirstVoxelAddr());
+		FFTConvolution(res,psf, threads);
+
+		double maxErr = 0, maxVal = 0;
+		for (size_t i = 0; i < img.GetImageSize(); ++i)
+		{
+			maxErr = std::max(maxErr, (double)std::fabs(res.GetVoxel(i) - ref.GetVoxel(i)));
+			maxVal = std::max(maxVal, (double)std::fabs(ref.GetVoxel(i)));
+		}
+
+		const bool ok = maxErr <= 1e-4 * maxVal;
+		if (!ok) ++failures;
+		std::cout << (ok ? "ok     " : "FAILED ") << "FFTConvolution of " << nx << "x" << ny << "x" << nz
+		          << " with " << kx << "x" << ky << "x" << kz << " PSF, " << threads << " workers: max error "
+		          << maxErr << " (of max value " << maxVal << ")\n";
+	}
+}
+
+void testGaussIIR(const size_t n, const size_t nz, const float sigmaXY, const float sigmaZ)
+{
+	i3d::Image3d<float> ref;
+	prepareImage(ref, n,n,nz);
+	const size_t c = n/2, cz = nz/2;
+	ref.SetVoxel(c,c,cz, 1.f);
+	ParallelGaussIIR(ref, sigmaXY,sigmaXY,sigmaZ, 1);
+
+	for (int threads : {1,2,3,8})
+	{
+		i3d::Image3d<float> img;
+		prepareImage(img, n,n,nz);
+		img.SetVoxel(c,c,cz, 1.f);
+		ParallelGaussIIR(img, sigmaXY,sigmaXY,sigmaZ, threads);
+
+		//the sampled Gaussian normalized over the image, z is ignored if not blurred along it
+		const bool blurZ = sigmaZ >= 0.5f && nz > 1;
+		std::vector<double> g(img.GetImageSize());
+		double gSum = 0;
+		for (size_t z = 0, i = 0; z < nz; ++z)
+		for (size_t y = 0; y < n; ++y)
+		for (size_t x = 0; x < n; ++x, ++i)
+		{
+			const double dx = (double)x-(double)c, dy = (double)y-(double)c, dz = (double)z-(double)cz;
+			g[i] = std::exp(-(dx*dx+dy*dy)/(2.0*sigmaXY*sigmaXY));
+			if (blurZ) g[i] *= std::exp(-dz*dz/(2.0*sigmaZ*sigmaZ));
+			else if (z != cz) g[i] = 0;
+			gSum += g[i];
+		}
+
+		double sum = 0, maxErr = 0, peak = 0, diffToRef = 0;
+		for (size_t i = 0; i < img.GetImageSize(); ++i)
+		{
+			const double v = img.GetVoxel(i);
+			sum   += v;
+			peak   = std::max(peak, g[i]/gSum);
+			maxErr = std::max(maxErr, std::fabs(v - g[i]/gSum));
+			diffToRef = std::max(diffToRef, (double)std::fabs(img.GetVoxel(i) - ref.GetVoxel(i)));
+		}
+
+		//the recursive filter is an approximation, its peak is off by few percents
+		const bool ok = std::fabs(sum-1.0) < 1e-3 && maxErr < 0.1*peak && diffToRef == 0;
+		if (!ok) ++failures;
+		std::cout << (ok ? "ok     " : "FAILED ") << "ParallelGaussIIR of " << n << "x" << n << "x" << nz
+		          << " impulse with sigmas " << sigmaXY << "," << sigmaZ << ", " << threads << " workers: sum "
+		          << sum << ", max error " << maxErr << " (of peak " << peak << "), diff to 1 worker "
+		          << diffToRef << "\n";
+	}
+}
+
+int main(void)
+{
+	//odd PSF sizes, the last slab along z is thinner than the others
+	testFFTConvolution(20,17,23, 5,3,7);
+	//even PSF sizes
+	testFFTConvolution(16,19,14, 4,6,2);
+	//2D image (z=1), slabs go along y then
+	testFFTConvolution(19,21,1, 3,5,1);
+	//2D image with 3D PSF
+	testFFTConvolution(12,25,1, 3,3,3);
+	//PSF larger than the image along some axis
+	testFFTConvolution(7,30,9, 9,3,11);
+
+	//the impulse is far enough from the borders (where the edge voxels are repeated)
+	testGaussIIR(61,41, 3.0f,2.0f);
+	testGaussIIR(41,1,  2.0f,2.0f);
+	testGaussIIR(33,41, 0.8f,3.5f);
+
+	std::cout << (failures == 0 ? "all tests passed\n" : "SOME TESTS FAILED\n");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,133 @@
+//
+// compile:
+//
+// g++ -o test -Wall -std=gnu++11 PayloadCompression.cpp ../util/report.cpp
+//
+// Round-trips various payloads through the ByteShuffleLZ codec;
+// returns non-zero if any fails.
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "../Communication/PayloadCompression.h"
+
+int failures = 0;
+
+void check(const bool ok, const std::string& what)
+{
+	if (!ok) ++failures;
+	std::cout << (ok ? "ok     " : "FAILED ") << what << "\n";
+}
+
+/** worst-case size of the compressed stream: the literals, their token
+    and the extra length bytes */
+size_t worstCase(const size_t size)
+{
+	return size + size/255 + 16;
+}
+
+/** compresses and decompresses, returns the compressed size or 0 if the
+    round trip didn't restore the original payload */
+size_t roundTrip(const std::vector<char>& data, const size_t elemSize)
+{
+	std::vector<char> scratch, packed(worstCase(data.size())), restored(data.size());
+	const size_t packedSize = ByteShuffleLZ::compress(data.data(),data.size(),elemSize,
+	                                                  scratch, packed.data(),packed.size());
+	if (packedSize == 0) return 0;
+
+	ByteShuffleLZ::decompress(packed.data(),packedSize,elemSize, scratch, restored.data(),restored.size());
+	return restored == data ? packedSize : 0;
+}
+
+void checkRoundTrip(const std::vector<char>& data, const size_t elemSize, const std::string& what)
+{
+	const size_t packedSize = roundTrip(data,elemSize);
+	check( packedSize > 0, what + " (" + std::to_string(data.size()) + " -> "
+	                            + std::to_string(packedSize) + " bytes)" );
+}
+
+int main(void)
+{
+	std::srand(42);
+
+	//incompressible: random bytes
+	std::vector<char> noise(300000);
+	for (char& c : noise) c = (char)(std::rand() & 0xff);
+	checkRoundTrip(noise,1, "random bytes round trip");
+	checkRoundTrip(noise,4, "random bytes round trip, shuffled by 4");
+
+	//all zeros, compresses into long matches of offset 1 that overlap themselves
+	std::vector<char> zeros(1 << 20, 0);
+	checkRoundTrip(zeros,1, "all-zero payload round trip");
+	checkRoundTrip(zeros,8, "all-zero payload round trip, shuffled by 8");
+	check( roundTrip(zeros,1) < zeros.size()/100, "all-zero payload is compressed well" );
+
+	//a short period, the matches overlap themselves with offsets > 1
+	std::vector<char> periodic(100003);
+	for (size_t i = 0; i < periodic.size(); ++i) periodic[i] = "abcdefg"[i % 7];
+	checkRoundTrip(periodic,1, "periodic payload (self-overlapping matches) round trip");
+
+	//slowly varying floats, sizes that are not multiples of the element size
+	for (size_t tail = 0; tail < 4; ++tail)
+	{
+		std::vector<char> floats(4*50000 + tail);
+		for (size_t i = 0; i < 50000; ++i)
+		{
+			const float f = 100.f + 0.01f*(float)i;
+			std::memcpy(floats.data() + 4*i, &f, 4);
+		}
+		for (size_t i = 0; i < tail; ++i) floats[4*50000 + i] = (char)(i+1);
+		checkRoundTrip(floats,4, "floats with " + std::to_string(tail) + " trailing bytes round trip");
+		checkRoundTrip(floats,3, "floats with " + std::to_string(tail) + " trailing bytes round trip, shuffled by 3");
+	}
+
+	//tiny payloads, shorter than the element size or the minimal match
+	for (size_t size = 0; size < 10; ++size)
+	{
+		std::vector<char> tiny(size, 'x');
+		std::vector<char> scratch, packed(worstCase(size)), restored(size);
+		const size_t packedSize = ByteShuffleLZ::compress(tiny.data(),size,4, scratch, packed.data(),packed.size());
+		bool ok = packedSize > 0;
+		if (ok)
+		{
+			ByteShuffleLZ::decompress(packed.data(),packedSize,4, scratch, restored.data(),size);
+			ok = restored == tiny;
+		}
+		check( ok, "tiny payload of " + std::to_string(size) + " bytes round trip" );
+	}
+
+	//too small output buffer must be reported, not overrun
+	{
+		std::vector<char> scratch, packed(noise.size() + 64);
+		const size_t capacity = noise.size() / 2;
+		packed[capacity] = 0x5a;
+		check( ByteShuffleLZ::compress(noise.data(),noise.size(),1, scratch, packed.data(),capacity) == 0,
+		       "incompressible payload into a half-sized buffer returns 0" );
+		check( packed[capacity] == 0x5a, "the output buffer is not overrun" );
+		check( ByteShuffleLZ::compress(zeros.data(),zeros.size(),1, scratch, packed.data(),4) == 0,
+		       "all-zero payload into a 4 bytes buffer returns 0" );
+		check( ByteShuffleLZ::compress(zeros.data(),zeros.size(),1, scratch, packed.data(),0) == 0,
+		       "any payload into no buffer returns 0" );
+	}
+
+	//corrupted streams must be detected
+	{
+		std::vector<char> scratch, packed(worstCase(periodic.size())), restored(periodic.size());
+		const size_t packedSize = ByteShuffleLZ::compress(periodic.data(),periodic.size(),1,
+		                                                  scratch, packed.data(),packed.size());
+		bool thrown = false;
+		try { ByteShuffleLZ::decompress(packed.data(),packedSize/2,1, scratch, restored.data(),restored.size()); }
+		catch (std::runtime_error* e) { delete e; thrown = true; }
+		check( thrown, "truncated stream is detected" );
+
+		thrown = false;
+		try { ByteShuffleLZ::decompress(packed.data(),packedSize,1, scratch, restored.data(),restored.size()-1); }
+		catch (std::runtime_error* e) { delete e; thrown = true; }
+		check( thrown, "mismatching original size is detected" );
+	}
+
+	std::cout << (failures == 0 ? "all tests passed\n" : "SOME TESTS FAILED\n");
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,203 @@
+#include <cstdio>
+#include <cstring>
+#include "../Geometries/Geometry.h"
+#include "Checkpoint.h"
+
+static const char checkpointMagic[4] = { 'E','G','C','P' };
+
+CheckpointWriter::CheckpointWriter(const std::string& fileName, const std::string& kind)
+	: fileName(fileName), tmpFileName(fileName+".tmp"),
+	  file(tmpFileName, std::ios::binary | std::ios::trunc)
+{
+	if (!file.is_open())
+		throw ERROR_REPORT("Cannot write the checkpoint file " << tmpFileName);
+
+	putBytes(checkpointMagic,sizeof(checkpointMagic));
+	put((int)CHECKPOINT_FORMAT_VERSION);
+	putString(kind);
+}
+
+CheckpointWriter::~CheckpointWriter()
+{
+	if (file.is_open())
+	{
+		file.close();
+		std::remove(tmpFileName.c_str());
+	}
+}
+
+
+void CheckpointWriter::putString(const std::string& s)
+{
+	put((uint64_t)s.size());
+	putBytes(s.data(),s.size());
+}
+
+
+void CheckpointWriter::putGeometry(const Geometry& geom)
+{
+	const long size = geom.getSizeInBytes();
+	std::vector<char> buffer((size_t)size);
+	geom.serializeTo(buffer.data());
+
+	put(geom.getType());
+	putVector(buffer);
+}
+
+
+void CheckpointWriter::putRngState(const rndGeneratorHandle& rngHandle)
+{
+	std::vector<char> state;
+	GetRandomGeneratorState(rngHandle,state);
+	putVector(state);
+}
+
+
+void CheckpointWriter::putBytes(const void* data, const size_t size)
+{
+	file.write((const char*)data,(std::streamsize)size);
+	if (!file.good())
+		throw ERROR_REPORT("Failed writing the checkpoint file " << tmpFileName);
+}
+
+
+void CheckpointWriter::beginRecord()
+{
+	if (recordStart != -1)
+		throw ERROR_REPORT("Checkpoint records cannot be nested");
+
+	recordStart = (std::streamoff)file.tellp();
+	put((uint64_t)0); //placeholder for the length, see endRecord()
+}
+
+void CheckpointWriter::endRecord()
+{
+	if (recordStart == -1)
+		throw ERROR_REPORT("No checkpoint record to end");
+
+	const std::streamoff recordEnd = (std::streamoff)file.tellp();
+	file.seekp(recordStart);
+	put((uint64_t)(recordEnd - recordStart - (std::streamoff)sizeof(uint64_t)));
+	file.seekp(recordEnd);
+	recordStart = -1;
+}
+
+
+void CheckpointWriter::close()
+{
+	if (recordStart != -1)
+		throw ERROR_REPORT("Unfinished checkpoint record in " << tmpFileName);
+
+	file.close();
+	if (file.fail())
+		throw ERROR_REPORT("Failed finishing the checkpoint file " << tmpFileName);
+
+	if (std::rename(tmpFileName.c_str(),fileName.c_str()) != 0)
+		throw ERROR_REPORT("Cannot rename " << tmpFileName << " to " << fileName);
+	DEBUG_REPORT("checkpoint file " << fileName << " was saved");
+}
+
+
+// ------------------------------------------------------------------------------
+CheckpointReader::CheckpointReader(const std::string& fileName, const std::string& kind)
+	: fileName(fileName), file(fileName, std::ios::binary)
+{
+	if (!file.is_open())
+		throw ERROR_REPORT("Cannot read the checkpoint file " << fileName);
+
+	char magic[sizeof(checkpointMagic)];
+	getBytes(magic,sizeof(magic));
+	if (std::memcmp(magic,checkpointMagic,sizeof(magic)) != 0)
+		throw ERROR_REPORT(fileName << " is not a checkpoint file");
+
+	const int version = get<int>();
+	if (version != CHECKPOINT_FORMAT_VERSION)
+		throw ERROR_REPORT(fileName << " is a checkpoint of format version " << version
+		                   << ", only version " << CHECKPOINT_FORMAT_VERSION << " is supported");
+
+	const std::string fileKind = getString();
+	if (fileKind != kind)
+		throw ERROR_REPORT(fileName << " is a checkpoint of '" << fileKind << "' but '" << kind << "' was expected");
+}
+
+
+std::string CheckpointReader::getString()
+{
+	std::string s((size_t)get<uint64_t>(),'\0');
+	if (!s.empty()) getBytes(&s[0],s.size());
+	return s;
+}
+
+
+Geometry* CheckpointReader::getGeometry()
+{
+	const int type = get<int>();
+	getVector(geomBuffer);
+
+	Geometry* geom = Geometry::createAndDeserializeFrom(type,geomBuffer.data());
+	if (geom == NULL)
+		throw ERROR_REPORT("Unknown geometry type " << type << " in " << fileName);
+	return geom;
+}
+
+void CheckpointReader::getGeometryInto(Geometry& geom)
+{
+	const int type = get<int>();
+	if (type != geom.getType())
+		throw ERROR_REPORT("Geometry of type " << geom.getType() << " cannot be read from geometry of type "
+		                   << type << " in " << fileName);
+	getVector(geomBuffer);
+	geom.deserializeFrom(geomBuffer.data());
+}
+
+
+void CheckpointReader::getRngState(rndGeneratorHandle& rngHandle)
+{
+	std::vector<char> state;
+	getVector(state);
+	SetRandomGeneratorState(rngHandle,state);
+}
+
+
+void CheckpointReader::getBytes(void* data, const size_t size)
+{
+	file.read((char*)data,(std::streamsize)size);
+	if ((size_t)file.gcount() != size)
+		throw ERROR_REPORT("Checkpoint file " << fileName << " is truncated");
+}
+
+
+uint64_t CheckpointReader::beginRecord()
+{
+	if (recordEnd != -1)
+		throw ERROR_REPORT("Checkpoint records cannot be nested");
+
+	const uint64_t length = get<uint64_t>();
+	recordEnd = (std::streamoff)file.tellg() + (std::streamoff)length;
+	return length;
+}
+
+void CheckpointReader::skipRecord()
+{
+	if (recordEnd == -1)
+		throw ERROR_REPORT("No checkpoint record to skip");
+
+	file.seekg(recordEnd);
+	recordEnd = -1;
+}
+
+void CheckpointReader::endRecord()
+{
+	if (recordEnd == -1)
+		throw ERROR_REPORT("No checkpoint record to end");
+	if ((std::streamoff)file.tellg() != recordEnd)
+		throw ERROR_REPORT("Checkpoint record in " << fileName << " was not read completely, "
+		                   << (recordEnd - (std::streamoff)file.tellg()) << " bytes are left");
+	recordEnd = -1;
+}
+
+
+bool CheckpointReader::atEnd()
+{
+	return file.peek() == std::ifstream::traits_type::eof();
+}
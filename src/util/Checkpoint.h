@@ -0,0 +1,179 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <type_traits>
+#include "report.h"
+#include "rnd_generators.h"
+#include "Vector3d.h"
+
+class Geometry;
+
+/** version of the layout of the checkpoint files, it must match exactly when
+    a checkpoint is read (no attempts are made to read older checkpoints) */
+#define CHECKPOINT_FORMAT_VERSION 1
+
+/**
+ * Binary writer of one checkpoint file, which is a file that holds a portion
+ * of the complete simulation state from which the simulation can be restarted.
+ * The file starts with a header (magic, format version, and the 'kind' of the file,
+ * e.g. "FO" or "Direktor") followed by items written with the put...() methods;
+ * the CheckpointReader must read them back in the same order with the corresponding
+ * get...() methods. Items are stored in the native byte order, checkpoints are thus
+ * not meant to be moved between machines of different architectures.
+ *
+ * Items can be grouped into records (see beginRecord()) that are prefixed with their
+ * length, so that the reader can skip over a record without understanding its content.
+ *
+ * The file is written under a temporary name and renamed only in close(), so that an
+ * interrupted writing never replaces the previous complete checkpoint.
+ */
+class CheckpointWriter
+{
+public:
+	CheckpointWriter(const std::string& fileName, const std::string& kind);
+
+	/** removes the unfinished temporary file if close() was not called */
+	~CheckpointWriter();
+
+	/** writes a value of an arithmetic or enum type */
+	template <typename T>
+	void put(const T value)
+	{
+		static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+		              "only plain values can be put directly");
+		putBytes(&value,sizeof(T));
+	}
+
+	/** writes 'count' values of an arithmetic type */
+	template <typename T>
+	void putArray(const T* values, const size_t count)
+	{
+		static_assert(std::is_arithmetic<T>::value, "only plain values can be put directly");
+		putBytes(values,count*sizeof(T));
+	}
+
+	template <typename T>
+	void putVector(const std::vector<T>& values)
+	{
+		put((uint64_t)values.size());
+		putArray(values.data(),values.size());
+	}
+
+	template <typename T>
+	void putVector3d(const Vector3d<T>& v)
+	{
+		put(v.x); put(v.y); put(v.z);
+	}
+
+	void putString(const std::string& s);
+
+	/** writes the geometry's type and its serialized form */
+	void putGeometry(const Geometry& geom);
+
+	/** writes the complete state of the random generator behind the handle */
+	void putRngState(const rndGeneratorHandle& rngHandle);
+
+	void putBytes(const void* data, const size_t size);
+
+	/** starts a length-prefixed record, records cannot be nested */
+	void beginRecord();
+	/** finishes the record started with beginRecord() */
+	void endRecord();
+
+	/** finishes the file and makes it appear under its final name,
+	    throws if anything went wrong during the writing */
+	void close();
+
+protected:
+	const std::string fileName, tmpFileName;
+	std::ofstream file;
+
+	/** position of the length of the currently open record, or -1 */
+	std::streamoff recordStart = -1;
+};
+
+
+/**
+ * Reader of a checkpoint file written with CheckpointWriter, see there.
+ * All methods throw if the file is shorter than what is being read.
+ */
+class CheckpointReader
+{
+public:
+	/** opens the file and checks its header, throws if the file cannot
+	    be opened, if its 'kind' differs or if it is of another format version */
+	CheckpointReader(const std::string& fileName, const std::string& kind);
+
+	template <typename T>
+	T get()
+	{
+		static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value,
+		              "only plain values can be get directly");
+		T value;
+		getBytes(&value,sizeof(T));
+		return value;
+	}
+
+	template <typename T>
+	void getArray(T* values, const size_t count)
+	{
+		static_assert(std::is_arithmetic<T>::value, "only plain values can be get directly");
+		getBytes(values,count*sizeof(T));
+	}
+
+	template <typename T>
+	void getVector(std::vector<T>& values)
+	{
+		values.resize((size_t)get<uint64_t>());
+		getArray(values.data(),values.size());
+	}
+
+	template <typename T>
+	void getVector3d(Vector3d<T>& v)
+	{
+		v.x = get<T>(); v.y = get<T>(); v.z = get<T>();
+	}
+
+	std::string getString();
+
+	/** creates a new geometry from what was written with CheckpointWriter::putGeometry(),
+	    the caller is responsible for deleting it */
+	Geometry* getGeometry();
+
+	/** fills an existing geometry (of the same type) from what was written
+	    with CheckpointWriter::putGeometry() */
+	void getGeometryInto(Geometry& geom);
+
+	/** restores the complete state of the random generator behind the handle */
+	void getRngState(rndGeneratorHandle& rngHandle);
+
+	void getBytes(void* data, const size_t size);
+
+	/** enters the next record, returns its length in bytes */
+	uint64_t beginRecord();
+	/** moves right behind the current record, regardless how much of it has been read */
+	void skipRecord();
+	/** leaves the current record, throws if it has not been read exactly */
+	void endRecord();
+
+	/** returns true if there is nothing more to read */
+	bool atEnd();
+
+	const std::string& getFileName() const
+	{ return fileName; }
+
+protected:
+	const std::string fileName;
+	std::ifstream file;
+
+	/** where the current record ends, or -1 */
+	std::streamoff recordEnd = -1;
+
+	/** reusable buffer for the serialized geometries */
+	std::vector<char> geomBuffer;
+};
+#endif
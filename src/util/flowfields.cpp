@@ -535,9 +535,10 @@ void DescribeRotation(FlowField<FT> &FF,
  * a helper static structures so that one does not need
  * to allocate and initiate them over and over again
  *
- * it is used in the function DescribeRadialFlow()
+ * it is used in the function DescribeRadialFlow(); all three are per
+ * thread as FOs may run as threads of one process
  */
-static bool pnInitiated=false;
+static thread_local bool pnInitiated=false;
 
 /**
  * a common to all cells structure for non-rigid deformations;
@@ -545,7 +546,7 @@ static bool pnInitiated=false;
  *
  * it is used in the function DescribeRadialFlow()
  */
-static i3d::Separable3dFilter<float> pnKernel;
+static thread_local i3d::Separable3dFilter<float> pnKernel;
 
 /**
  * a common to all cells structure for non-rigid deformations;
@@ -553,7 +554,7 @@ static i3d::Separable3dFilter<float> pnKernel;
  *
  * it is used in the function DescribeRadialFlow()
  */
-static i3d::BorderPadding<float> pnBoundaries;
+static thread_local i3d::BorderPadding<float> pnBoundaries;
 #endif
 
 template <class FT>
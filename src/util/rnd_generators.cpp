@@ -2,6 +2,10 @@
 #include <gsl/gsl_randist.h>
 #include <time.h>
 #include <unistd.h>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <atomic>
 
 #include "report.h"
 #include "rnd_generators.h"
@@ -27,7 +31,8 @@
 /// re-seed if necessary (and init at all if necessary too)
 void inline PossiblyReSeed(rndGeneratorHandle& rngHandle)
 {
-	static unsigned long seedExtraDiversity = 0;
+	//shared by all threads, so that handles seeded within the same second differ
+	static std::atomic<unsigned long> seedExtraDiversity(0);
 
 	if (rngHandle.usageCnt == rngHandle.reseedPeriod)
 	{
@@ -69,8 +74,58 @@ unsigned int GetRandomPoisson(const float mean, rndGeneratorHandle& rngHandle)
 }
 
 
+// -------------- state of the generator WITH explicit rndGeneratorHandle --------------
+/*
+ * The exported state is: reseedPeriod, usageCnt, the name of the GSL generator
+ * (zero-terminated, empty if the generator was not used yet) and its raw state.
+ */
+void GetRandomGeneratorState(const rndGeneratorHandle& rngHandle, std::vector<char>& state)
+{
+	const char* name = rngHandle.rngState != NULL ? gsl_rng_name(rngHandle.rngState) : "";
+	const size_t nameLen = strlen(name)+1;
+	const size_t rngSize = rngHandle.rngState != NULL ? gsl_rng_size(rngHandle.rngState) : 0;
+
+	state.resize(2*sizeof(int) + nameLen + rngSize);
+	char* s = state.data();
+	memcpy(s, &rngHandle.reseedPeriod, sizeof(int)); s += sizeof(int);
+	memcpy(s, &rngHandle.usageCnt, sizeof(int));     s += sizeof(int);
+	memcpy(s, name, nameLen);                        s += nameLen;
+	if (rngSize > 0) memcpy(s, gsl_rng_state(rngHandle.rngState), rngSize);
+}
+
+
+void SetRandomGeneratorState(rndGeneratorHandle& rngHandle, const std::vector<char>& state)
+{
+	const char* s = state.data();
+	const char* const end = s + state.size();
+	if (state.size() < 2*sizeof(int)+1 || memchr(s+2*sizeof(int), 0, state.size()-2*sizeof(int)) == NULL)
+		throw ERROR_REPORT("Malformed state of the random generator");
+
+	memcpy(&rngHandle.reseedPeriod, s, sizeof(int)); s += sizeof(int);
+	memcpy(&rngHandle.usageCnt, s, sizeof(int));     s += sizeof(int);
+	const std::string name(s);                       s += name.size()+1;
+
+	if (name.empty())
+	{
+		//the generator was not used yet, will be seeded on the first use
+		rngHandle.usageCnt = rngHandle.reseedPeriod;
+		return;
+	}
+
+	if (rngHandle.rngState == NULL)
+		rngHandle.rngState = gsl_rng_alloc(gsl_rng_default);
+
+	if (name != gsl_rng_name(rngHandle.rngState) || (size_t)(end-s) != gsl_rng_size(rngHandle.rngState))
+		throw ERROR_REPORT("Cannot restore the random generator " << name << " into the generator "
+		                   << gsl_rng_name(rngHandle.rngState));
+	memcpy(gsl_rng_state(rngHandle.rngState), s, (size_t)(end-s));
+}
+
+
 // -------------- rnd generator WITHOUT explicit rndGeneratorHandle --------------
-rndGeneratorHandle lostSoulRngHandle;
+/// one per thread: FOs that run as threads of one process (DISTRIBUTED_INPROCESS)
+/// must not share it, and every FO then checkpoints its own
+thread_local rndGeneratorHandle lostSoulRngHandle;
 
 float GetRandomGauss(const float mean, const float sigma)
 {
@@ -86,3 +141,312 @@ unsigned int GetRandomPoisson(const float mean)
 {
 	return GetRandomPoisson(mean, lostSoulRngHandle);
 }
+
+void GetRandomGeneratorState(std::vector<char>& state)
+{
+	GetRandomGeneratorState(lostSoulRngHandle, state);
+}
+
+void SetRandomGeneratorState(const std::vector<char>& state)
+{
+	SetRandomGeneratorState(lostSoulRngHandle, state);
+}
+
+
+// -------------- counter-based rnd generator --------------
+/// the seed is set during the initialization and is only read afterwards; it is atomic
+/// as FOs running as threads of one process set it (to the same value) concurrently
+std::atomic<uint64_t> randomStreamsSeed(0);
+
+void SetRandomStreamsSeed(const uint64_t seed)
+{
+	randomStreamsSeed.store(seed);
+}
+
+uint64_t GetRandomStreamsSeed(void)
+{
+	return randomStreamsSeed.load();
+}
+
+
+rndStream::rndStream(const int agentID, const int round, const int purpose)
+	: rndStream(randomStreamsSeed, agentID, round, purpose)
+{}
+
+rndStream::rndStream(const uint64_t seed, const int agentID, const int round, const int purpose)
+{
+	key[0] = (uint32_t)seed;
+	key[1] = (uint32_t)(seed >> 32);
+
+	counter[0] = 0;
+	counter[1] = (uint32_t)purpose;
+	counter[2] = (uint32_t)agentID;
+	counter[3] = (uint32_t)round;
+}
+
+
+void rndStream::philox(const uint32_t key[2], uint32_t counter[4])
+{
+	uint32_t k0 = key[0], k1 = key[1];
+	for (int r = 0; r < 10; ++r)
+	{
+		const uint64_t p0 = (uint64_t)0xD2511F53u * counter[0];
+		const uint64_t p1 = (uint64_t)0xCD9E8D57u * counter[2];
+
+		const uint32_t c1 = counter[1], c3 = counter[3];
+		counter[0] = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+		counter[1] = (uint32_t)p1;
+		counter[2] = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+		counter[3] = (uint32_t)p0;
+
+		k0 += 0x9E3779B9u;
+		k1 += 0xBB67AE85u;
+	}
+}
+
+
+void rndStream::philox(const uint32_t key[2],
+                       uint32_t* c0, uint32_t* c1, uint32_t* c2, uint32_t* c3,
+                       const size_t lanes)
+{
+	uint32_t k0 = key[0], k1 = key[1];
+	for (int r = 0; r < 10; ++r)
+	{
+		for (size_t l = 0; l < lanes; ++l)
+		{
+			const uint64_t p0 = (uint64_t)0xD2511F53u * c0[l];
+			const uint64_t p1 = (uint64_t)0xCD9E8D57u * c2[l];
+
+			c0[l] = (uint32_t)(p1 >> 32) ^ c1[l] ^ k0;
+			c1[l] = (uint32_t)p1;
+			c2[l] = (uint32_t)(p0 >> 32) ^ c3[l] ^ k1;
+			c3[l] = (uint32_t)p0;
+		}
+
+		k0 += 0x9E3779B9u;
+		k1 += 0xBB67AE85u;
+	}
+}
+
+
+void rndStream::refill(void)
+{
+	memcpy(block, counter, sizeof(block));
+	philox(key, block);
+	++counter[0];
+}
+
+
+void rndStream::nextBits(uint32_t* out, size_t count)
+{
+	//finish the current block first
+	while (count > 0 && used < 4)
+	{
+		*out++ = block[used++];
+		--count;
+	}
+
+	//then whole batches of blocks
+	const size_t lanes = 16;
+	uint32_t c0[lanes],c1[lanes],c2[lanes],c3[lanes];
+	while (count >= 4*lanes)
+	{
+		for (size_t l = 0; l < lanes; ++l)
+		{
+			c0[l] = counter[0] + (uint32_t)l;
+			c1[l] = counter[1];
+			c2[l] = counter[2];
+			c3[l] = counter[3];
+		}
+		philox(key, c0,c1,c2,c3, lanes);
+
+		for (size_t l = 0; l < lanes; ++l)
+		{
+			*out++ = c0[l];
+			*out++ = c1[l];
+			*out++ = c2[l];
+			*out++ = c3[l];
+		}
+		counter[0] += (uint32_t)lanes;
+		count -= 4*lanes;
+	}
+
+	//and the rest the usual way
+	while (count > 0)
+	{
+		*out++ = nextBits();
+		--count;
+	}
+}
+
+
+float GetRandomGauss(const float mean, const float sigma, rndStream& stream)
+{
+	if (stream.hasSpareGauss)
+	{
+		stream.hasSpareGauss = false;
+		return (float)(stream.spareGauss * sigma) + mean;
+	}
+
+	//Box-Muller: two Gaussians from two uniforms
+	const double r   = std::sqrt(-2.0 * std::log(stream.nextUniformNonZero()));
+	const double phi = 6.283185307179586 * stream.nextUniform();
+	stream.spareGauss = r * std::sin(phi);
+	stream.hasSpareGauss = true;
+	return (float)(r * std::cos(phi) * sigma) + mean;
+}
+
+
+float GetRandomUniform(const float A, const float B, rndStream& stream)
+{
+	return A + (float)stream.nextUniform() * (B-A);
+}
+
+
+unsigned int GetRandomPoisson(const float mean, rndStream& stream)
+{
+	if (mean <= 0) return 0;
+
+	if (mean < 10)
+	{
+		//multiplication method
+		const double L = std::exp(-(double)mean);
+		double p = stream.nextUniform();
+		unsigned int k = 0;
+		while (p > L)
+		{
+			++k;
+			p *= stream.nextUniform();
+		}
+		return k;
+	}
+
+	//PTRS: transformed rejection with squeeze
+	const double mu  = mean;
+	const double smu = std::sqrt(mu);
+	const double b   = 0.931 + 2.53*smu;
+	const double a   = -0.059 + 0.02483*b;
+	const double invAlpha = 1.1239 + 1.1328/(b-3.4);
+	const double vr  = 0.9277 - 3.6224/(b-2);
+	const double logMu = std::log(mu);
+
+	while (true)
+	{
+		const double U  = stream.nextUniform() - 0.5;
+		const double V  = stream.nextUniformNonZero();
+		const double us = 0.5 - std::fabs(U);
+		const double k  = std::floor((2*a/us + b)*U + mu + 0.43);
+
+		if (us >= 0.07 && V <= vr) return (unsigned int)k;
+		if (k < 0 || (us < 0.013 && V > us)) continue;
+
+		if (std::log(V) + std::log(invAlpha) - std::log(a/(us*us) + b)
+		    <= -mu + k*logMu - std::lgamma(k+1)) return (unsigned int)k;
+	}
+}
+
+
+/// how many variates the batched functions process in one go
+const size_t fillChunk = 1024;
+
+void FillRandomUniform(float* out, const size_t count,
+                       const float A, const float B, rndStream& stream)
+{
+	uint32_t bits[fillChunk];
+	const float scale = B-A;
+
+	for (size_t i = 0; i < count; i += fillChunk)
+	{
+		const size_t n = std::min(fillChunk, count-i);
+		stream.nextBits(bits, n);
+
+		float* const o = out+i;
+		for (size_t j = 0; j < n; ++j)
+			o[j] = A + (float)(bits[j] * (1.0/4294967296.0)) * scale;
+	}
+}
+
+
+void FillRandomGauss(float* out, size_t count,
+                     const float mean, const float sigma, rndStream& stream)
+{
+	if (count > 0 && stream.hasSpareGauss)
+	{
+		*out++ = GetRandomGauss(mean,sigma, stream);
+		--count;
+	}
+
+	uint32_t bits[fillChunk];
+	const size_t pairs = count/2;
+	for (size_t i = 0; i < pairs; i += fillChunk/2)
+	{
+		const size_t n = std::min(fillChunk/2, pairs-i);
+		stream.nextBits(bits, 2*n);
+
+		float* const o = out+2*i;
+		for (size_t j = 0; j < n; ++j)
+		{
+			const double r   = std::sqrt(-2.0 * std::log((bits[2*j] + 1.0) * (1.0/4294967296.0)));
+			const double phi = 6.283185307179586 * (bits[2*j+1] * (1.0/4294967296.0));
+			o[2*j]   = (float)(r * std::cos(phi) * sigma) + mean;
+			o[2*j+1] = (float)(r * std::sin(phi) * sigma) + mean;
+		}
+	}
+
+	//odd count: the last one the usual way (which also leaves the spare in the stream)
+	if (count % 2 == 1) out[count-1] = GetRandomGauss(mean,sigma, stream);
+}
+
+
+void FillRandomPoisson(float* out, const size_t count,
+                       const float mean, rndStream& stream)
+{
+	if (mean <= 0)
+	{
+		std::fill(out, out+count, 0.f);
+		return;
+	}
+
+	if (mean >= 10)
+	{
+		for (size_t i = 0; i < count; ++i)
+			out[i] = (float)GetRandomPoisson(mean, stream);
+		return;
+	}
+
+	//CDF of the distribution in the 32-bit fixed point, up to where it becomes 1
+	std::vector<uint64_t> cdf;
+	double p = std::exp(-(double)mean), sum = p;
+	for (unsigned int k = 1; sum*4294967296.0 < 4294967295.0 && k < 256; ++k)
+	{
+		cdf.push_back((uint64_t)(sum*4294967296.0));
+		p *= mean / (double)k;
+		sum += p;
+	}
+	cdf.push_back((uint64_t)1 << 32);
+
+	uint32_t bits[fillChunk];
+	for (size_t i = 0; i < count; i += fillChunk)
+	{
+		const size_t n = std::min(fillChunk, count-i);
+		stream.nextBits(bits, n);
+
+		float* const o = out+i;
+		for (size_t j = 0; j < n; ++j)
+		{
+			//linear search is the fastest here: small means have short CDFs
+			//and most of the variates are found among the first few items
+			unsigned int k = 0;
+			while (bits[j] >= cdf[k]) ++k;
+			o[j] = (float)k;
+		}
+	}
+}
+
+
+void FillRandomPoisson(float* out, const float* means, const size_t count,
+                       rndStream& stream)
+{
+	for (size_t i = 0; i < count; ++i)
+		out[i] = (float)GetRandomPoisson(means[i], stream);
+}
@@ -1,6 +1,8 @@
 #ifndef RNDGENERATORS_H
 #define RNDGENERATORS_H
 
+#include <cstdint>
+#include <vector>
 #include <gsl/gsl_rng.h>
 
 typedef struct rndGeneratorHandle_t
@@ -47,7 +49,8 @@ typedef struct rndGeneratorHandle_t
 float GetRandomGauss(const float mean, const float sigma, rndGeneratorHandle& rngHandle);
 
 /** The same as GetRandomGauss(...,rngHandle) but default handle is used.
-    This may be used in non-critical applications. */
+    This may be used in non-critical applications. Every thread has its own
+    default handle (and so every FO, even if FOs run as threads). */
 float GetRandomGauss(const float mean, const float sigma);
 
 /**
@@ -94,4 +97,173 @@ unsigned int GetRandomPoisson(const float mean, rndGeneratorHandle& rngHandle);
 /** The same as GetRandomPoisson(...,rngHandle) but default handle is used.
     This may be used in non-critical applications. */
 unsigned int GetRandomPoisson(const float mean);
+
+/**
+ * Exports the complete state of the generator behind the given handle
+ * (incl. the handle's own counters) into the \e state buffer, from which
+ * the generator can be later restored with SetRandomGeneratorState(),
+ * e.g., when the simulation is checkpointed and restarted.
+ *
+ * \param[in]  rngHandle	reference on the generator
+ * \param[out] state    	buffer that is resized and filled
+ */
+void GetRandomGeneratorState(const rndGeneratorHandle& rngHandle, std::vector<char>& state);
+
+/**
+ * Restores the generator behind the given handle from the \e state buffer
+ * that was filled by GetRandomGeneratorState(). The generator continues
+ * exactly with the same sequence of random numbers as the exported one would.
+ * Throws if the state was exported from a different type of generator.
+ */
+void SetRandomGeneratorState(rndGeneratorHandle& rngHandle, const std::vector<char>& state);
+
+/** The same as GetRandomGeneratorState(rngHandle,...) but default handle
+    (of the calling thread) is used. */
+void GetRandomGeneratorState(std::vector<char>& state);
+
+/** The same as SetRandomGeneratorState(rngHandle,...) but default handle
+    (of the calling thread) is used. */
+void SetRandomGeneratorState(const std::vector<char>& state);
+
+
+/**
+ * Counter-based random generator (Philox4x32-10, Salmon et al., SC'11): the n-th
+ * random number of a stream is a pure function of the global seed, the stream's
+ * key (agent ID, simulation round, purpose) and the n. Unlike with the rndGeneratorHandle,
+ * there is no shared (global) state and no seeding from the clock, so the numbers
+ * do not depend on which FO or thread, or in which order, asks for them, and
+ * simulations become reproducible (given the same seed, see SetRandomStreamsSeed()).
+ *
+ * A stream is cheap to create (no allocations) and is meant to be created
+ * on the spot, e.g., with AbstractAgent::getRandomStream(), and thrown away.
+ */
+class rndStream
+{
+public:
+	/** the stream of the global seed, see SetRandomStreamsSeed() */
+	rndStream(const int agentID, const int round, const int purpose);
+
+	/** the stream of the given seed */
+	rndStream(const uint64_t seed, const int agentID, const int round, const int purpose);
+
+	/** returns next 32 random bits */
+	uint32_t nextBits(void)
+	{
+		if (used == 4)
+		{
+			refill();
+			used = 0;
+		}
+		return block[used++];
+	}
+
+	/** fills the 'out' with the next 'count' random bits, it gives the same numbers
+	    as if nextBits() was called 'count' times but many blocks are computed at once */
+	void nextBits(uint32_t* out, size_t count);
+
+	/** returns a random number from the interval [0,1) */
+	double nextUniform(void)
+	{ return nextBits() * (1.0/4294967296.0); }
+
+	/** returns a random number from the interval (0,1] */
+	double nextUniformNonZero(void)
+	{ return (nextBits() + 1.0) * (1.0/4294967296.0); }
+
+	/** the Philox4x32-10 bijection, transforms the 'counter' given the 'key' */
+	static void philox(const uint32_t key[2], uint32_t counter[4]);
+
+	/** the Philox4x32-10 bijection of 'lanes' counters at once, the i-th counter
+	    is { c0[i],c1[i],c2[i],c3[i] }; the loops are laid out to be vectorised */
+	static void philox(const uint32_t key[2],
+	                   uint32_t* c0, uint32_t* c1, uint32_t* c2, uint32_t* c3,
+	                   const size_t lanes);
+
+protected:
+	uint32_t key[2];
+	/** counter: index of the block, and the stream's purpose, agent ID and round */
+	uint32_t counter[4];
+
+	/** the current block of random bits, and how many of them are used already */
+	uint32_t block[4];
+	int used = 4;
+
+	/** second of the Gaussian pair from the last Box-Muller transform, if hasSpareGauss */
+	double spareGauss = 0;
+	bool hasSpareGauss = false;
+
+	void refill(void);
+
+	friend float GetRandomGauss(const float mean, const float sigma, rndStream& stream);
+	friend void FillRandomGauss(float* out, const size_t count,
+	                            const float mean, const float sigma, rndStream& stream);
+};
+
+/**
+ * Purposes of the rndStreams that belong to no agent (e.g., of the image synthesis).
+ * They are all negative, whereas agents' streams may use only non-negative purposes
+ * (see AbstractAgent::getRandomStream()), so that the two kinds of streams never draw
+ * the same numbers; the agentID and round of such streams are thus free to index,
+ * e.g., the chunks of an image and the images.
+ */
+enum e_nonAgentStreamPurposes
+{
+	//FiloGen PhaseIII noise: agentID = chunk of the image, round = image
+	phaseIII_excessNoiseFactor = -1,
+	phaseIII_photonNoise       = -2,
+	phaseIII_SKIP              = -3,
+	phaseIII_darkCurrent       = -4,
+	phaseIII_readoutNoise      = -5,
+
+	//FiloGen PhaseIII background: round = background
+	phaseIII_background        = -6,
+
+	//MitoGen final preview noise: agentID = chunk of the image, round = image
+	finalPreview_photonNoise   = -7,
+	finalPreview_darkCurrent   = -8,
+	finalPreview_readoutNoise  = -9,
+
+	//tables of the PerlinNoiseGenerator(seed), and of the perlin.cpp's init()
+	perlinNoiseTables          = -10
+};
+
+/** Sets the seed from which all rndStreams are derived, all FOs (and the Direktor)
+    must use the same, the simulation sets it from SceneControls::Constants::randomSeed
+    (in the Direktor's c'tor and after Scenario::initializeScene() in the Direktor and FOs);
+    when FOs run as threads of one process, the seed is set before the FO threads start. */
+void SetRandomStreamsSeed(const uint64_t seed);
+
+/** Returns the seed that was set with SetRandomStreamsSeed(), it is 0 by default. */
+uint64_t GetRandomStreamsSeed(void);
+
+/** The same as GetRandomGauss(...,rngHandle) but the counter-based stream is used. */
+float GetRandomGauss(const float mean, const float sigma, rndStream& stream);
+
+/** The same as GetRandomUniform(...,rngHandle) but the counter-based stream is used. */
+float GetRandomUniform(const float A, const float B, rndStream& stream);
+
+/** The same as GetRandomPoisson(...,rngHandle) but the counter-based stream is used.
+    Small means are served with the multiplication method, larger with the
+    transformed rejection with squeeze (PTRS, Hormann 1993). */
+unsigned int GetRandomPoisson(const float mean, rndStream& stream);
+
+
+/** Batched variants of the above: they fill the whole buffer 'out' with 'count'
+    variates at once, which is much faster than drawing them one by one (for which
+    reason they exist only for the counter-based streams). */
+void FillRandomUniform(float* out, const size_t count,
+                       const float A, const float B, rndStream& stream);
+
+/** Box-Muller on pairs of uniforms drawn at once, see FillRandomUniform(). */
+void FillRandomGauss(float* out, const size_t count,
+                     const float mean, const float sigma, rndStream& stream);
+
+/** Poisson variates of the same 'mean', small means (below 10) are served with
+    the inversion of the precomputed CDF (one uniform per variate), larger means
+    with the PTRS, see FillRandomUniform(). */
+void FillRandomPoisson(float* out, const size_t count,
+                       const float mean, rndStream& stream);
+
+/** Poisson variates of the individual 'means[i]', see FillRandomUniform(). */
+void FillRandomPoisson(float* out, const float* means, const size_t count,
+                       rndStream& stream);
 #endif
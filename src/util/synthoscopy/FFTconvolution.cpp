@@ -0,0 +1,423 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <i3d/transform.h>
+#include "../report.h"
+#include "FFTconvolution.h"
+#include "parallel.h"
+
+typedef FFTplan::cplx cplx;
+
+/** complex multiplication without the checks for infinities
+    that std::complex does (and which prevent vectorisation) */
+static inline cplx mul(const cplx a, const cplx b)
+{
+	return cplx(a.real()*b.real() - a.imag()*b.imag(),
+	            a.real()*b.imag() + a.imag()*b.real());
+}
+
+FFTplan::FFTplan(const size_t _n)
+	: n(_n)
+{
+	if (n == 0 || niceSize(n) != n)
+		throw ERROR_REPORT("FFT length " << n << " is not a product of 2, 3 and 5");
+
+	//factorize, the radix 4 first as it is the cheapest per item
+	size_t rest = n;
+	std::vector<size_t> radices;
+	while (rest % 4 == 0) { radices.push_back(4); rest /= 4; }
+	for (size_t r : { (size_t)2, (size_t)3, (size_t)5 })
+		while (rest % r == 0) { radices.push_back(r); rest /= r; }
+
+	size_t len = n;
+	for (size_t r : radices)
+	{
+		stages.emplace_back();
+		Stage& s = stages.back();
+		s.radix = r;
+		s.m = len / r;
+		s.twiddles.resize(len);
+		for (size_t p = 0; p < s.m; ++p)
+			for (size_t k = 0; k < r; ++k)
+			{
+				const double a = -2.0*M_PI * (double)(p*k) / (double)len;
+				s.twiddles[p*r + k] = cplx((float)std::cos(a), (float)std::sin(a));
+			}
+		len = s.m;
+	}
+}
+
+
+size_t FFTplan::niceSize(size_t n)
+{
+	if (n < 1) n = 1;
+	while (true)
+	{
+		size_t rest = n;
+		for (size_t r : { (size_t)2, (size_t)3, (size_t)5 })
+			while (rest % r == 0) rest /= r;
+		if (rest == 1) return n;
+		++n;
+	}
+}
+
+
+const FFTplan& FFTplan::get(const size_t n)
+{
+	static std::mutex lock;
+	static std::map<size_t, std::unique_ptr<FFTplan> > plans;
+
+	std::lock_guard<std::mutex> guard(lock);
+	std::unique_ptr<FFTplan>& plan = plans[n];
+	if (!plan) plan.reset(new FFTplan(n));
+	return *plan;
+}
+
+
+void FFTplan::transform(cplx* data, cplx* work, const size_t batch, const bool inverse) const
+{
+	cplx* in  = data;
+	cplx* out = work;
+	size_t s  = batch;
+
+	//exp(-2*pi*i/3) and exp(-2*pi*i/5) powers for the generic butterflies
+	const float sgn = inverse ? +1.f : -1.f;
+	cplx roots[5];
+
+	for (const Stage& st : stages)
+	{
+		const size_t r = st.radix, m = st.m;
+		for (size_t k = 0; k < r; ++k)
+		{
+			const double a = sgn * 2.0*M_PI * (double)k / (double)r;
+			roots[k] = cplx((float)std::cos(a), (float)std::sin(a));
+		}
+
+		for (size_t p = 0; p < m; ++p)
+		{
+			const cplx* const tw = st.twiddles.data() + p*r;
+			cplx w[5];
+			for (size_t k = 0; k < r; ++k) w[k] = inverse ? std::conj(tw[k]) : tw[k];
+
+			const cplx* const src = in  + s*p;
+			cplx* const dst       = out + s*r*p;
+
+			if (r == 2)
+			{
+				for (size_t q = 0; q < s; ++q)
+				{
+					const cplx a0 = src[q], a1 = src[q + s*m];
+					dst[q]   = a0 + a1;
+					dst[q+s] = mul(a0 - a1, w[1]);
+				}
+			}
+			else if (r == 4)
+			{
+				for (size_t q = 0; q < s; ++q)
+				{
+					const cplx a0 = src[q],       a1 = src[q + s*m];
+					const cplx a2 = src[q + 2*s*m], a3 = src[q + 3*s*m];
+					const cplx t0 = a0 + a2, t1 = a0 - a2;
+					const cplx t2 = a1 + a3;
+					//(a1 - a3) * (-i), or * (+i) for the inverse
+					const cplx d  = a1 - a3;
+					const cplx t3 = inverse ? cplx(-d.imag(), d.real()) : cplx(d.imag(), -d.real());
+					dst[q]     =  t0 + t2;
+					dst[q+s]   = mul(t1 + t3, w[1]);
+					dst[q+2*s] = mul(t0 - t2, w[2]);
+					dst[q+3*s] = mul(t1 - t3, w[3]);
+				}
+			}
+			else
+			{
+				for (size_t q = 0; q < s; ++q)
+				{
+					cplx a[5];
+					for (size_t j = 0; j < r; ++j) a[j] = src[q + j*s*m];
+					for (size_t k = 0; k < r; ++k)
+					{
+						cplx sum = a[0];
+						for (size_t j = 1; j < r; ++j) sum += mul(a[j], roots[(j*k) % r]);
+						dst[q + k*s] = mul(sum, w[k]);
+					}
+				}
+			}
+		}
+
+		s *= r;
+		std::swap(in,out);
+	}
+
+	if (in != data) std::memcpy((void*)data, (const void*)in, batch*n*sizeof(cplx));
+}
+
+
+// ------------------------------------------------------------------------------
+namespace
+{
+	/// how many columns are transformed at once along y and z
+	const size_t columnsBatch = 16;
+
+	/** transforms along x the lines [y0,y1) x [z0,z1) of the volume of the size 'sz' */
+	void transformX(cplx* d, const i3d::Vector3d<size_t>& sz,
+	                const size_t y0, const size_t y1, const size_t z0, const size_t z1,
+	                const bool inverse)
+	{
+		const FFTplan& plan = FFTplan::get(sz.x);
+		std::vector<cplx> work(sz.x);
+		for (size_t z = z0; z < z1; ++z)
+			for (size_t y = y0; y < y1; ++y)
+				plan.transform(d + (z*sz.y + y)*sz.x, work.data(), 1, inverse);
+	}
+
+	/** transforms along y the columns of the slices [z0,z1) */
+	void transformY(cplx* d, const i3d::Vector3d<size_t>& sz,
+	                const size_t z0, const size_t z1, const bool inverse)
+	{
+		const FFTplan& plan = FFTplan::get(sz.y);
+		std::vector<cplx> buf(columnsBatch*sz.y), work(columnsBatch*sz.y);
+		for (size_t z = z0; z < z1; ++z)
+			for (size_t x0 = 0; x0 < sz.x; x0 += columnsBatch)
+			{
+				const size_t b = std::min(columnsBatch, sz.x-x0);
+				cplx* const slice = d + z*sz.y*sz.x + x0;
+
+				for (size_t y = 0; y < sz.y; ++y)
+					std::copy(slice + y*sz.x, slice + y*sz.x + b, buf.data() + y*b);
+				plan.transform(buf.data(), work.data(), b, inverse);
+				for (size_t y = 0; y < sz.y; ++y)
+					std::copy(buf.data() + y*b, buf.data() + (y+1)*b, slice + y*sz.x);
+			}
+	}
+
+	/** transforms along z all columns of the volume */
+	void transformZ(cplx* d, const i3d::Vector3d<size_t>& sz, const bool inverse)
+	{
+		if (sz.z == 1) return;
+
+		const FFTplan& plan = FFTplan::get(sz.z);
+		const size_t sliceSize = sz.x*sz.y;
+		std::vector<cplx> buf(columnsBatch*sz.z), work(columnsBatch*sz.z);
+		for (size_t y = 0; y < sz.y; ++y)
+			for (size_t x0 = 0; x0 < sz.x; x0 += columnsBatch)
+			{
+				const size_t b = std::min(columnsBatch, sz.x-x0);
+				cplx* const row = d + y*sz.x + x0;
+
+				for (size_t z = 0; z < sz.z; ++z)
+					std::copy(row + z*sliceSize, row + z*sliceSize + b, buf.data() + z*b);
+				plan.transform(buf.data(), work.data(), b, inverse);
+				for (size_t z = 0; z < sz.z; ++z)
+					std::copy(buf.data() + z*b, buf.data() + (z+1)*b, row + z*sliceSize);
+			}
+	}
+
+	/** FNV-1a over the PSF's voxels */
+	uint64_t hashPSF(const i3d::Image3d<float>& psf)
+	{
+		uint64_t h = 14695981039346656037ull;
+		const unsigned char* const bytes = (const unsigned char*)psf.GetFirstVoxelAddr();
+		const size_t size = psf.GetImageSize()*sizeof(float);
+		for (size_t i = 0; i < size; ++i) h = (h ^ bytes[i]) * 1099511628211ull;
+		return h;
+	}
+}
+
+
+PSFspectrum::PSFspectrum(const i3d::Image3d<float>& psf, const i3d::Vector3d<size_t>& _tileSize)
+	: psfSize(psf.GetSize()), tileSize(_tileSize)
+{
+	const i3d::Vector3d<size_t>& k = psfSize;
+	paddedSize.x = FFTplan::niceSize(tileSize.x + k.x - 1);
+	paddedSize.y = FFTplan::niceSize(tileSize.y + k.y - 1);
+	paddedSize.z = FFTplan::niceSize(tileSize.z + k.z - 1);
+	DEBUG_REPORT("FFT size: " << paddedSize.x << " x " << paddedSize.y << " x " << paddedSize.z);
+
+	//the PSF with its centre moved (wrapped around) to the origin
+	spectrum.assign(paddedSize.x*paddedSize.y*paddedSize.z, cplx(0.f,0.f));
+	const float norm = 1.f / (float)spectrum.size();
+	const float* v = psf.GetFirstVoxelAddr();
+	for (size_t z = 0; z < k.z; ++z)
+	for (size_t y = 0; y < k.y; ++y)
+	for (size_t x = 0; x < k.x; ++x, ++v)
+	{
+		const size_t px = (x + paddedSize.x - k.x/2) % paddedSize.x;
+		const size_t py = (y + paddedSize.y - k.y/2) % paddedSize.y;
+		const size_t pz = (z + paddedSize.z - k.z/2) % paddedSize.z;
+		spectrum[(pz*paddedSize.y + py)*paddedSize.x + px] = cplx(*v * norm, 0.f);
+	}
+
+	transformX(spectrum.data(), paddedSize, 0,paddedSize.y, 0,paddedSize.z, false);
+	transformY(spectrum.data(), paddedSize, 0,paddedSize.z, false);
+	transformZ(spectrum.data(), paddedSize, false);
+}
+
+
+std::shared_ptr<const i3d::Image3d<float> > PSFspectrum::getResampledPSF(const i3d::Image3d<float>& psf,
+                                                                          const i3d::Vector3d<float>& imgRes)
+{
+	typedef std::tuple<uint64_t, size_t,size_t,size_t, float,float,float, float,float,float> Key;
+
+	static std::mutex lock;
+	static std::map<Key, std::shared_ptr<const i3d::Image3d<float> > > psfs;
+
+	const i3d::Vector3d<float> psfRes = psf.GetResolution().GetRes();
+	const Key key(hashPSF(psf), psf.GetSizeX(),psf.GetSizeY(),psf.GetSizeZ(),
+	              psfRes.x,psfRes.y,psfRes.z, imgRes.x,imgRes.y,imgRes.z);
+
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<const i3d::Image3d<float> >& p = psfs[key];
+	if (!p)
+	{
+		std::shared_ptr<i3d::Image3d<float> > psfII = std::make_shared<i3d::Image3d<float> >(psf);
+		if (psfRes != imgRes)
+		{
+			DEBUG_REPORT("resampling psf");
+			i3d::ResampleToDesiredResolution(*psfII, imgRes, i3d::LANCZOS);
+		}
+		p = psfII;
+	}
+	return p;
+}
+
+
+std::shared_ptr<const PSFspectrum> PSFspectrum::get(const std::shared_ptr<const i3d::Image3d<float> >& psf,
+                                                    const i3d::Vector3d<size_t>& tileSize)
+{
+	//the cached spectra hold no reference on the PSF, the PSFs are however
+	//kept by the getResampledPSF() and so their addresses are not reused
+	typedef std::tuple<const i3d::Image3d<float>*, size_t,size_t,size_t> Key;
+
+	static std::mutex lock;
+	static std::map<Key, std::shared_ptr<const PSFspectrum> > spectra;
+
+	const Key key(psf.get(), tileSize.x,tileSize.y,tileSize.z);
+
+	std::lock_guard<std::mutex> guard(lock);
+	std::shared_ptr<const PSFspectrum>& s = spectra[key];
+	if (!s) s.reset(new PSFspectrum(*psf, tileSize));
+	return s;
+}
+
+
+void FFTConvolution(i3d::Image3d<float>& img, const i3d::Image3d<float>& psf,
+                    const int threads)
+{
+	const i3d::Vector3d<size_t> n = img.GetSize();
+	std::shared_ptr<const i3d::Image3d<float> > kernel
+		= PSFspectrum::getResampledPSF(psf, img.GetResolution().GetRes());
+	const i3d::Vector3d<size_t> k = kernel->GetSize();
+
+	//slabs along y or z: every worker should get one but they must be at least
+	//as thick as the PSF so that the halos reach only into the neighbouring slabs
+	const size_t tY = std::min(n.y, std::max(k.y, (n.y+(size_t)threads-1) / (size_t)threads));
+	const size_t tZ = std::min(n.z, std::max(k.z, (n.z+(size_t)threads-1) / (size_t)threads));
+	const size_t slabsY = (n.y+tY-1) / tY;
+	const size_t slabsZ = (n.z+tZ-1) / tZ;
+	const bool alongZ = slabsZ >= slabsY;
+	const size_t slabs = alongZ ? slabsZ : slabsY;
+
+	i3d::Vector3d<size_t> tile(n);
+	if (alongZ) tile.z = tZ; else tile.y = tY;
+	std::shared_ptr<const PSFspectrum> spectrum = PSFspectrum::get(kernel, tile);
+	const i3d::Vector3d<size_t>& p = spectrum->paddedSize;
+	DEBUG_REPORT("convolving in " << slabs << " slabs along " << (alongZ ? "z" : "y"));
+
+	//the halo before the slab's (or image's) beginning
+	const i3d::Vector3d<size_t> h(k.x-1-k.x/2, k.y-1-k.y/2, k.z-1-k.z/2);
+
+	//bookkeeping of the in-place writing: results of slabs wait
+	//until both neighbouring slabs have read their inputs
+	std::mutex lock;
+	std::vector<char> inputRead(slabs, 0);
+	std::map<size_t, std::vector<float> > pending;
+
+	float* const imgData = img.GetFirstVoxelAddr();
+	auto slabRange = [&](const size_t s, size_t& y0, size_t& y1, size_t& z0, size_t& z1)
+	{
+		y0 = 0; y1 = n.y; z0 = 0; z1 = n.z;
+		if (alongZ) { z0 = s*tZ; z1 = std::min(z0+tZ, n.z); }
+		else        { y0 = s*tY; y1 = std::min(y0+tY, n.y); }
+	};
+
+	//must be called under the lock
+	auto flushPending = [&]()
+	{
+		auto it = pending.begin();
+		while (it != pending.end())
+		{
+			const size_t s = it->first;
+			if ((s > 0 && !inputRead[s-1]) || (s+1 < slabs && !inputRead[s+1])) { ++it; continue; }
+
+			size_t y0,y1,z0,z1;
+			slabRange(s, y0,y1,z0,z1);
+			const float* r = it->second.data();
+			for (size_t z = z0; z < z1; ++z)
+				for (size_t y = y0; y < y1; ++y, r += n.x)
+					std::copy(r, r+n.x, imgData + (z*n.y + y)*n.x);
+			it = pending.erase(it);
+		}
+	};
+
+	std::vector< std::vector<cplx> > buffers((size_t)threads);
+	parallelTasks(slabs, threads, [&](const size_t s, const int w)
+	{
+		size_t y0,y1,z0,z1;
+		slabRange(s, y0,y1,z0,z1);
+
+		std::vector<cplx>& data = buffers[(size_t)w];
+		data.assign(p.x*p.y*p.z, cplx(0.f,0.f));
+
+		//the slab with its halos, positioned at the origin of the transform;
+		//what is outside the image stays zero
+		const long ox = -(long)h.x, oy = (long)y0 - (long)h.y, oz = (long)z0 - (long)h.z;
+		const i3d::Vector3d<size_t> box(tile.x+k.x-1, tile.y+k.y-1, tile.z+k.z-1);
+		for (size_t zz = 0; zz < box.z; ++zz)
+		{
+			const long z = oz + (long)zz;
+			if (z < 0 || z >= (long)n.z) continue;
+			for (size_t yy = 0; yy < box.y; ++yy)
+			{
+				const long y = oy + (long)yy;
+				if (y < 0 || y >= (long)n.y) continue;
+				const float* src = imgData + ((size_t)z*n.y + (size_t)y)*n.x;
+				cplx* dst = data.data() + (zz*p.y + yy)*p.x - ox;
+				for (size_t x = 0; x < n.x; ++x) dst[x] = cplx(src[x], 0.f);
+			}
+		}
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			inputRead[s] = 1;
+			flushPending();
+		}
+
+		//forward: only where the input is, inverse: only what becomes the result
+		transformX(data.data(), p, 0,box.y, 0,box.z, false);
+		transformY(data.data(), p, 0,box.z, false);
+		transformZ(data.data(), p, false);
+
+		const cplx* const sp = spectrum->spectrum.data();
+		for (size_t i = 0; i < data.size(); ++i) data[i] = mul(data[i], sp[i]);
+
+		transformZ(data.data(), p, true);
+		transformY(data.data(), p, h.z, h.z+z1-z0, true);
+		transformX(data.data(), p, h.y, h.y+y1-y0, h.z, h.z+z1-z0, true);
+
+		std::vector<float> result(n.x*(y1-y0)*(z1-z0));
+		float* r = result.data();
+		for (size_t z = 0; z < z1-z0; ++z)
+			for (size_t y = 0; y < y1-y0; ++y)
+			{
+				const cplx* d = data.data() + ((z+h.z)*p.y + y+h.y)*p.x + h.x;
+				for (size_t x = 0; x < n.x; ++x) *r++ = d[x].real();
+			}
+
+		std::lock_guard<std::mutex> guard(lock);
+		pending[s] = std::move(result);
+		flushPending();
+	});
+}
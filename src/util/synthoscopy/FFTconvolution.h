@@ -0,0 +1,105 @@
+#ifndef UTIL_SYNTHOSCOPY_FFTCONVOLUTION_H
+#define UTIL_SYNTHOSCOPY_FFTCONVOLUTION_H
+
+#include <complex>
+#include <memory>
+#include <vector>
+#include <i3d/image3d.h>
+
+/**
+ * Complex 1D FFT of a fixed length that is a product of 2, 3 and 5
+ * (mixed-radix Stockham autosort, decimation in frequency). The plan holds
+ * the factorization of the length and the twiddle factors of all stages.
+ *
+ * A plan can transform several interleaved sequences at once (the 'batch'),
+ * which is how the columns of 3D images are transformed without transposing.
+ */
+class FFTplan
+{
+public:
+	typedef std::complex<float> cplx;
+
+	explicit FFTplan(const size_t n);
+
+	size_t size() const
+	{ return n; }
+
+	/** transforms, in place, 'batch' sequences held interleaved in the 'data', the i-th
+	    item of the q-th sequence is data[q + batch*i]; the 'work' must hold batch*size()
+	    items; the inverse transform is not normalized (the result is size() times larger) */
+	void transform(cplx* data, cplx* work, const size_t batch, const bool inverse) const;
+
+	/** returns the smallest length, not shorter than 'n', for which plans can be made */
+	static size_t niceSize(size_t n);
+
+	/** returns the plan for the length 'n', plans are created on the first
+	    request and are kept for the rest of the run; this is thread-safe */
+	static const FFTplan& get(const size_t n);
+
+protected:
+	const size_t n;
+
+	struct Stage
+	{
+		size_t radix;
+		/** length of the sub-sequences after this stage */
+		size_t m;
+		/** twiddles[p*radix + k] = exp(-2*pi*i * p*k / (m*radix)) */
+		std::vector<cplx> twiddles;
+	};
+	std::vector<Stage> stages;
+};
+
+
+/**
+ * The spectrum of a PSF prepared for convolving image tiles of a particular size,
+ * see FFTConvolution(). Spectra are expensive (the PSF is resampled and transformed)
+ * and so they are computed once and shared for the rest of the run, see get().
+ */
+class PSFspectrum
+{
+public:
+	/** returns the 'psf' resampled to the 'imgRes' (or the 'psf' itself if it is
+	    of that resolution already), resampling happens only on the first request
+	    for the same PSF content and resolutions */
+	static std::shared_ptr<const i3d::Image3d<float> > getResampledPSF(const i3d::Image3d<float>& psf,
+	                                                                   const i3d::Vector3d<float>& imgRes);
+
+	/** returns the spectrum of the 'psf' for the convolution of tiles of the 'tileSize'
+	    (without their halos); the spectrum is computed only on the first request for
+	    the same 'psf' (obtained from getResampledPSF()) and tile size */
+	static std::shared_ptr<const PSFspectrum> get(const std::shared_ptr<const i3d::Image3d<float> >& psf,
+	                                              const i3d::Vector3d<size_t>& tileSize);
+
+	/** the size of the PSF (after resampling) */
+	i3d::Vector3d<size_t> psfSize;
+
+	/** the size of the tiles this spectrum is for */
+	i3d::Vector3d<size_t> tileSize;
+
+	/** the size of the transforms: at least the tile with its halos (tileSize+psfSize-1) */
+	i3d::Vector3d<size_t> paddedSize;
+
+	/** the spectrum itself (including the normalization of the inverse transform),
+	    x-coordinate is the fastest */
+	std::vector<FFTplan::cplx> spectrum;
+
+protected:
+	PSFspectrum(const i3d::Image3d<float>& psf, const i3d::Vector3d<size_t>& tileSize);
+};
+
+
+/**
+ * Convolves, in place, the 'img' with the 'psf' (whose centre is its middle voxel) resampled
+ * to the resolution of the 'img', voxels outside the 'img' are considered zero; this is
+ * what i3d::Convolution() does, only computed via the FFT in O(n log n).
+ *
+ * The image is processed in slabs (along y or z, whichever gives more of them) that are
+ * convolved, together with their PSF-sized halos, independently by up to 'threads' workers
+ * (overlap-save). The result of a slab is written back into the 'img' as soon as both neighbouring
+ * slabs have read their halos, the memory needed is thus about the size of the transform of
+ * one slab per worker, regardless of the size of the image.
+ */
+void FFTConvolution(i3d::Image3d<float>& img, const i3d::Image3d<float>& psf,
+                    const int threads);
+#endif
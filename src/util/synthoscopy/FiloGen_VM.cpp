@@ -33,13 +33,17 @@
 #include <stdio.h>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
+#include <memory>
+#include <vector>
 #include <i3d/image3d.h>
 #include <i3d/transform.h>
 #include <i3d/filters.h>
-#include <i3d/convolution.h>
 #include "../rnd_generators.h"
 #include "../texture/texture.h"
 #include "../report.h"
+#include "FFTconvolution.h"
+#include "parallel.h"
 #include "FiloGen_VM.h"
 
 ///------------------------------------------------------------------------
@@ -57,6 +61,8 @@ void PhaseII(i3d::Image3d<float>& fimg,
 	// note: the phantom image is already of the float
 	// data type (to enable convolution with PSF)
 
+	const int threads = getSynthoscopyThreads();
+
 	// perform intensity scaling of the phantom by the given factor
 	for (size_t i = 0; i < fimg.GetImageSize(); ++i)
 	{
@@ -64,73 +70,59 @@ void PhaseII(i3d::Image3d<float>& fimg,
 	}
 
 	// If the PSF has different resolution from the processed image,
-	// resampling is required.
-	i3d::Vector3d<float>
-			  res_psf = psf.GetResolution().GetRes(),
-			  res_fimg = fimg.GetResolution().GetRes();
-
-	DEBUG_REPORT("res img: " << res_fimg);
-	DEBUG_REPORT("res psf: " << res_psf);
-
-	i3d::Image3d<float> psfII(psf);
-
-	if (res_fimg != res_psf)
-	{
-		DEBUG_REPORT("resampling psf");
-		i3d::ResampleToDesiredResolution(psfII, res_fimg, i3d::LANCZOS);
-	}
-
+	// resampling is required (which the FFTConvolution does, only once per run).
+	DEBUG_REPORT("res img: " << fimg.GetResolution().GetRes());
+	DEBUG_REPORT("res psf: " << psf.GetResolution().GetRes());
 	DEBUG_REPORT("image size: " << fimg.GetSize());
-	DEBUG_REPORT("psf size: " << psfII.GetSize());
+	DEBUG_REPORT("psf size: " << psf.GetSize());
 
-	// convolution with real confocal PSF
-	i3d::Image3d<float> blurred_texture;
-	i3d::Convolution<double,float,float>(fimg, psfII, blurred_texture);
+	// convolution with real confocal PSF, via FFT in slabs, in place
+	FFTConvolution(fimg, psf, threads);
 
 	DEBUG_REPORT("convolution done.");
 
 	// Let us add the uneven illumination (with its brightest loci in the cell
 	// centre, which happens to be in the image centre)
-	const int xC=(int)(blurred_texture.GetSizeX()/2);
-	const int yC=(int)(blurred_texture.GetSizeY()/2);
+	const int xC=(int)(fimg.GetSizeX()/2);
+	const int yC=(int)(fimg.GetSizeY()/2);
 	// max distance
 	const float maxDist = SQR((float)xC) + SQR((float)yC);
 
-	float* f=fimg.GetFirstVoxelAddr();
-	float* p=blurred_texture.GetFirstVoxelAddr();
-	for (int z=0; z < (signed)blurred_texture.GetSizeZ(); ++z)
-		 for (int y=0; y < (signed)blurred_texture.GetSizeY(); ++y)
-			  for (int x=0; x < (signed)blurred_texture.GetSizeX(); ++x, ++f, ++p)
+	const size_t sliceSize = fimg.GetSizeX()*fimg.GetSizeY();
+	parallelTasks(fimg.GetSizeZ(), threads, [&](const size_t z, const int)
+	{
+		float* f=fimg.GetFirstVoxelAddr() + z*sliceSize;
+		for (int y=0; y < (signed)fimg.GetSizeY(); ++y)
+			  for (int x=0; x < (signed)fimg.GetSizeX(); ++x, ++f)
 			  {
 				// background signal (inverted parabola)
 				float distSq =
 						  -(SQR((float)(x-xC)) + SQR((float)(y-yC)))/maxDist + 1.f;
-				*f = *p * distSq;
+				*f *= distSq;
 			  }
+	});
 
-	//fimg = blurred_texture;
 	DEBUG_REPORT("all done.");
 }
 
 ///------------------------------------------------------------------------
+namespace
+{
 
-const int reseedPeriod = 4000000;
-rndGeneratorHandle rngExcessNoiseFactor(reseedPeriod);
-rndGeneratorHandle rngPhotonNoise(reseedPeriod);
-rndGeneratorHandle rngDarkCurrent(reseedPeriod);
-rndGeneratorHandle rngReadoutNoise(reseedPeriod);
-rndGeneratorHandle rngSKIP(reseedPeriod);
+/// the noise is drawn from the counter-based random streams in chunks of this
+/// many voxels, every chunk has its own streams (keyed by the chunk's index)
+const size_t noiseChunk = 4096;
 
-void PhaseIII(i3d::Image3d<float>& blurred,
-              i3d::Image3d<i3d::GRAY16>& texture)
+/// builds the 'bgNo'-th non-specific background for images like the 'img',
+/// every background gets its own Perlin noise
+void BuildBackground(i3d::Image3d<float>& bgImg, const i3d::Image3d<float>& img, const int bgNo)
 {
-	// NONSPECIFIC BACKGROUND
-	i3d::Image3d<float> bgImg;
-	bgImg.CopyMetaData(blurred);
-	DoPerlin3D(bgImg,10.0,7.0,1.0,10); // very smooth a wide coherent noise
+	bgImg.CopyMetaData(img);
+	rndStream rngBackground(0,bgNo,phaseIII_background);
+	const PerlinNoiseGenerator perlin(rngBackground);
+	DoPerlin3D(bgImg,perlin,10.0,7.0,1.0,10,getSynthoscopyThreads()); // very smooth a wide coherent noise
 
 	DEBUG_REPORT("BG Perlin done.");
-	DEBUG_REPORT("Image contains " << blurred.GetImageSize() << " voxels");
 
 	// reset the maximum and minimum intensity levels of the background
 	// to the expected values
@@ -146,56 +138,191 @@ void PhaseIII(i3d::Image3d<float>& blurred,
 		value = scale*(value - oldMinI) + newMinI;
 	   bgImg.SetVoxel(i, value);
 	}
-	
+}
+
+/// the non-specific background is expensive to build, it is thus built lazily
+/// and re-used for all images of the same size and resolution; with the drift,
+/// it morphs (crossfades) slowly into another background, and that into another...,
+/// the 'bgNo'-th background is reached at the frame bgNo*backgroundDriftFrames;
+/// the cache is keyed only by the size and resolution because these are the only
+/// inputs of the BuildBackground() (its Perlin and intensity parameters are fixed),
+/// shall the latter be made adjustable, they must become a part of the isFor() test
+struct Background
+{
+	i3d::Vector3d<size_t> size;
+	i3d::Vector3d<float> res;
+
+	std::unique_ptr< i3d::Image3d<float> > current, next;
+
+	/// which background is the 'current' one, the 'next' one is the following one
+	int currentNo = 0;
+
+	bool isFor(const i3d::Image3d<float>& img) const
+	{
+		return current && size == img.GetSize() && res == img.GetResolution().GetRes();
+	}
+};
+Background background;
+
+} //end of the anonymous namespace
+
+void PhaseIII(i3d::Image3d<float>& blurred,
+              i3d::Image3d<i3d::GRAY16>& texture,
+              const int frameNo,
+              const int backgroundDriftFrames,
+              const i3d::Image3d<i3d::GRAY16>* mask,
+              mitogen::SNRstats* snr)
+{
+	if (mask != NULL && mask->GetSize() != blurred.GetSize())
+		throw ERROR_REPORT("Phantom and mask images do not match in size.");
+
+	// NONSPECIFIC BACKGROUND
+	// (which is given by the frameNo, and so it does not depend on what was rendered before)
+	const int bgNo = backgroundDriftFrames > 0 ? frameNo / backgroundDriftFrames : 0;
+	if (!background.isFor(blurred) || background.currentNo != bgNo)
+	{
+		if (background.isFor(blurred) && background.next && background.currentNo+1 == bgNo)
+		{
+			// the crossfade has just finished
+			background.current = std::move(background.next);
+		}
+		else
+		{
+			background.size = blurred.GetSize();
+			background.res  = blurred.GetResolution().GetRes();
+			background.current.reset(new i3d::Image3d<float>());
+			BuildBackground(*background.current, blurred, bgNo);
+			background.next.reset();
+		}
+		background.currentNo = bgNo;
+	}
+
+	float bgDrift = 0.f;
+	if (backgroundDriftFrames > 0)
+	{
+		if (!background.next)
+		{
+			background.next.reset(new i3d::Image3d<float>());
+			BuildBackground(*background.next, blurred, bgNo+1);
+		}
+		bgDrift = (float)(frameNo % backgroundDriftFrames) / (float)backgroundDriftFrames;
+	}
+
+	DEBUG_REPORT("Image contains " << blurred.GetImageSize() << " voxels");
+
    // given gain of EMCCD camera
    const int EMCCDgain = 1000;
 
-	float* p=blurred.GetFirstVoxelAddr();
-	for (size_t i=0; i<blurred.GetImageSize(); i++, p++)
+	const size_t imgSize = blurred.GetImageSize();
+	const float* const bg = background.current->GetFirstVoxelAddr();
+	const float* const bgNext = bgDrift > 0 ? background.next->GetFirstVoxelAddr() : bg;
+
+	// buffers of the noise variates of one chunk, for every worker
+	const int threads = getSynthoscopyThreads();
+	struct NoiseBuffers
+	{
+		std::vector<float> ENF, noiseMean, photons, skip, darkPhotons, readout;
+	};
+	std::vector<NoiseBuffers> buffers((size_t)threads);
+
+	// chunks are independent (every has its own random streams)
+	const size_t chunks = (imgSize+noiseChunk-1) / noiseChunk;
+
+	// SNR of every chunk, merged in the order of the chunks afterwards
+	const bool computeSNR = mask != NULL && snr != NULL;
+	std::vector<mitogen::SNRstats> chunkSNRs(computeSNR ? chunks : 0);
+	const i3d::GRAY16* const m = computeSNR ? mask->GetFirstVoxelAddr() : NULL;
+	parallelTasks(chunks, threads, [&](const size_t chunk, const int w)
 	{
+		const size_t c = chunk*noiseChunk;
+		const size_t n = std::min(noiseChunk, imgSize-c);
+		const int chunkNo = (int)chunk;
+		float* const p = blurred.GetFirstVoxelAddr() + c;
+
+		NoiseBuffers& b = buffers[(size_t)w];
+		if (b.ENF.empty())
+		{
+			b.ENF.resize(noiseChunk); b.noiseMean.resize(noiseChunk); b.photons.resize(noiseChunk);
+			b.skip.resize(noiseChunk); b.darkPhotons.resize(noiseChunk); b.readout.resize(noiseChunk);
+		}
+		std::vector<float> &ENF = b.ENF, &noiseMean = b.noiseMean, &photons = b.photons,
+		                   &skip = b.skip, &darkPhotons = b.darkPhotons, &readout = b.readout;
+
 		// shift the signal (simulates non-ideal black background)
 		// ?reflection of medium?
-		*p += bgImg.GetVoxel(i);
+		for (size_t j=0; j < n; ++j)
+		{
+			p[j] += bg[c+j] + bgDrift*(bgNext[c+j] - bg[c+j]);
+			noiseMean[j] = sqrtf(p[j]);
+		}
 
 		// ENF ... Excess Noise Factor (stochasticity of EMCCD gain)
 		// source of information:
 		// https://www.qimaging.com/resources/pdfs/emccd_technote.pdf
-		const float ENF = GetRandomUniform(1.0f, 1.4f, rngExcessNoiseFactor);
+		rndStream rngExcessNoiseFactor(chunkNo,frameNo,phaseIII_excessNoiseFactor);
+		FillRandomUniform(ENF.data(),n, 1.0f, 1.4f, rngExcessNoiseFactor);
 
 		// PHOTON NOISE
 		// uncertainty in the number of incoming photons,
 		// from statistics: shot noise mean = sqrt(signal)
-		const float noiseMean = sqrtf(*p);
-		*p += ENF * ((float)GetRandomPoisson(noiseMean, rngPhotonNoise) - noiseMean);
+		rndStream rngPhotonNoise(chunkNo,frameNo,phaseIII_photonNoise);
+		FillRandomPoisson(photons.data(),noiseMean.data(),n, rngPhotonNoise);
 
 		// avoid strong discretization of intensity histogram due
 		// to the Poisson probability function (aka SKIP)
-		*p += GetRandomUniform(0.0, 1.0, rngSKIP);
-
-		// EMCCD GAIN
-       // amplification of signal (and inevitably also the noise)
-	   *p *= EMCCDgain;
+		rndStream rngSKIP(chunkNo,frameNo,phaseIII_SKIP);
+		FillRandomUniform(skip.data(),n, 0.0f, 1.0f, rngSKIP);
 
 		// DARK CURRENT
 		// constants are parameters of Andor iXon camera provided from vendor:
-		*p += ENF*EMCCDgain*(float)GetRandomPoisson(0.06f, rngDarkCurrent);
-
-		// BASELINE (camera electron level)
-		*p += 400.0f;
+		rndStream rngDarkCurrent(chunkNo,frameNo,phaseIII_darkCurrent);
+		FillRandomPoisson(darkPhotons.data(),n, 0.06f, rngDarkCurrent);
 
 		// READOUT NOISE
 		// variance up to 25.f (old camera on ILBIT)
 		// variance about 1.f (for the new camera on ILBIT)
-		*p += GetRandomGauss(0.0f,1.0f, rngReadoutNoise);
+		rndStream rngReadoutNoise(chunkNo,frameNo,phaseIII_readoutNoise);
+		FillRandomGauss(readout.data(),n, 0.0f,1.0f, rngReadoutNoise);
 
 		// ADC (analogue-digital converter)
 		// ADCgain ... how many electrons correspond one intensity level
 		// ADCoffset ... how many intensity levels are globally added to each pixel
 		const float ADCgain = 28.0f;
-		*p /= ADCgain;
-
 		const float ADCoffset = 400.0f;
-		*p += ADCoffset;
+
+		for (size_t j=0; j < n; ++j)
+		{
+			float v = p[j];
+			v += ENF[j] * (photons[j] - noiseMean[j]);
+			v += skip[j];
+
+			// EMCCD GAIN
+			// amplification of signal (and inevitably also the noise)
+			v *= EMCCDgain;
+
+			v += ENF[j]*EMCCDgain*darkPhotons[j];
+
+			// BASELINE (camera electron level)
+			v += 400.0f;
+
+			v += readout[j];
+
+			v /= ADCgain;
+			p[j] = v + ADCoffset;
+		}
+
+		if (computeSNR)
+		{
+			mitogen::SNRstats& s = chunkSNRs[chunk];
+			for (size_t j=0; j < n; ++j)
+				s.add(std::min(std::max(p[j],0.f),65535.f), m[c+j] != 0);
+		}
+	});
+
+	if (computeSNR)
+	{
+		snr->clear();
+		for (const mitogen::SNRstats& s : chunkSNRs) snr->merge(s);
 	}
 
 	//obtain final GRAY16 image
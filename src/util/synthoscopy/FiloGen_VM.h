@@ -30,6 +30,8 @@
  * Martin Maska <xmaskaa@fi.muni.cz> 2018
  */
 
+#include "SNR.h"
+
 namespace filogen
 {
 
@@ -43,8 +45,20 @@ void PhaseII(i3d::Image3d<float>& fimg,
 //------------------------------------------------------------------------
 // simulation of acquisition device
 //------------------------------------------------------------------------
+// the noise and the non-specific background of an image are given by its
+// frameNo (and not by how many images have been through this function);
+// the background is built only once (for images of the same size and
+// resolution) unless the backgroundDriftFrames is positive, in which
+// case it crossfades into a new one over that many frames;
+// if the mask and snr are given, the SNR of the final image is accumulated
+// into the snr during the noise pass (from the values before their conversion
+// to GRAY16, which may differ by the rounding from the saved texture image)
 void PhaseIII(i3d::Image3d<float>& blurred,
-              i3d::Image3d<i3d::GRAY16>& texture);
+              i3d::Image3d<i3d::GRAY16>& texture,
+              const int frameNo,
+              const int backgroundDriftFrames = 0,
+              const i3d::Image3d<i3d::GRAY16>* mask = NULL,
+              mitogen::SNRstats* snr = NULL);
 
 }
 #endif
@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "parallel.h"
+#include "GaussIIR.h"
+
+namespace
+{
+	/** coefficients of the recursive filter: out[n] = B*in[n] + b1*out[n-1] + b2*out[n-2] + b3*out[n-3] */
+	struct Coefficients
+	{
+		float B, b1, b2, b3;
+
+		explicit Coefficients(const float sigma)
+		{
+			const double s = sigma;
+			const double q = s >= 2.5 ? 0.98711*s - 0.96330
+			                          : 3.97156 - 4.14554*std::sqrt(1.0 - 0.26891*s);
+			const double q2 = q*q, q3 = q2*q;
+
+			const double a0 =  1.57825 + 2.44413*q + 1.4281*q2 + 0.422205*q3;
+			const double a1 =            2.44413*q + 2.85619*q2 + 1.26661*q3;
+			const double a2 =                      -(1.4281*q2 + 1.26661*q3);
+			const double a3 =                                    0.422205*q3;
+
+			b1 = (float)(a1/a0);
+			b2 = (float)(a2/a0);
+			b3 = (float)(a3/a0);
+			B  = 1.f - (b1 + b2 + b3);
+		}
+	};
+
+	/// how many lines along x are filtered at once
+	const size_t linesBatch = 16;
+
+	/**
+	 * Filters 'width' interleaved lines of the length 'len': the i-th item of the
+	 * l-th line is at d[i*stride + l]. The inner loops run over the lines.
+	 * The 'prev' buffer must hold 3*width items.
+	 */
+	void filterLines(float* const d, const size_t len, const size_t width, const size_t stride,
+	                 const Coefficients& c, float* const prev)
+	{
+		float* const p1 = prev;
+		float* const p2 = prev + width;
+		float* const p3 = prev + 2*width;
+
+		//causal pass, starting as if the first voxel were repeated
+		std::copy(d, d+width, p1);
+		std::copy(d, d+width, p2);
+		std::copy(d, d+width, p3);
+		for (size_t i = 0; i < len; ++i)
+		{
+			float* const v = d + i*stride;
+			for (size_t l = 0; l < width; ++l)
+			{
+				const float w = c.B*v[l] + c.b1*p1[l] + c.b2*p2[l] + c.b3*p3[l];
+				p3[l] = p2[l]; p2[l] = p1[l]; p1[l] = w;
+				v[l] = w;
+			}
+		}
+
+		//anti-causal pass, starting as if the last voxel were repeated
+		const float* const last = d + (len-1)*stride;
+		std::copy(last, last+width, p1);
+		std::copy(last, last+width, p2);
+		std::copy(last, last+width, p3);
+		for (size_t i = len; i > 0; --i)
+		{
+			float* const v = d + (i-1)*stride;
+			for (size_t l = 0; l < width; ++l)
+			{
+				const float w = c.B*v[l] + c.b1*p1[l] + c.b2*p2[l] + c.b3*p3[l];
+				p3[l] = p2[l]; p2[l] = p1[l]; p1[l] = w;
+				v[l] = w;
+			}
+		}
+	}
+}
+
+
+void ParallelGaussIIR(i3d::Image3d<float>& img,
+                      const float sigmaX, const float sigmaY, const float sigmaZ,
+                      const int threads)
+{
+	const size_t sx = img.GetSizeX(), sy = img.GetSizeY(), sz = img.GetSizeZ();
+	const size_t sliceSize = sx*sy;
+	float* const data = img.GetFirstVoxelAddr();
+	if (img.GetImageSize() == 0) return;
+
+	//along x: batches of rows are transposed into a buffer so that
+	//the recursion runs over the rows, a slice per task
+	if (sigmaX >= 0.5f && sx > 1)
+	{
+		const Coefficients c(sigmaX);
+		std::vector< std::vector<float> > buffers((size_t)threads);
+		parallelTasks(sz, threads, [&](const size_t z, const int w)
+		{
+			std::vector<float>& buf = buffers[(size_t)w];
+			buf.resize(linesBatch*(sx+3));
+			float* const lines = buf.data();
+			float* const prev  = lines + linesBatch*sx;
+
+			for (size_t y0 = 0; y0 < sy; y0 += linesBatch)
+			{
+				const size_t b = std::min(linesBatch, sy-y0);
+				float* const rows = data + z*sliceSize + y0*sx;
+
+				for (size_t l = 0; l < b; ++l)
+					for (size_t x = 0; x < sx; ++x) lines[x*b + l] = rows[l*sx + x];
+				filterLines(lines, sx, b, b, c, prev);
+				for (size_t l = 0; l < b; ++l)
+					for (size_t x = 0; x < sx; ++x) rows[l*sx + x] = lines[x*b + l];
+			}
+		});
+	}
+
+	//along y: the recursion runs over whole rows of a slice, a slice per task
+	if (sigmaY >= 0.5f && sy > 1)
+	{
+		const Coefficients c(sigmaY);
+		std::vector< std::vector<float> > buffers((size_t)threads);
+		parallelTasks(sz, threads, [&](const size_t z, const int w)
+		{
+			std::vector<float>& prev = buffers[(size_t)w];
+			prev.resize(3*sx);
+			filterLines(data + z*sliceSize, sy, sx, sx, c, prev.data());
+		});
+	}
+
+	//along z: the recursion runs over the same row in all slices, a row per task
+	if (sigmaZ >= 0.5f && sz > 1)
+	{
+		const Coefficients c(sigmaZ);
+		std::vector< std::vector<float> > buffers((size_t)threads);
+		parallelTasks(sy, threads, [&](const size_t y, const int w)
+		{
+			std::vector<float>& prev = buffers[(size_t)w];
+			prev.resize(3*sx);
+			filterLines(data + y*sx, sz, sx, sliceSize, c, prev.data());
+		});
+	}
+}
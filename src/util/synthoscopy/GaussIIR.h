@@ -0,0 +1,24 @@
+#ifndef UTIL_SYNTHOSCOPY_GAUSSIIR_H
+#define UTIL_SYNTHOSCOPY_GAUSSIIR_H
+
+#include <i3d/image3d.h>
+
+/**
+ * Blurs, in place, the 'img' with the Gaussian of the given sigmas (in pixels),
+ * it is a drop-in for the i3d::GaussIIR() that is parallel and vectorised.
+ *
+ * The Gaussian is approximated with the separable recursive (IIR) filter of
+ * Young and van Vliet [1], a causal and an anti-causal pass along every axis,
+ * computed in the float precision; the boundaries are treated as if the edge
+ * voxels were repeated. Many independent lines are filtered at once so that
+ * the recursion runs over adjacent voxels (vectorisable), and slices (or rows)
+ * of the image are distributed among (up to) 'threads' workers. Axes with
+ * sigma below 0.5 px are left intact (for which the filter is not defined).
+ *
+ * [1] Young, Ian T.; van Vliet, Lucas J. (1995), "Recursive implementation of
+ * the Gaussian filter", Signal Processing 44 (2): 139-151.
+ */
+void ParallelGaussIIR(i3d::Image3d<float>& img,
+                      const float sigmaX, const float sigmaY, const float sigmaZ,
+                      const int threads);
+#endif
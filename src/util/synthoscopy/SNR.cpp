@@ -24,131 +24,64 @@
 *
 ***********************************************************************/
 
+#include <algorithm>
+#include <vector>
 #include <i3d/image3d.h>
 #include "../report.h"
+#include "parallel.h"
+#include "SNR.h"
 
 namespace mitogen
 {
 
-template <class MV, class PV>
-double ComputeSNR(i3d::Image3d<PV> const &img,
-                  i3d::Image3d<MV> const &mask)
+double SNRstats::report() const
 {
-	if (img.GetSize() != mask.GetSize())
-		throw ERROR_REPORT("Phantom and mask images do not match in size.");
-
-	//helper sums for the fg and bg regions
-	double sumFg=0.f, compFg=0.f;
-	double sumBg=0.f, compBg=0.f;
-
-	//sizes
-	unsigned long sizeFg=0;
-	unsigned long sizeBg=0;
-
-	//running pointers
-	const PV* pI=img.GetFirstVoxelAddr();
-	const MV* pM=mask.GetFirstVoxelAddr();
-	PV const *LastpI=img.GetFirstVoxelAddr() + img.GetImageSize();
-
-	//the first pass, computation of the means:
-	//'sum' will accumulate for mean, 'comp' will do the compensation job
-
-	for (; pI != LastpI; ++pI, ++pM) {
-		//first, convert...
-		const double tmp=static_cast<double>(*pI);
-
-		if (*pM) {
-			//foreground
-			const double tmpC=tmp - compFg;
-			const double tmpS=sumFg + tmpC;
-			compFg=(tmpS-sumFg) - tmpC;
-			sumFg=tmpS;
-
-			++sizeFg;
-		} else {
-			//background
-			const double tmpC=tmp - compBg;
-			const double tmpS=sumBg + tmpC;
-			compBg=(tmpS-sumBg) - tmpC;
-			sumBg=tmpS;
-
-			++sizeBg;
-		}
-	}
-
-	const double meanFg=sumFg / (double)sizeFg;
-	const double meanBg=sumBg / (double)sizeBg;
-
-	//the second pass, computation of the variances:
-	//reset vars for first-order accumulations
-	sumFg=0.f; compFg=0.f;
-	sumBg=0.f; compBg=0.f;
-
-	//prepare vars for squared (second-order) accumulations
-	double sum2Fg=0.f, comp2Fg=0.f;
-	double sum2Bg=0.f, comp2Bg=0.f;
-
-	//reset the running pointers
-	pI=img.GetFirstVoxelAddr();
-	pM=mask.GetFirstVoxelAddr();
+	const double SNR = getSNR();
 
-	for (; pI != LastpI; ++pI, ++pM) {
-		//first, convert...
-		const double tmp=static_cast<double>(*pI);
-
-		if (*pM) {
-			//foreground
-			/* naive version, btw: shouldn't we do Kahan here as well?
-			sumFg+=(tmp-meanFg);
-			sum2Fg+=(tmp-meanFg) * (tmp-meanFg);
-			*/
-			double tmpC=(tmp-meanFg) - compFg;
-			double tmpS=sumFg + tmpC;
-			compFg=(tmpS-sumFg) - tmpC;
-			sumFg=tmpS;
-
-			tmpC=(tmp-meanFg)*(tmp-meanFg) - comp2Fg;
-			tmpS=sum2Fg + tmpC;
-			comp2Fg=(tmpS-sum2Fg) - tmpC;
-			sum2Fg=tmpS;
-		} else {
-			//background
-			/* naive version, btw: shouldn't we do Kahan here as well?
-			sumBg+=(tmp-meanBg);
-			sum2Bg+=(tmp-meanBg) * (tmp-meanBg);
-			*/
-			double tmpC=(tmp-meanBg) - compBg;
-			double tmpS=sumBg + tmpC;
-			compBg=(tmpS-sumBg) - tmpC;
-			sumBg=tmpS;
-
-			tmpC=(tmp-meanBg)*(tmp-meanBg) - comp2Bg;
-			tmpS=sum2Bg + tmpC;
-			comp2Bg=(tmpS-sum2Bg) - tmpC;
-			sum2Bg=tmpS;
-		}
-	}
-
-	const double devFg=sqrt( (sum2Fg - sumFg*sumFg/(double)sizeFg) / (double)sizeFg );
-	const double devBg=sqrt( (sum2Bg - sumBg*sumBg/(double)sizeBg) / (double)sizeBg );
-
-	const double SNR=(meanFg - meanBg) / devBg;
-
-	DEBUG_REPORT("fg / bg volume ratio: " << (double)sizeFg / (double)sizeBg
-			<< ", fg constitues " << (double)sizeFg/(double)mask.GetImageSize()*100.f
+	DEBUG_REPORT("fg / bg volume ratio: " << (double)fg.n / (double)bg.n
+			<< ", fg constitues " << (double)fg.n/(double)(fg.n + bg.n)*100.f
 			<< "% of the image volume");
-	DEBUG_REPORT("fg signal is " << meanFg << " +- " << devFg
-			<< ", bg signal is " << meanBg << " +- " << devBg);
-	DEBUG_REPORT("SNR=" << SNR << ", CR=" << meanFg/meanBg);
+	DEBUG_REPORT("fg signal is " << fg.mean << " +- " << fg.stdDev()
+			<< ", bg signal is " << bg.mean << " +- " << bg.stdDev());
+	DEBUG_REPORT("SNR=" << SNR << ", CR=" << fg.mean/bg.mean);
 
 	//tagged and formated for machine processing of the SNR related data...
-	REPORT("SNR " << SNR << " " << meanFg << " "
-		<< meanBg << " " << devFg << " " << devBg);
+	REPORT("SNR " << SNR << " " << fg.mean << " "
+		<< bg.mean << " " << fg.stdDev() << " " << bg.stdDev());
 
 	return (SNR);
 }
 
 
+template <class MV, class PV>
+double ComputeSNR(i3d::Image3d<PV> const &img,
+                  i3d::Image3d<MV> const &mask)
+{
+	if (img.GetSize() != mask.GetSize())
+		throw ERROR_REPORT("Phantom and mask images do not match in size.");
+
+	const size_t chunk = 1 << 16;
+	const size_t imgSize = img.GetImageSize();
+	const size_t chunks = (imgSize+chunk-1) / chunk;
+
+	const PV* const pI = img.GetFirstVoxelAddr();
+	const MV* const pM = mask.GetFirstVoxelAddr();
+
+	std::vector<SNRstats> chunkStats(chunks);
+	parallelTasks(chunks, getSynthoscopyThreads(), [&](const size_t c, const int)
+	{
+		SNRstats& s = chunkStats[c];
+		const size_t last = std::min(imgSize, (c+1)*chunk);
+		for (size_t i = c*chunk; i < last; ++i)
+			s.add(static_cast<double>(pI[i]), pM[i] != 0);
+	});
+
+	SNRstats stats;
+	for (const SNRstats& s : chunkStats) stats.merge(s);
+	return stats.report();
+}
+
+
 //
 // explicit instantiations (just one, for now...)
 //
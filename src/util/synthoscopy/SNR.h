@@ -27,6 +27,7 @@
 *
 ***********************************************************************/
 
+#include <cmath>
 #include <i3d/image3d.h>
 
 namespace mitogen
@@ -35,50 +36,99 @@ namespace mitogen
 /**
  * \ingroup toolbox
  *
- * Computes the Signal-to-Noise Ratio (SNR) of the input image \e img
- * given that signal voxels are those within the mask \e mask.
- * Voxels outside the mask are considered as background.
+ * One-pass (streaming) accumulator of what is needed for the SNR: the counts,
+ * means and sums of squared deviations from the means (M2) of the foreground
+ * and background voxels. Values are added with the Welford's algorithm [1],
+ * partial accumulators (e.g., of image chunks processed in parallel) are
+ * merged with the pairwise formula of Chan et al. [2].
  *
  * The SNR is computed as:
  * \verbatim
  * (avg(fg region) - avg(bg region)) / std_dev(bg region)
  * \endverbatim
  *
- * This function, however, uses two-pass algorithms for 'compensated'
- * computations of both the mean and variance. It should be more accurate.
- *
- * For the mean, Kahan summation alg. is used [1].
- * \verbatim
- * mean=0
- * compensation=0	//a running compensation for lost low-order bits
- *
- * for d in data_to_be_summed
- *   d_compensated=d-compensation
- *   sum=mean+d_compensated							//this potentially loses low-order bits
- *   compensation=(sum-mean) - d_compensated		//recovers what's been lost and adds it in the next round,
- *   															//algebraically, 'compensation' should be zero
- *   mean=sum
- * endfor
- * \endverbatim
- *
- * For the variance (square of the standard deviation) the eq. (1.4) [2],\
- * the prof. Bjorek's alg., is used.
- * \verbatim
- * d is data_to_be_summed, mean is mean of this data:
- * variance=[ sum(d-mean)^2 - (sum(d-mean))^2/N ] / N
- * \endverbatim
- * The Kahan summation is applied for both summations as well.
- *
  * Literature:
  *
- * [1] Kahan, William (January 1965), "Further remarks on reducing truncation errors",
- * Communications of the ACM 8 (1): 40, doi:10.1145/363707.363723.
- * http://en.wikipedia.org/wiki/Kahan_summation_algorithm
+ * [1] Welford, B. P. (1962), "Note on a method for calculating corrected sums of
+ * squares and products", Technometrics 4 (3): 419-420, doi:10.2307/1266577.
  *
  * [2] Chan, Tony F.; Golub, Gene H.; LeVeque, Randall J. (1979),
  * "Updating Formulae and a Pairwise Algorithm for Computing Sample Variances.",
  * Technical Report STAN-CS-79-773, Department of Computer Science, Stanford University.
  * ftp://reports.stanford.edu/pub/cstr/reports/cs/tr/79/773/CS-TR-79-773.pdf
+ */
+class SNRstats
+{
+public:
+	struct Region
+	{
+		unsigned long n = 0;
+		double mean = 0, M2 = 0;
+
+		void add(const double x)
+		{
+			++n;
+			const double delta = x - mean;
+			mean += delta / (double)n;
+			M2   += delta * (x - mean);
+		}
+
+		void merge(const Region& r)
+		{
+			if (r.n == 0) return;
+			const double N = (double)(n + r.n);
+			const double delta = r.mean - mean;
+			mean += delta * (double)r.n / N;
+			M2   += r.M2 + delta*delta * (double)n * (double)r.n / N;
+			n    += r.n;
+		}
+
+		double stdDev() const
+		{ return n > 0 ? std::sqrt(M2 / (double)n) : 0.0; }
+	};
+
+	Region fg, bg;
+
+	void add(const double value, const bool isForeground)
+	{
+		if (isForeground) fg.add(value);
+		else              bg.add(value);
+	}
+
+	void merge(const SNRstats& s)
+	{
+		fg.merge(s.fg);
+		bg.merge(s.bg);
+	}
+
+	void clear()
+	{
+		fg = Region();
+		bg = Region();
+	}
+
+	bool isEmpty() const
+	{ return fg.n == 0 && bg.n == 0; }
+
+	double getSNR() const
+	{ return (fg.mean - bg.mean) / bg.stdDev(); }
+
+	/** reports (in the machine-processable form) and returns the SNR */
+	double report() const;
+};
+
+
+/**
+ * \ingroup toolbox
+ *
+ * Computes the Signal-to-Noise Ratio (SNR) of the input image \e img
+ * given that signal voxels are those within the mask \e mask.
+ * Voxels outside the mask are considered as background.
+ *
+ * The image is read only once, in chunks that are processed in parallel
+ * (see getSynthoscopyThreads()) each into its own SNRstats; these are merged
+ * in the order of the chunks so that the result does not depend on the
+ * number of threads.
  *
  * \param[in] img		image of which SNR is to be computed
  * \param[in] mask	corresponding mask image
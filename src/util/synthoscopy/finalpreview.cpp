@@ -29,6 +29,8 @@
 *
 ***********************************************************************/
 
+#include <algorithm>
+#include <vector>
 #include <i3d/image3d.h>
 #include <i3d/filters.h>
 #include <i3d/morphology.h>
@@ -36,6 +38,8 @@
 
 #include "../report.h"
 #include "../rnd_generators.h"
+#include "GaussIIR.h"
+#include "parallel.h"
 #include "finalpreview.h"
 
 namespace mitogen
@@ -43,31 +47,51 @@ namespace mitogen
 
 template <class PV, class FV>
 void PrepareFinalPreviewImage(i3d::Image3d<PV> &phantom,
-										i3d::Image3d<FV> &final)
+										i3d::Image3d<FV> &final,
+										const int frameNo)
 {
-	i3d::GaussIIR(phantom,
+	ParallelGaussIIR(phantom,
 		0.13f*phantom.GetResolution().GetX(),
 		0.13f*phantom.GetResolution().GetY(),
-		//0.15f*phantom.GetResolution().GetZ());	//2D
-		0.26f*phantom.GetResolution().GetZ());	//3D
+		//0.15f*phantom.GetResolution().GetZ(),	//2D
+		0.26f*phantom.GetResolution().GetZ(),	//3D
+		getSynthoscopyThreads());
 	
-	//running pointers
-	PV* pF = phantom.GetFirstVoxelAddr();
-	PV* const pFlast = pF + phantom.GetImageSize();
-	for (; pF != pFlast; ++pF)
+	//the noise is drawn in chunks of voxels, every chunk
+	//(of every frame) has its own counter-based random streams
+	const size_t chunk = 4096;
+	std::vector<float> noiseMean(chunk), photons(chunk), darkPhotons(chunk), readout(chunk);
+
+	const size_t imgSize = phantom.GetImageSize();
+	for (size_t c = 0; c < imgSize; c += chunk)
 	{
+		const size_t n = std::min(chunk, imgSize-c);
+		const int chunkNo = (int)(c / chunk);
+		PV* const pF = phantom.GetFirstVoxelAddr() + c;
+
 		//uncertainty in the number of incoming photons
-		const float noiseMean = std::sqrt(*pF); // from statistics: shot noise = sqrt(signal)
-		*pF += (PV)GetRandomPoisson(noiseMean) - noiseMean;
+		for (size_t j = 0; j < n; ++j)
+			noiseMean[j] = std::sqrt((float)pF[j]); // from statistics: shot noise = sqrt(signal)
+		rndStream rngPhotons(chunkNo,frameNo,finalPreview_photonNoise);
+		FillRandomPoisson(photons.data(),noiseMean.data(),n, rngPhotons);
 
 		//constants are parameters of Andor iXon camera provided from vendor:
 		//photon shot noise: dark current
-		*pF += (PV)GetRandomPoisson(0.06f);
+		rndStream rngDarkCurrent(chunkNo,frameNo,finalPreview_darkCurrent);
+		FillRandomPoisson(darkPhotons.data(),n, 0.06f, rngDarkCurrent);
 
 		//read-out noise:
 		//  variance up to 25.f (old camera on ILBIT)
 		//  variance about 1.f (for the new camera on ILBIT)
-		*pF += std::max(0.f,GetRandomGauss(700.f,90.f));
+		rndStream rngReadout(chunkNo,frameNo,finalPreview_readoutNoise);
+		FillRandomGauss(readout.data(),n, 700.f,90.f, rngReadout);
+
+		for (size_t j = 0; j < n; ++j)
+		{
+			pF[j] += (PV)photons[j] - noiseMean[j];
+			pF[j] += (PV)darkPhotons[j];
+			pF[j] += std::max(0.f,readout[j]);
+		}
 	}
 
 	i3d::FloatToGrayNoWeight(phantom,final);
@@ -90,6 +114,7 @@ void PrepareFinalPreviewImage(i3d::Image3d<PV> &phantom,
 // explicit instantiations (just one, for now...)
 //
 template void PrepareFinalPreviewImage(i3d::Image3d<float> &phantom,
-                                       i3d::Image3d<i3d::GRAY16> &final);
+                                       i3d::Image3d<i3d::GRAY16> &final,
+                                       const int frameNo);
 
 } //end of the namespace
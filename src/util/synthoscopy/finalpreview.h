@@ -46,6 +46,7 @@ namespace mitogen
  *
  * \param[in,out] phantom	phantom image (the input phantom image can be modified!)
  * \param[out] final			finale preview image
+ * \param[in] frameNo		index of the image, its noise is given by it
  * \param[in] configIni		configuration of the simulation
  *
  * The \e phantom and \e mask images must be of the same size and resolution.
@@ -53,7 +54,8 @@ namespace mitogen
  */
 template <class PV, class FV>
 void PrepareFinalPreviewImage(i3d::Image3d<PV> &phantom,
-										i3d::Image3d<FV> &final);
+										i3d::Image3d<FV> &final,
+										const int frameNo);
 
 }
 #endif
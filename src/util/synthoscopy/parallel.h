@@ -0,0 +1,58 @@
+#ifndef UTIL_SYNTHOSCOPY_PARALLEL_H
+#define UTIL_SYNTHOSCOPY_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/** how many threads the image synthesis may use, the EMBRYOGEN_SYNTHOSCOPY_THREADS
+    environment variable can override the number of CPU cores */
+inline int getSynthoscopyThreads()
+{
+	const char* envThreads = std::getenv("EMBRYOGEN_SYNTHOSCOPY_THREADS");
+	int threads = envThreads != NULL ? std::atoi(envThreads) : (int)std::thread::hardware_concurrency();
+	return threads > 0 ? threads : 1;
+}
+
+/**
+ * Executes task(t,w) for every t from [0,tasksCount) using a team of (at most)
+ * 'threads' workers, the 'w' is the index of the worker from [0,threads) so that
+ * the task can use per-worker buffers. Tasks are handed out in the increasing
+ * order of 't' as the workers become free. The calling thread is one of the workers
+ * and the function returns after all tasks are done; the first exception thrown
+ * from any task is re-thrown here (after the other workers have finished).
+ */
+template <class TASK>
+void parallelTasks(const size_t tasksCount, const int threads, TASK task)
+{
+	std::atomic<size_t> nextTask(0);
+	std::exception_ptr failure;
+	std::mutex failureLock;
+
+	auto worker = [&](const int w)
+	{
+		try
+		{
+			for (size_t t = nextTask++; t < tasksCount; t = nextTask++) task(t,w);
+		}
+		catch (...)
+		{
+			std::lock_guard<std::mutex> lock(failureLock);
+			if (!failure) failure = std::current_exception();
+			nextTask = tasksCount; //no new tasks for anyone
+		}
+	};
+
+	const int helpers = (int)std::min((size_t)threads, tasksCount) - 1;
+	std::vector<std::thread> team;
+	for (int w = 1; w <= helpers; ++w) team.emplace_back(worker,w);
+	worker(0);
+	for (auto& t : team) t.join();
+
+	if (failure) std::rethrow_exception(failure);
+}
+#endif
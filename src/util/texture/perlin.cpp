@@ -7,10 +7,6 @@
 #include "../rnd_generators.h"
 #include "perlin.h"
 
-#ifdef _MSC_VER
-  #define random() rand()
-#endif
-
 #define B 0x100
 #define BM 0xff
 #define N 0x1000
@@ -28,11 +24,12 @@
 #define at2(rx,ry) ( rx * q[0] + ry * q[1] )
 #define at3(rx,ry,rz) ( rx * q[0] + ry * q[1] + rz * q[2] )
 
-static int p[B + B + 2];
-static double g3[B + B + 2][3];
-static double g2[B + B + 2][2];
-static double g1[B + B + 2];
-static int start = 1;
+/* the tables are per thread, FOs may run as threads of one process */
+static thread_local int p[B + B + 2];
+static thread_local double g3[B + B + 2][3];
+static thread_local double g2[B + B + 2][2];
+static thread_local double g1[B + B + 2];
+static thread_local int start = 1;
 
 double noise1(double arg)
 {
@@ -161,28 +158,28 @@ void normalize3(double v[3])
 
 void init(void)
 {
-	//reset the random() with some random seed,
-	//which must come from some different generator...
-	srandom( (unsigned int)GetRandomUniform(0,32000) );
+	//own stream with some random seed, which must come from some different
+	//generator... (not the random() whose state is shared by all threads)
+	rndStream stream( (uint64_t)GetRandomUniform(0,32000), 0,0,perlinNoiseTables );
 
    int i, j, k;
 
    for (i = 0 ; i < B ; i++) {
       p[i] = i;
-      g1[i] = (double)((random() % (B + B)) - B) / B;
+      g1[i] = (double)((int)(stream.nextBits() % (B + B)) - B) / B;
 
       for (j = 0 ; j < 2 ; j++)
-         g2[i][j] = (double)((random() % (B + B)) - B) / B;
+         g2[i][j] = (double)((int)(stream.nextBits() % (B + B)) - B) / B;
       normalize2(g2[i]);
 
       for (j = 0 ; j < 3 ; j++)
-         g3[i][j] = (double)((random() % (B + B)) - B) / B;
+         g3[i][j] = (double)((int)(stream.nextBits() % (B + B)) - B) / B;
       normalize3(g3[i]);
    }
 
    while (--i) {
       k = p[i];
-      p[i] = p[j = (int)(random() % B)];
+      p[i] = p[j = (int)(stream.nextBits() % B)];
       p[j] = k;
    }
 
@@ -259,3 +256,145 @@ double PerlinNoise3D(double x,double y,double z,double alpha,double beta,int n)
    return(sum);
 }
 
+
+/* --- Reentrant float variant of noise3() and PerlinNoise3D() ------------------*/
+
+const int PerlinNoiseGenerator::period;
+const size_t PerlinNoiseGenerator::blockSize;
+
+PerlinNoiseGenerator::PerlinNoiseGenerator(const uint64_t seed)
+{
+   rndStream stream(seed, 0,0,perlinNoiseTables);
+   createTables(stream);
+}
+
+PerlinNoiseGenerator::PerlinNoiseGenerator(rndStream& stream)
+{
+   createTables(stream);
+}
+
+void PerlinNoiseGenerator::createTables(rndStream& stream)
+{
+   //the same construction as in init(), just with the given stream
+   int i, j, k;
+
+   for (i = 0 ; i < period ; i++) {
+      perm[i] = i;
+
+      double v[3], s;
+      do {
+         for (j = 0 ; j < 3 ; j++)
+            v[j] = (double)((int)(stream.nextBits() % (2*period)) - period) / period;
+         s = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+      } while (s == 0); //init() would divide by zero here
+      gx[i] = (float)(v[0] / s);
+      gy[i] = (float)(v[1] / s);
+      gz[i] = (float)(v[2] / s);
+   }
+
+   while (--i) {
+      k = perm[i];
+      perm[i] = perm[j = (int)(stream.nextBits() % period)];
+      perm[j] = k;
+   }
+
+   for (i = 0 ; i < period + 2 ; i++) {
+      perm[period + i] = perm[i];
+      gx[period + i] = gx[i];
+      gy[period + i] = gy[i];
+      gz[period + i] = gz[i];
+   }
+}
+
+void PerlinNoiseGenerator::addOctave(const float* x, const float* y, const float* z,
+                              float* out, const size_t count,
+                              const double freq, const float weight) const
+{
+   //lattice cells and positions within them (the 'setup' of noise3()),
+   //the cells' neighbours (b1 in 'setup') are not wrapped as the tables
+   //are repeated: perm[b+1] == perm[(b+1) & BM] for all b < B
+   int bx[blockSize], by[blockSize], bz[blockSize];
+   float rx[blockSize], ry[blockSize], rz[blockSize];
+   for (size_t l = 0; l < count; ++l)
+   {
+      const double tx = x[l]*freq, ty = y[l]*freq, tz = z[l]*freq;
+      const double fx = floor(tx), fy = floor(ty), fz = floor(tz);
+      bx[l] = (int)((int64_t)fx & BM);
+      by[l] = (int)((int64_t)fy & BM);
+      bz[l] = (int)((int64_t)fz & BM);
+      rx[l] = (float)(tx - fx);
+      ry[l] = (float)(ty - fy);
+      rz[l] = (float)(tz - fz);
+   }
+
+   for (size_t l = 0; l < count; ++l)
+   {
+      const int i = perm[ bx[l] ];
+      const int j = perm[ bx[l]+1 ];
+
+      const int b00 = perm[ i + by[l] ]   + bz[l];
+      const int b10 = perm[ j + by[l] ]   + bz[l];
+      const int b01 = perm[ i + by[l]+1 ] + bz[l];
+      const int b11 = perm[ j + by[l]+1 ] + bz[l];
+
+      const float rx0 = rx[l], rx1 = rx0 - 1.f;
+      const float ry0 = ry[l], ry1 = ry0 - 1.f;
+      const float rz0 = rz[l], rz1 = rz0 - 1.f;
+
+      const float t  = rx0 * rx0 * (3.f - 2.f * rx0);
+      const float sy = ry0 * ry0 * (3.f - 2.f * ry0);
+      const float sz = rz0 * rz0 * (3.f - 2.f * rz0);
+
+#define at(b,rx,ry,rz) ( rx * gx[b] + ry * gy[b] + rz * gz[b] )
+      float u = at(b00,rx0,ry0,rz0);
+      float v = at(b10,rx1,ry0,rz0);
+      float a = lerp(t, u, v);
+
+      u = at(b01,rx0,ry1,rz0);
+      v = at(b11,rx1,ry1,rz0);
+      float b = lerp(t, u, v);
+
+      const float c = lerp(sy, a, b);
+
+      u = at(b00+1,rx0,ry0,rz1);
+      v = at(b10+1,rx1,ry0,rz1);
+      a = lerp(t, u, v);
+
+      u = at(b01+1,rx0,ry1,rz1);
+      v = at(b11+1,rx1,ry1,rz1);
+      b = lerp(t, u, v);
+#undef at
+
+      const float d = lerp(sy, a, b);
+
+      out[l] += weight * lerp(sz, c, d);
+   }
+}
+
+void PerlinNoiseGenerator::noise(const float* x, const float* y, const float* z,
+                          float* out, const size_t count) const
+{
+   for (size_t i = 0; i < count; ++i) out[i] = 0;
+
+   for (size_t i = 0; i < count; i += blockSize)
+      addOctave(x+i,y+i,z+i, out+i, (count-i < blockSize ? count-i : blockSize), 1.0, 1.f);
+}
+
+void PerlinNoiseGenerator::harmonicNoise(const float* x, const float* y, const float* z,
+                                  float* out, const size_t count,
+                                  const double alpha, const double beta, const int n) const
+{
+   for (size_t i = 0; i < count; ++i) out[i] = 0;
+
+   for (size_t i = 0; i < count; i += blockSize)
+   {
+      const size_t c = count-i < blockSize ? count-i : blockSize;
+      double freq = 1, scale = 1;
+      for (int o = 0; o < n; ++o)
+      {
+         addOctave(x+i,y+i,z+i, out+i, c, freq, (float)(1.0/scale));
+         scale *= alpha;
+         freq  *= beta;
+      }
+   }
+}
@@ -4,6 +4,9 @@
 #ifndef _PERLIN_
 #define _PERLIN_
 
+#include <cstddef>
+#include <cstdint>
+
 void init(void);
 double noise1(double);
 double noise2(double *);
@@ -15,4 +18,76 @@ double PerlinNoise1D(double,double,double,int);
 double PerlinNoise2D(double,double,double,double,int);
 double PerlinNoise3D(double,double,double,double,double,int);
 
+class rndStream;
+
+/**
+ * Reentrant 3D coherent (Perlin) noise: the same lattice noise as noise3() and
+ * PerlinNoise3D() but every instance has its own permutation and gradient
+ * tables, which are created from an explicit seed (rather than from random()).
+ * Instances are never modified after their construction, they can be thus
+ * shared among threads, and the same seed gives the same noise on every run.
+ *
+ * The noise is computed in float for many points at once: the points are
+ * given as separate arrays of x, y and z coordinates and are processed in
+ * blocks whose loops are laid out to be vectorised. Only the splitting of
+ * the coordinates into the lattice cell and the position within it is done
+ * in double, the coordinates of the finest octaves can be large.
+ */
+class PerlinNoiseGenerator
+{
+public:
+	/** tables made from the stream of the given 'seed' */
+	explicit PerlinNoiseGenerator(const uint64_t seed);
+
+	/** tables made from the next numbers of the 'stream' */
+	explicit PerlinNoiseGenerator(rndStream& stream);
+
+	/** out[i] = noise at (x[i],y[i],z[i]), this is what noise3() computes */
+	void noise(const float* x, const float* y, const float* z,
+	           float* out, const size_t count) const;
+
+	/** out[i] = harmonic sum of 'n' octaves of the noise at (x[i],y[i],z[i]),
+	    this is what PerlinNoise3D() computes (see there for 'alpha' and 'beta') */
+	void harmonicNoise(const float* x, const float* y, const float* z,
+	                   float* out, const size_t count,
+	                   const double alpha, const double beta, const int n) const;
+
+	/** the noise at the single point */
+	float noise(const float x, const float y, const float z) const
+	{
+		float out;
+		noise(&x,&y,&z, &out,1);
+		return out;
+	}
+
+	/** the harmonic sum at the single point */
+	float harmonicNoise(const float x, const float y, const float z,
+	                    const double alpha, const double beta, const int n) const
+	{
+		float out;
+		harmonicNoise(&x,&y,&z, &out,1, alpha,beta,n);
+		return out;
+	}
+
+protected:
+	/** the period of the lattice, and the size of the tables */
+	static const int period = 0x100;
+
+	/** permutation of [0,period), repeated twice and then some */
+	int perm[2*period + 2];
+
+	/** unit gradients, as x, y and z components, indexed (as perm) twice and then some */
+	float gx[2*period + 2], gy[2*period + 2], gz[2*period + 2];
+
+	void createTables(rndStream& stream);
+
+	/** out[i] += weight * noise at (x[i],y[i],z[i])*freq, for at most blockSize points */
+	void addOctave(const float* x, const float* y, const float* z,
+	               float* out, const size_t count,
+	               const double freq, const float weight) const;
+
+	/** how many points are processed at once */
+	static const size_t blockSize = 64;
+};
+
 #endif
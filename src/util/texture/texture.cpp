@@ -29,11 +29,13 @@ Description: Manipulation with procedural texture (Perlin noise).
 	#include <time.h>
 #endif
 
+#include <vector>
 #include <i3d/histogram.h>
 #include <i3d/transform.h>
 
 #include "../report.h"
 #include "../rnd_generators.h"
+#include "../synthoscopy/parallel.h"
 #include "perlin.h"
 #include "texture.h"
 #include "myround.h"
@@ -41,47 +43,80 @@ Description: Manipulation with procedural texture (Perlin noise).
 using namespace i3d;
 using namespace std;
 
-rndGeneratorHandle textureOwnRng;
+/// one per thread, FOs may run as threads of one process
+thread_local rndGeneratorHandle textureOwnRng;
 
 /***************************************************************************/
-/** Generate 3D Perlin noise and store the result **/
-void DoPerlin3D(Image3d<float> &fimg,
+/** Fill the image with the noise at the (shifted) voxel coordinates **/
+static void DoPerlin3D(Image3d<float> &fimg,
+						const PerlinNoiseGenerator& perlin,
+						const Vector3d<float>& shift,
 						double var,
 						double alpha,
 						double beta,
-						int n)
+						int n,
+						int threads)
 {
 	 if (!fimg.GetResolution().IsDefined())
 	 {
 		  throw ERROR_REPORT("Image resolution is not set.");
 	 }
 
-	 // 'var' is in microns - function PerlinNoise3D requires pixels as
+	 // 'var' is in microns - the noise requires pixels as
 	 // the reference unit. We must convert it.
 	 Vector3d<float> res = fimg.GetResolution().GetRes();
 	 double v_x = var * res.x,
 			  v_y = var * res.y,
 			  v_z = var * res.z;
-	 
+
+	 const size_t sx = fimg.GetSizeX(), sy = fimg.GetSizeY();
+	 std::vector<float> xs(sx);
+	 for (size_t x=0; x < sx; ++x) xs[x] = (float)((shift.x + (float)x) / v_x);
+
+	 // a whole row at once, a slice per task
+	 parallelTasks(fimg.GetSizeZ(), threads, [&](const size_t z, const int)
+	 {
+		  std::vector<float> ys, zs(sx, (float)((shift.z + (float)z) / v_z));
+		  for (size_t y=0; y < sy; ++y)
+		  {
+				ys.assign(sx, (float)((shift.y + (float)y) / v_y));
+				perlin.harmonicNoise(xs.data(),ys.data(),zs.data(),
+				                     fimg.GetVoxelAddr(0,y,z), sx, alpha,beta,n);
+		  }
+	 });
+}
+
+/***************************************************************************/
+/** Generate 3D Perlin noise and store the result **/
+void DoPerlin3D(Image3d<float> &fimg,
+						double var,
+						double alpha,
+						double beta,
+						int n)
+{
+	 // the tables are shared by all calls, they are made
+	 // on the first call as in the original noise3()
+	 static const PerlinNoiseGenerator sharedPerlin( (uint64_t)GetRandomUniform(0,32000) );
+
 	 // First, place the image in the random position within the space.
 	 // This guarantee that the result won't be the same in all the cases!
- 
-	 float shift_x = GetRandomUniform(0,1000, textureOwnRng);
-	 float shift_y = GetRandomUniform(0,1000, textureOwnRng);
-	 float shift_z = GetRandomUniform(0,1000, textureOwnRng);
-
-	 for (size_t i=0; i<fimg.GetImageSize(); i++)
-			 {
-				 double x,y,z;
-
-				 x = shift_x + (float)fimg.GetX(i);
-				 y = shift_y + (float)fimg.GetY(i);
-				 z = shift_z + (float)fimg.GetZ(i);
-				 
-				 float noise = (float) PerlinNoise3D(x/v_x, y/v_y, z/v_z, alpha, beta, n);
-
-				 fimg.SetVoxel(i, noise);
-			  }
+	 Vector3d<float> shift;
+	 shift.x = GetRandomUniform(0,1000, textureOwnRng);
+	 shift.y = GetRandomUniform(0,1000, textureOwnRng);
+	 shift.z = GetRandomUniform(0,1000, textureOwnRng);
+
+	 DoPerlin3D(fimg, sharedPerlin, shift, var, alpha, beta, n, 1);
+}
+
+void DoPerlin3D(Image3d<float> &fimg,
+						const PerlinNoiseGenerator& perlin,
+						double var,
+						double alpha,
+						double beta,
+						int n,
+						int threads)
+{
+	 DoPerlin3D(fimg, perlin, Vector3d<float>(0), var, alpha, beta, n, threads);
 }
 
 /***************************************************************************/
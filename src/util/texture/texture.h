@@ -29,6 +29,7 @@ Description: Manipulation with procedural texture (Perlin noise).
 #define _TEXTURE_
 
 #include <i3d/image3d.h>
+#include "perlin.h"
 
 /**
  * Generate Perlin noise and put the results into image3d<float> image:
@@ -49,6 +50,20 @@ void DoPerlin3D(i3d::Image3d<float> &fimg,
 						double beta = 4,
 						int n = 6);
 
+/**
+ * The same as above but the noise comes from the given 'perlin' generator, and is
+ * evaluated right at the voxel coordinates (not at randomly shifted ones). Rows of
+ * voxels are evaluated at once, and slices are distributed among up to 'threads'
+ * workers; the result depends only on the generator (its seed) and the parameters.
+ */
+void DoPerlin3D(i3d::Image3d<float> &fimg,
+						const PerlinNoiseGenerator& perlin,
+						double var,
+						double alpha = 8,
+						double beta = 4,
+						int n = 6,
+						int threads = 1);
+
 //------------------------------------------------------------------------
 /*template <class VOXEL> void GenPerlin(
 		i3d::Image3d<VOXEL> &img, // empty already allocated image